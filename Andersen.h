@@ -0,0 +1,998 @@
+/************************************************************************
+ *
+ * @file Andersen.h
+ *
+ * Flow-insensitive, inclusion-based (Andersen-style) pointer analysis
+ *
+ ***********************************************************************/
+
+#ifndef _ANDERSEN_H_
+#define _ANDERSEN_H_
+
+#include <llvm/ADT/SparseBitVector.h>
+#include <llvm/IR/Constants.h>
+#include <llvm/IR/Module.h>
+#include <llvm/IR/Operator.h>
+
+#include "Liveness.h"
+#include "Slice.h"
+
+#include <map>
+#include <set>
+#include <vector>
+using namespace llvm;
+
+enum ConstraintKind
+{
+    CK_AddrOf, /// dst ⊇ {src}, src is an object node
+    CK_Copy,   /// dst ⊇ src
+    CK_Load,   /// dst ⊇ *src
+    CK_Store   /// *dst ⊇ src
+};
+
+struct Constraint
+{
+    ConstraintKind kind;
+    unsigned dst;
+    unsigned src;
+    Constraint(ConstraintKind kind, unsigned dst, unsigned src) : kind(kind), dst(dst), src(src) {}
+};
+
+///
+/// A call through the pointer held by node callee. Every function object
+/// callee may point to gets its formals bound to args and its return node
+/// copied into ret. Direct calls are calls through the function's own node.
+///
+struct CallConstraint
+{
+    unsigned callee;
+    std::vector<unsigned> args; /// 0 for arguments that are not pointers
+    unsigned ret;               /// 0 if the result is not a pointer
+    CallInst *inst;
+    CallConstraint(unsigned callee, CallInst *inst) : callee(callee), args(), ret(0), inst(inst) {}
+};
+
+/// Interface nodes of a function, keyed by its object node
+struct FunctionNodes
+{
+    std::vector<unsigned> formals; /// 0 for parameters that are not pointers
+    unsigned ret;                  /// 0 if the function does not return a pointer
+    Function *func;
+    FunctionNodes() : formals(), ret(0), func(nullptr) {}
+};
+
+///
+/// Constraint graph over numbered nodes. Node 0 means "no node", so it is
+/// never used as an endpoint.
+///
+struct ConstraintGraph
+{
+    unsigned num_nodes;
+    std::vector<Constraint> constraints;
+    std::vector<CallConstraint> calls;
+    std::map<unsigned, FunctionNodes> functions;
+    std::vector<unsigned> equiv; /// representative of each node, see substitutePointerEquivalents
+
+    ConstraintGraph() : num_nodes(1), constraints(), calls(), functions(), equiv() {}
+
+    unsigned addNode() { return num_nodes++; }
+
+    void addConstraint(ConstraintKind kind, unsigned dst, unsigned src)
+    {
+        if (dst && src)
+        {
+            constraints.push_back(Constraint(kind, dst, src));
+        }
+    }
+};
+
+///
+/// Builds the constraint graph of a module from the instructions that
+/// LivenessVisitor handles: store, load, GEP, bitcast, phi, call, return
+/// and memcpy. Every pointer value has a node holding its points-to set;
+/// every alloca, global, function and heap allocation site has an object
+/// node holding the points-to set of its contents (field-insensitive).
+///
+class ConstraintBuilder
+{
+public:
+    std::map<Value *, unsigned> value_nodes;
+    std::map<Value *, unsigned> object_nodes;
+
+    ConstraintBuilder(ConstraintGraph *graph) : value_nodes(), object_nodes(), graph(graph) {}
+
+    void build(Module &M)
+    {
+        for (auto gi = M.global_begin(), ge = M.global_end(); gi != ge; gi++)
+        {
+            GlobalVariable *global = &*gi;
+            getValueNode(global);
+            if (global->hasInitializer())
+            {
+                addInitializer(getObjectNode(global), global->getInitializer());
+            }
+        }
+        for (auto &F : M)
+        {
+            if (F.isDeclaration())
+            {
+                continue;
+            }
+            for (inst_iterator ii = inst_begin(&F), ie = inst_end(&F); ii != ie; ii++)
+            {
+                visit(&*ii);
+            }
+        }
+    }
+
+    /// Node of a pointer value, 0 for null, undef and other constants
+    unsigned getValueNode(Value *v)
+    {
+        v = stripConstantCasts(v);
+        if (isa<Constant>(v) && !isa<GlobalValue>(v))
+        {
+            return 0;
+        }
+        auto it = value_nodes.find(v);
+        if (it != value_nodes.end())
+        {
+            return it->second;
+        }
+        unsigned node = graph->addNode();
+        value_nodes[v] = node;
+        if (isa<GlobalValue>(v))
+        {
+            graph->addConstraint(CK_AddrOf, node, getObjectNode(v));
+        }
+        return node;
+    }
+
+    /// Node of a pointer value if it has one, without creating it
+    unsigned lookupValueNode(Value *v) const
+    {
+        auto it = value_nodes.find(stripConstantCasts(v));
+        return it == value_nodes.end() ? 0 : it->second;
+    }
+
+    /// Node of the memory object allocated by v
+    unsigned getObjectNode(Value *v)
+    {
+        auto it = object_nodes.find(v);
+        if (it != object_nodes.end())
+        {
+            return it->second;
+        }
+        unsigned node = graph->addNode();
+        object_nodes[v] = node;
+        if (auto *func = dyn_cast<Function>(v))
+        {
+            FunctionNodes &fn = graph->functions[node];
+            fn.func = func;
+            for (auto ai = func->arg_begin(), ae = func->arg_end(); ai != ae; ai++)
+            {
+                fn.formals.push_back(ai->getType()->isPointerTy() ? getValueNode(&*ai) : 0);
+            }
+            if (func->getReturnType()->isPointerTy())
+            {
+                fn.ret = graph->addNode();
+            }
+        }
+        return node;
+    }
+
+    static Value *stripConstantCasts(Value *v)
+    {
+        while (auto *expr = dyn_cast<ConstantExpr>(v))
+        {
+            if (!isa<GEPOperator>(expr) && !isa<BitCastOperator>(expr))
+            {
+                break;
+            }
+            v = expr->getOperand(0);
+        }
+        return v;
+    }
+
+    static bool isPointerLike(Type *type)
+    {
+        return type->isPointerTy() || type->isAggregateType();
+    }
+
+private:
+    ConstraintGraph *graph;
+
+    void addInitializer(unsigned object, Constant *init)
+    {
+        Value *v = stripConstantCasts(init);
+        if (isa<GlobalValue>(v))
+        {
+            graph->addConstraint(CK_AddrOf, object, getObjectNode(v));
+            return;
+        }
+        for (unsigned i = 0, e = init->getNumOperands(); i != e; i++)
+        {
+            if (auto *c = dyn_cast<Constant>(init->getOperand(i)))
+            {
+                addInitializer(object, c);
+            }
+        }
+    }
+
+    void visit(Instruction *inst)
+    {
+        if (auto *memCpyInst = dyn_cast<MemCpyInst>(inst))
+        {
+            unsigned tmp = graph->addNode();
+            graph->addConstraint(CK_Load, tmp, getValueNode(memCpyInst->getArgOperand(1)));
+            graph->addConstraint(CK_Store, getValueNode(memCpyInst->getArgOperand(0)), tmp);
+        }
+        else if (isa<IntrinsicInst>(inst))
+        {
+            return;
+        }
+        else if (auto *callInst = dyn_cast<CallInst>(inst))
+        {
+            visitCallInst(callInst);
+        }
+        else if (auto *allocaInst = dyn_cast<AllocaInst>(inst))
+        {
+            graph->addConstraint(CK_AddrOf, getValueNode(allocaInst), getObjectNode(allocaInst));
+        }
+        else if (auto *storeInst = dyn_cast<StoreInst>(inst))
+        {
+            if (isPointerLike(storeInst->getValueOperand()->getType()))
+            {
+                graph->addConstraint(CK_Store, getValueNode(storeInst->getPointerOperand()),
+                                     getValueNode(storeInst->getValueOperand()));
+            }
+        }
+        else if (auto *loadInst = dyn_cast<LoadInst>(inst))
+        {
+            if (isPointerLike(loadInst->getType()))
+            {
+                graph->addConstraint(CK_Load, getValueNode(loadInst), getValueNode(loadInst->getPointerOperand()));
+            }
+        }
+        else if (auto *getElementPtrInst = dyn_cast<GetElementPtrInst>(inst))
+        {
+            graph->addConstraint(CK_Copy, getValueNode(getElementPtrInst),
+                                 getValueNode(getElementPtrInst->getPointerOperand()));
+        }
+        else if (isa<BitCastInst>(inst) && inst->getType()->isPointerTy())
+        {
+            graph->addConstraint(CK_Copy, getValueNode(inst), getValueNode(inst->getOperand(0)));
+        }
+        else if (auto *phiNode = dyn_cast<PHINode>(inst))
+        {
+            if (phiNode->getType()->isPointerTy())
+            {
+                for (Value *value : phiNode->incoming_values())
+                {
+                    graph->addConstraint(CK_Copy, getValueNode(phiNode), getValueNode(value));
+                }
+            }
+        }
+        else if (auto *selectInst = dyn_cast<SelectInst>(inst))
+        {
+            if (selectInst->getType()->isPointerTy())
+            {
+                graph->addConstraint(CK_Copy, getValueNode(selectInst), getValueNode(selectInst->getTrueValue()));
+                graph->addConstraint(CK_Copy, getValueNode(selectInst), getValueNode(selectInst->getFalseValue()));
+            }
+        }
+        else if (auto *returnInst = dyn_cast<ReturnInst>(inst))
+        {
+            Value *value = returnInst->getReturnValue();
+            if (value && value->getType()->isPointerTy())
+            {
+                unsigned ret = graph->functions[getObjectNode(returnInst->getFunction())].ret;
+                graph->addConstraint(CK_Copy, ret, getValueNode(value));
+            }
+        }
+    }
+
+    void visitCallInst(CallInst *callInst)
+    {
+        Value *value = stripConstantCasts(callInst->getCalledValue());
+        CallConstraint call(getValueNode(value), callInst);
+        for (unsigned argi = 0, arge = callInst->getNumArgOperands(); argi < arge; argi++)
+        {
+            Value *arg = callInst->getArgOperand(argi);
+            call.args.push_back(arg->getType()->isPointerTy() ? getValueNode(arg) : 0);
+        }
+        if (callInst->getType()->isPointerTy())
+        {
+            call.ret = getValueNode(callInst);
+            Function *func = dyn_cast<Function>(value);
+            if (func && func->isDeclaration())
+            {
+                // 外部函数(malloc等)返回一个新的堆对象
+                graph->addConstraint(CK_AddrOf, call.ret, getObjectNode(callInst));
+            }
+        }
+        graph->calls.push_back(call);
+    }
+};
+
+///
+/// Offline variable substitution (HVN extended with unions, i.e. HU). Every
+/// node gets the set of pointer labels it may hold: address-of an object
+/// gives the object's label, copies union the labels of their sources, and
+/// nodes filled by something the offline graph can not see (loads, memory
+/// objects, formals and call results, bound only while solving) get a
+/// fresh label of their own. Nodes with equal label sets end up with equal
+/// points-to sets, so graph->equiv maps them to one representative; all
+/// nodes without labels are non-pointers and share one as well.
+///
+/// @return the number of nodes that are not their own representative
+///
+inline unsigned substitutePointerEquivalents(ConstraintGraph *graph)
+{
+    unsigned size = graph->num_nodes;
+    std::vector<bool> indirect(size, false);
+    std::vector<SparseBitVector<>> labels(size);
+    std::vector<std::vector<unsigned>> succ(size);
+    for (const Constraint &c : graph->constraints)
+    {
+        switch (c.kind)
+        {
+        case CK_AddrOf:
+            labels[c.dst].set(c.src);
+            indirect[c.src] = true;
+            break;
+        case CK_Copy:
+            succ[c.src].push_back(c.dst);
+            break;
+        case CK_Load:
+            indirect[c.dst] = true;
+            break;
+        case CK_Store:
+            break;
+        }
+    }
+    for (const CallConstraint &call : graph->calls)
+    {
+        if (call.ret)
+            indirect[call.ret] = true;
+    }
+    for (auto fi = graph->functions.begin(), fe = graph->functions.end(); fi != fe; fi++)
+    {
+        indirect[fi->first] = true;
+        for (unsigned formal : fi->second.formals)
+        {
+            if (formal)
+                indirect[formal] = true;
+        }
+    }
+
+    std::vector<unsigned> worklist;
+    for (unsigned n = 1; n < size; n++)
+    {
+        if (indirect[n])
+        {
+            // fresh labels are numbered after the object labels
+            labels[n].set(size + n);
+        }
+        if (!labels[n].empty())
+        {
+            worklist.push_back(n);
+        }
+    }
+    while (!worklist.empty())
+    {
+        unsigned n = worklist.back();
+        worklist.pop_back();
+        for (unsigned s : succ[n])
+        {
+            if (labels[s] |= labels[n])
+            {
+                worklist.push_back(s);
+            }
+        }
+    }
+
+    unsigned substituted = 0;
+    std::map<std::vector<unsigned>, unsigned> classes;
+    graph->equiv.assign(size, 0);
+    for (unsigned n = 1; n < size; n++)
+    {
+        std::vector<unsigned> key;
+        for (unsigned label : labels[n])
+        {
+            key.push_back(label);
+        }
+        unsigned rep = classes.insert(std::make_pair(key, n)).first->second;
+        graph->equiv[n] = rep;
+        if (rep != n)
+        {
+            substituted++;
+        }
+    }
+    return substituted;
+}
+
+///
+/// Solves a constraint graph with difference propagation: a node only
+/// pushes the part of its points-to set its successors have not seen yet.
+/// Cycles of copy edges are collapsed offline with hybrid cycle detection
+/// (HCD) and online with lazy cycle detection (LCD), and the worklist is
+/// processed in topological order of the copy graph.
+///
+class AndersenSolver
+{
+public:
+    AndersenSolver(const ConstraintGraph &graph)
+        : graph(graph), parent(), pts(), prev(), succ(), loads(), stores(), call_sites(), hcd(), rank(),
+          worklist(), lcd_checked(), call_targets(), num_collapsed(0) {}
+
+    void solve()
+    {
+        init();
+        offlineCycleDetection();
+        for (unsigned n = 1, e = graph.equiv.size(); n < e; n++)
+        {
+            if (graph.equiv[n] != n)
+            {
+                unite(find(graph.equiv[n]), find(n));
+            }
+        }
+        computeTopologicalOrder();
+        for (unsigned n = 1; n < graph.num_nodes; n++)
+        {
+            if (find(n) == n && !pts[n].empty())
+            {
+                push(n);
+            }
+        }
+        while (!worklist.empty())
+        {
+            unsigned n = worklist.begin()->second;
+            worklist.erase(worklist.begin());
+            process(n);
+        }
+    }
+
+    const SparseBitVector<> &getPointsTo(unsigned node) { return pts[find(node)]; }
+
+    /// Object nodes of the functions called by graph.calls[call]
+    const std::set<unsigned> &getCallTargets(unsigned call) const { return call_targets[call]; }
+
+    /// Nodes merged into another node by cycle detection
+    unsigned getNumCollapsed() const { return num_collapsed; }
+
+private:
+    const ConstraintGraph &graph;
+    std::vector<unsigned> parent;  // union-find over collapsed nodes
+    std::vector<SparseBitVector<>> pts, prev, succ;
+    std::vector<std::vector<unsigned>> loads, stores, call_sites;
+    std::vector<unsigned> hcd;  // pointees of n are merged with hcd[n], 0 if none
+    std::vector<unsigned> rank; // topological position, smaller first
+    std::set<std::pair<unsigned, unsigned>> worklist;
+    std::set<std::pair<unsigned, unsigned>> lcd_checked;
+    std::vector<std::set<unsigned>> call_targets;
+    unsigned num_collapsed;
+
+    static std::vector<unsigned> toVector(const SparseBitVector<> &bv)
+    {
+        std::vector<unsigned> v;
+        for (unsigned n : bv)
+        {
+            v.push_back(n);
+        }
+        return v;
+    }
+
+    unsigned find(unsigned n)
+    {
+        while (parent[n] != n)
+        {
+            parent[n] = parent[parent[n]];
+            n = parent[n];
+        }
+        return n;
+    }
+
+    void push(unsigned n)
+    {
+        worklist.insert(std::make_pair(rank[n], n));
+    }
+
+    void init()
+    {
+        unsigned size = graph.num_nodes;
+        parent.resize(size);
+        for (unsigned n = 0; n < size; n++)
+        {
+            parent[n] = n;
+        }
+        pts.resize(size);
+        prev.resize(size);
+        succ.resize(size);
+        loads.resize(size);
+        stores.resize(size);
+        call_sites.resize(size);
+        hcd.assign(size, 0);
+        rank.assign(size, 0);
+        call_targets.resize(graph.calls.size());
+
+        for (const Constraint &c : graph.constraints)
+        {
+            switch (c.kind)
+            {
+            case CK_AddrOf:
+                pts[c.dst].set(c.src);
+                break;
+            case CK_Copy:
+                if (c.dst != c.src)
+                    succ[c.src].set(c.dst);
+                break;
+            case CK_Load:
+                loads[c.src].push_back(c.dst);
+                break;
+            case CK_Store:
+                stores[c.dst].push_back(c.src);
+                break;
+            }
+        }
+        for (unsigned i = 0, e = graph.calls.size(); i != e; i++)
+        {
+            if (graph.calls[i].callee)
+            {
+                call_sites[graph.calls[i].callee].push_back(i);
+            }
+        }
+    }
+
+    /// Merge b into a, both representatives, and return the result
+    unsigned unite(unsigned a, unsigned b)
+    {
+        if (a == b)
+        {
+            return a;
+        }
+        parent[b] = a;
+        num_collapsed++;
+        pts[a] |= pts[b];
+        // a's successors have seen prev[a], b's successors prev[b]
+        prev[a] &= prev[b];
+        succ[a] |= succ[b];
+        loads[a].insert(loads[a].end(), loads[b].begin(), loads[b].end());
+        stores[a].insert(stores[a].end(), stores[b].begin(), stores[b].end());
+        call_sites[a].insert(call_sites[a].end(), call_sites[b].begin(), call_sites[b].end());
+        if (!hcd[a])
+        {
+            hcd[a] = hcd[b];
+        }
+        rank[a] = std::min(rank[a], rank[b]);
+        pts[b].clear();
+        prev[b].clear();
+        succ[b].clear();
+        std::vector<unsigned>().swap(loads[b]);
+        std::vector<unsigned>().swap(stores[b]);
+        std::vector<unsigned>().swap(call_sites[b]);
+        return a;
+    }
+
+    void addCopyEdge(unsigned src, unsigned dst)
+    {
+        src = find(src);
+        dst = find(dst);
+        if (src == dst || !succ[src].test_and_set(dst))
+        {
+            return;
+        }
+        if (pts[dst] |= pts[src])
+        {
+            push(dst);
+        }
+    }
+
+    void bindCall(unsigned call, unsigned func)
+    {
+        auto fi = graph.functions.find(func);
+        if (fi == graph.functions.end() || !call_targets[call].insert(func).second)
+        {
+            return;
+        }
+        const CallConstraint &c = graph.calls[call];
+        const FunctionNodes &fn = fi->second;
+        for (unsigned i = 0, e = std::min(c.args.size(), fn.formals.size()); i != e; i++)
+        {
+            if (c.args[i] && fn.formals[i])
+            {
+                addCopyEdge(c.args[i], fn.formals[i]);
+            }
+        }
+        if (c.ret && fn.ret)
+        {
+            addCopyEdge(fn.ret, c.ret);
+        }
+    }
+
+    void process(unsigned n)
+    {
+        n = find(n);
+        if (hcd[n])
+        {
+            // HCD: everything n points to is in a cycle with hcd[n]
+            unsigned r = find(hcd[n]);
+            std::vector<unsigned> pointees = toVector(pts[n]);
+            for (unsigned o : pointees)
+            {
+                r = unite(r, find(o));
+            }
+            push(r);
+            n = find(n);
+        }
+
+        SparseBitVector<> delta = pts[n];
+        delta.intersectWithComplement(prev[n]);
+        if (delta.empty())
+        {
+            return;
+        }
+        prev[n] |= delta;
+
+        std::vector<unsigned> node_loads = loads[n], node_stores = stores[n], node_calls = call_sites[n];
+        for (unsigned o : delta)
+        {
+            for (unsigned dst : node_loads)
+            {
+                addCopyEdge(o, dst);
+            }
+            for (unsigned src : node_stores)
+            {
+                addCopyEdge(src, o);
+            }
+            for (unsigned call : node_calls)
+            {
+                bindCall(call, o);
+            }
+        }
+
+        n = find(n);
+        std::vector<unsigned> lcd_candidates;
+        std::vector<unsigned> successors = toVector(succ[n]);
+        for (unsigned s : successors)
+        {
+            s = find(s);
+            if (s == n)
+            {
+                continue;
+            }
+            if (pts[s] |= delta)
+            {
+                push(s);
+            }
+            // LCD: equal sets across an edge hint at a cycle, check each edge once
+            if (pts[s] == pts[n] && lcd_checked.insert(std::make_pair(n, s)).second)
+            {
+                lcd_candidates.push_back(s);
+            }
+        }
+        for (unsigned s : lcd_candidates)
+        {
+            collapseCyclesFrom(find(s));
+        }
+    }
+
+    ///
+    /// Tarjan's algorithm over the copy edges reachable from start; every
+    /// strongly connected component found is collapsed into one node.
+    ///
+    void collapseCyclesFrom(unsigned start)
+    {
+        std::map<unsigned, unsigned> index, low;
+        std::vector<unsigned> stack;
+        std::set<unsigned> on_stack;
+        struct Frame
+        {
+            unsigned node;
+            std::vector<unsigned> succs;
+            size_t next;
+        };
+        std::vector<Frame> frames;
+        unsigned counter = 0;
+
+        auto enter = [&](unsigned n) {
+            index[n] = low[n] = counter++;
+            stack.push_back(n);
+            on_stack.insert(n);
+            Frame frame;
+            frame.node = n;
+            for (unsigned s : succ[n])
+            {
+                frame.succs.push_back(find(s));
+            }
+            frame.next = 0;
+            frames.push_back(frame);
+        };
+
+        enter(start);
+        while (!frames.empty())
+        {
+            Frame &frame = frames.back();
+            if (frame.next < frame.succs.size())
+            {
+                unsigned s = frame.succs[frame.next++];
+                if (!index.count(s))
+                {
+                    enter(s);
+                }
+                else if (on_stack.count(s))
+                {
+                    low[frame.node] = std::min(low[frame.node], index[s]);
+                }
+                continue;
+            }
+            unsigned n = frame.node;
+            frames.pop_back();
+            if (!frames.empty())
+            {
+                low[frames.back().node] = std::min(low[frames.back().node], low[n]);
+            }
+            if (low[n] != index[n])
+            {
+                continue;
+            }
+            unsigned rep = n;
+            while (true)
+            {
+                unsigned m = stack.back();
+                stack.pop_back();
+                on_stack.erase(m);
+                if (m != n)
+                {
+                    rep = unite(rep, m);
+                }
+                if (m == n)
+                {
+                    break;
+                }
+            }
+            if (rep != n || pts[rep] != prev[rep])
+            {
+                push(rep);
+            }
+        }
+    }
+
+    ///
+    /// HCD: find cycles in the offline graph where a dereference *p sits in
+    /// a cycle with a variable r. Variables in such cycles are merged now;
+    /// each p is remembered so that its pointees are merged with r online.
+    ///
+    void offlineCycleDetection()
+    {
+        unsigned size = graph.num_nodes;
+        // node n is the variable n, node size + n is the dereference *n
+        std::vector<std::vector<unsigned>> edges(2 * size);
+        for (const Constraint &c : graph.constraints)
+        {
+            switch (c.kind)
+            {
+            case CK_Copy:
+                edges[c.src].push_back(c.dst);
+                break;
+            case CK_Load:
+                edges[size + c.src].push_back(c.dst);
+                break;
+            case CK_Store:
+                edges[c.src].push_back(size + c.dst);
+                break;
+            default:
+                break;
+            }
+        }
+
+        std::vector<unsigned> index(2 * size, 0), low(2 * size, 0);
+        std::vector<bool> on_stack(2 * size, false);
+        std::vector<unsigned> stack;
+        unsigned counter = 1;
+        for (unsigned root = 1; root < 2 * size; root++)
+        {
+            if (index[root])
+            {
+                continue;
+            }
+            std::vector<std::pair<unsigned, size_t>> frames;
+            index[root] = low[root] = counter++;
+            stack.push_back(root);
+            on_stack[root] = true;
+            frames.push_back(std::make_pair(root, 0));
+            while (!frames.empty())
+            {
+                unsigned n = frames.back().first;
+                size_t &next = frames.back().second;
+                if (next < edges[n].size())
+                {
+                    unsigned s = edges[n][next++];
+                    if (!index[s])
+                    {
+                        index[s] = low[s] = counter++;
+                        stack.push_back(s);
+                        on_stack[s] = true;
+                        frames.push_back(std::make_pair(s, 0));
+                    }
+                    else if (on_stack[s])
+                    {
+                        low[n] = std::min(low[n], index[s]);
+                    }
+                    continue;
+                }
+                frames.pop_back();
+                if (!frames.empty())
+                {
+                    unsigned p = frames.back().first;
+                    low[p] = std::min(low[p], low[n]);
+                }
+                if (low[n] != index[n])
+                {
+                    continue;
+                }
+                std::vector<unsigned> vars, derefs;
+                while (true)
+                {
+                    unsigned m = stack.back();
+                    stack.pop_back();
+                    on_stack[m] = false;
+                    if (m < size)
+                        vars.push_back(m);
+                    else
+                        derefs.push_back(m - size);
+                    if (m == n)
+                        break;
+                }
+                if (vars.empty() || vars.size() + derefs.size() < 2)
+                {
+                    continue;
+                }
+                unsigned rep = find(vars[0]);
+                for (unsigned v : vars)
+                {
+                    rep = unite(rep, find(v));
+                }
+                for (unsigned d : derefs)
+                {
+                    hcd[d] = rep;
+                }
+            }
+        }
+    }
+
+    /// Rank nodes by reverse post-order of the copy graph
+    void computeTopologicalOrder()
+    {
+        unsigned size = graph.num_nodes;
+        std::vector<bool> visited(size, false);
+        std::vector<unsigned> postorder;
+        for (unsigned root = 1; root < size; root++)
+        {
+            if (find(root) != root || visited[root])
+            {
+                continue;
+            }
+            std::vector<std::pair<unsigned, std::vector<unsigned>>> frames;
+            visited[root] = true;
+            frames.push_back(std::make_pair(root, toVector(succ[root])));
+            while (!frames.empty())
+            {
+                if (!frames.back().second.empty())
+                {
+                    unsigned s = find(frames.back().second.back());
+                    frames.back().second.pop_back();
+                    if (!visited[s])
+                    {
+                        visited[s] = true;
+                        frames.push_back(std::make_pair(s, toVector(succ[s])));
+                    }
+                    continue;
+                }
+                postorder.push_back(frames.back().first);
+                frames.pop_back();
+            }
+        }
+        for (unsigned i = 0, e = postorder.size(); i != e; i++)
+        {
+            rank[postorder[i]] = e - i;
+        }
+    }
+};
+
+///
+/// Andersen-style analysis of a whole module: builds the constraint graph,
+/// solves it, and fills call_func_result for every call instruction.
+///
+class AndersenAnalysis
+{
+public:
+    std::map<CallInst *, FunctionSet> call_func_result;
+
+    AndersenAnalysis() : call_func_result(), graph(), builder(&graph) {}
+
+    void run(Module &M)
+    {
+        builder.build(M);
+        substitutePointerEquivalents(&graph);
+        AndersenSolver solver(graph);
+        solver.solve();
+        for (unsigned i = 0, e = graph.calls.size(); i != e; i++)
+        {
+            FunctionSet &callees = call_func_result[graph.calls[i].inst];
+            const std::set<unsigned> &targets = solver.getCallTargets(i);
+            for (unsigned target : targets)
+            {
+                callees.insert(graph.functions[target].func);
+            }
+        }
+    }
+
+    void printCallFuncResult(raw_ostream &out = errs())
+    {
+        ::printCallFuncResult(call_func_result, out);
+    }
+
+private:
+    ConstraintGraph graph;
+    ConstraintBuilder builder;
+};
+
+/// Answers the slice's alias and call-target questions from a solved graph
+class AndersenSliceOracle : public SliceOracle
+{
+public:
+    AndersenSliceOracle(const ConstraintGraph &graph, const ConstraintBuilder &builder, AndersenSolver &solver)
+        : graph(graph), builder(builder), solver(solver), call_index()
+    {
+        for (unsigned i = 0, e = graph.calls.size(); i != e; i++)
+        {
+            call_index[graph.calls[i].inst] = i;
+        }
+    }
+
+    void getPointees(Value *pointer, std::vector<unsigned> *objects) override
+    {
+        if (unsigned node = builder.lookupValueNode(pointer))
+        {
+            for (unsigned o : solver.getPointsTo(node))
+            {
+                objects->push_back(o);
+            }
+        }
+    }
+
+    void getCallees(CallInst *callInst, std::vector<Function *> *callees) override
+    {
+        auto it = call_index.find(callInst);
+        if (it == call_index.end())
+        {
+            return;
+        }
+        const std::set<unsigned> &targets = solver.getCallTargets(it->second);
+        for (unsigned target : targets)
+        {
+            callees->push_back(graph.functions.find(target)->second.func);
+        }
+    }
+
+private:
+    const ConstraintGraph &graph;
+    const ConstraintBuilder &builder;
+    AndersenSolver &solver;
+    std::map<CallInst *, unsigned> call_index;
+};
+
+/// Computes slice over an Andersen pre-analysis of M
+inline void computeRelevanceSlice(Module &M, RelevanceSlice *slice)
+{
+    ConstraintGraph graph;
+    ConstraintBuilder builder(&graph);
+    builder.build(M);
+    substitutePointerEquivalents(&graph);
+    AndersenSolver solver(graph);
+    solver.solve();
+    AndersenSliceOracle oracle(graph, builder, solver);
+    slice->compute(M, &oracle);
+}
+
+#endif /* !_ANDERSEN_H_ */
@@ -0,0 +1,670 @@
+/************************************************************************
+ *
+ * @file Checkpoint.h
+ *
+ * Checkpoints of the flow analysis, so that a run that was killed can be
+ * resumed where it was
+ *
+ ***********************************************************************/
+
+#ifndef _CHECKPOINT_H_
+#define _CHECKPOINT_H_
+
+#include <llvm/IR/Module.h>
+#include <llvm/IR/Function.h>
+#include <llvm/IR/Constants.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/InstIterator.h>
+#include <llvm/ADT/DenseMap.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/raw_ostream.h>
+#include "Liveness.h"
+#include "Serialize.h"
+#include "VisitCache.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+using namespace llvm;
+
+///
+/// Snapshot of the flow analysis between two visits: the worklist, the
+/// functions that went over budget, the calling contexts and everything
+/// the visitor keeps, call_func_result and the tables of getResults() and
+/// its siblings. Running a resumed snapshot to the end gives the result
+/// of an uninterrupted run.
+///
+/// Values are stored by name, so that a checkpoint survives reloading the
+/// module: a global by its name, a formal by its function and position,
+/// an instruction by its function and its index in the function, and a
+/// constant by its printed form. A checkpoint only fits the module and the
+/// options it was taken with, which a digest of each checks.
+///
+class AnalysisCheckpoint
+{
+public:
+    AnalysisCheckpoint(Module &M, uint64_t options)
+        : M(M), options(options), module_digest(), globals(), positions(), instructions(), names(), name_of(),
+          constants(), constants_scanned(false), num_written(0), written_bytes(0)
+    {
+        for (auto &G : M.global_values())
+        {
+            positions[&G] = globals.size();
+            globals.push_back(&G);
+            module_digest.add(G.getName());
+            module_digest.add(G.getValueID());
+            module_digest.add(G.isDeclaration());
+        }
+        for (auto &F : M)
+        {
+            std::vector<Instruction *> &insts = instructions[&F];
+            for (inst_iterator ii = inst_begin(F), ie = inst_end(F); ii != ie; ii++)
+            {
+                positions[&*ii] = insts.size();
+                insts.push_back(&*ii);
+            }
+        }
+        for (auto &F : M)
+        {
+            for (inst_iterator ii = inst_begin(F), ie = inst_end(F); ii != ie; ii++)
+            {
+                module_digest.add(ii->getOpcode());
+                for (Value *operand : ii->operands())
+                {
+                    addOperand(operand);
+                }
+            }
+            module_digest.add(instructions[&F].size());
+        }
+    }
+
+    /// Replaces the checkpoint at path with the current state of the analysis
+    bool write(StringRef path, const LivenessVisitor &visitor, const std::deque<FunctionContext> &worklist,
+               const std::map<FunctionContext, DataflowStatus> &degraded, std::string *error)
+    {
+        names.clear();
+        name_of.clear();
+        std::string body;
+        raw_string_ostream os(body);
+        ByteWriter w(os);
+
+        const CallStringTable &contexts = visitor.contexts;
+        w.writeVarint(contexts.size());
+        for (unsigned ctx = 1; ctx < contexts.size(); ctx++)
+        {
+            w.writeVarint(contexts.getParent(ctx));
+            writeRef(w, contexts.getSite(ctx));
+        }
+        w.writeVarint(worklist.size());
+        for (const FunctionContext &fc : worklist)
+        {
+            writeRef(w, fc.first);
+            w.writeVarint(fc.second);
+        }
+        w.writeVarint(degraded.size());
+        for (auto di = degraded.begin(), de = degraded.end(); di != de; di++)
+        {
+            writeRef(w, di->first.first);
+            w.writeVarint(di->first.second);
+            w.writeVarint(di->second);
+        }
+        w.writeVarint(visitor.call_func_result.size());
+        for (auto ci = visitor.call_func_result.begin(), ce = visitor.call_func_result.end(); ci != ce; ci++)
+        {
+            writeRef(w, ci->first);
+            writeRefs(w, ci->second);
+        }
+        const std::map<CallSite, FunctionSet> &callees = visitor.getContextCallees();
+        w.writeVarint(callees.size());
+        for (auto ci = callees.begin(), ce = callees.end(); ci != ce; ci++)
+        {
+            writeRef(w, ci->first.first);
+            w.writeVarint(ci->first.second);
+            writeRefs(w, ci->second);
+        }
+        const std::map<FunctionContext, std::set<CallSite>> &return_sites = visitor.getReturnSites();
+        w.writeVarint(return_sites.size());
+        for (auto ri = return_sites.begin(), re = return_sites.end(); ri != re; ri++)
+        {
+            writeRef(w, ri->first.first);
+            w.writeVarint(ri->first.second);
+            w.writeVarint(ri->second.size());
+            for (const CallSite &site : ri->second)
+            {
+                writeRef(w, site.first);
+                w.writeVarint(site.second);
+            }
+        }
+        const std::map<unsigned, LiveVarsToMap> &top_level = visitor.getTopLevelTables();
+        w.writeVarint(top_level.size());
+        for (auto ti = top_level.begin(), te = top_level.end(); ti != te; ti++)
+        {
+            w.writeVarint(ti->first);
+            writeMapDelta(w, LiveVarsToMap(), ti->second);
+        }
+        const std::map<unsigned, DataflowResult<LivenessInfo>::Type> &results = visitor.getResults();
+        w.writeVarint(results.size());
+        for (auto ri = results.begin(), re = results.end(); ri != re; ri++)
+        {
+            w.writeVarint(ri->first);
+            writeResult(w, ri->second);
+        }
+        os.flush();
+
+        std::string head;
+        raw_string_ostream hs(head);
+        ByteWriter h(hs);
+        h.writeBytes("FPCHKPT");
+        h.writeVarint(1);
+        h.writeVarint(options);
+        h.writeVarint(module_digest.lo);
+        h.writeVarint(module_digest.hi);
+        h.writeVarint(names.size());
+        for (const std::string &name : names)
+        {
+            h.writeString(name);
+        }
+        hs.flush();
+        StringRef parts[] = {head, body};
+        if (!writeFileAtomically(path, parts, error))
+        {
+            return false;
+        }
+        num_written++;
+        written_bytes = head.size() + body.size();
+        return true;
+    }
+
+    ///
+    /// Puts back the state written to path and sets resumed. A missing file
+    /// is not an error; on an error, including a checkpoint of another
+    /// module or taken with other options, nothing is changed.
+    ///
+    bool read(StringRef path, LivenessVisitor *visitor, std::deque<FunctionContext> *worklist,
+              std::map<FunctionContext, DataflowStatus> *degraded, bool *resumed, std::string *error)
+    {
+        *resumed = false;
+        ErrorOr<std::unique_ptr<MemoryBuffer>> buffer = MemoryBuffer::getFile(path);
+        if (!buffer)
+        {
+            if (buffer.getError() == std::errc::no_such_file_or_directory)
+            {
+                return true;
+            }
+            *error = buffer.getError().message();
+            return false;
+        }
+        ByteReader r((*buffer)->getBuffer());
+        if (!r.expectBytes("FPCHKPT") || r.readVarint() != 1)
+        {
+            *error = "not a checkpoint";
+            return false;
+        }
+        if (r.readVarint() != options || r.readVarint() != module_digest.lo || r.readVarint() != module_digest.hi)
+        {
+            *error = "taken of another module or with other options";
+            return false;
+        }
+        std::vector<Value *> values;
+        for (uint64_t i = 0, e = r.readVarint(); i != e && !r.hasError(); i++)
+        {
+            std::string name = r.readString();
+            values.push_back(resolve(name));
+            if (!values.back() && !r.hasError())
+            {
+                *error = "no value named " + name;
+                return false;
+            }
+        }
+
+        // 先解码到局部变量, 出错时visitor不变
+        Decoder d(r, values);
+        CallStringTable contexts = visitor->contexts;
+        for (unsigned ctx = 1, e = r.readVarint(); ctx < e && !d.failed(); ctx++)
+        {
+            unsigned parent = r.readVarint();
+            CallInst *site = d.readRef<CallInst>();
+            if (d.failed() || parent >= ctx || contexts.extend(parent, site) != ctx)
+            {
+                d.fail();
+            }
+        }
+        unsigned num_contexts = contexts.size();
+        std::deque<FunctionContext> queue;
+        for (uint64_t i = 0, e = r.readVarint(); i != e && !d.failed(); i++)
+        {
+            Function *F = d.readRef<Function>();
+            queue.push_back(std::make_pair(F, d.readContext(num_contexts)));
+        }
+        std::map<FunctionContext, DataflowStatus> over_budget;
+        for (uint64_t i = 0, e = r.readVarint(); i != e && !d.failed(); i++)
+        {
+            Function *F = d.readRef<Function>();
+            unsigned ctx = d.readContext(num_contexts);
+            uint64_t status = r.readVarint();
+            if (status > DF_ExceededStateSize)
+            {
+                d.fail();
+            }
+            over_budget[std::make_pair(F, ctx)] = (DataflowStatus)status;
+        }
+        std::map<CallInst *, FunctionSet> call_func_result;
+        for (uint64_t i = 0, e = r.readVarint(); i != e && !d.failed(); i++)
+        {
+            CallInst *callInst = d.readRef<CallInst>();
+            d.readRefs(&call_func_result[callInst]);
+        }
+        std::map<CallSite, FunctionSet> callees;
+        for (uint64_t i = 0, e = r.readVarint(); i != e && !d.failed(); i++)
+        {
+            CallInst *callInst = d.readRef<CallInst>();
+            unsigned ctx = d.readContext(num_contexts);
+            d.readRefs(&callees[std::make_pair(callInst, ctx)]);
+        }
+        std::map<FunctionContext, std::set<CallSite>> return_sites;
+        for (uint64_t i = 0, e = r.readVarint(); i != e && !d.failed(); i++)
+        {
+            Function *F = d.readRef<Function>();
+            std::set<CallSite> &sites = return_sites[std::make_pair(F, d.readContext(num_contexts))];
+            for (uint64_t j = 0, je = r.readVarint(); j != je && !d.failed(); j++)
+            {
+                CallInst *callInst = d.readRef<CallInst>();
+                sites.insert(std::make_pair(callInst, d.readContext(num_contexts)));
+            }
+        }
+        std::map<unsigned, LiveVarsToMap> top_level;
+        for (uint64_t i = 0, e = r.readVarint(); i != e && !d.failed(); i++)
+        {
+            LiveVarsToMap &table = top_level[d.readContext(num_contexts)];
+            d.readMapDelta(&table);
+        }
+        std::map<unsigned, DataflowResult<LivenessInfo>::Type> results;
+        for (uint64_t i = 0, e = r.readVarint(); i != e && !d.failed(); i++)
+        {
+            readResult(d, &results[d.readContext(num_contexts)]);
+        }
+        if (d.failed() || !r.atEnd())
+        {
+            *error = "not a checkpoint";
+            return false;
+        }
+
+        visitor->contexts = contexts;
+        visitor->call_func_result.swap(call_func_result);
+        visitor->swapTables(&results, &top_level, &callees, &return_sites);
+        worklist->swap(queue);
+        degraded->swap(over_budget);
+        *resumed = true;
+        return true;
+    }
+
+    unsigned getNumWritten() const { return num_written; }
+    size_t getWrittenBytes() const { return written_bytes; }
+
+private:
+    /// Reads references to the names of the file, checking what they stand for
+    class Decoder
+    {
+    public:
+        Decoder(ByteReader &r, const std::vector<Value *> &values) : r(r), values(values), error(false) {}
+
+        template <typename T>
+        T *readRef()
+        {
+            uint64_t index = r.readVarint();
+            T *value = index < values.size() ? dyn_cast<T>(values[index]) : nullptr;
+            if (!value)
+            {
+                error = true;
+            }
+            return value;
+        }
+
+        template <typename T>
+        void readRefs(std::set<T *> *set)
+        {
+            for (uint64_t i = 0, e = r.readVarint(); i != e && !failed(); i++)
+            {
+                set->insert(readRef<T>());
+            }
+        }
+
+        unsigned readContext(unsigned num_contexts)
+        {
+            uint64_t ctx = r.readVarint();
+            if (ctx >= num_contexts)
+            {
+                error = true;
+            }
+            return ctx;
+        }
+
+        /// Applies the changes writeMapDelta wrote to map
+        void readMapDelta(LiveVarsToMap *map)
+        {
+            for (uint64_t i = 0, e = r.readVarint(); i != e && !failed(); i++)
+            {
+                map->erase(readRef<Value>());
+            }
+            for (uint64_t i = 0, e = r.readVarint(); i != e && !failed(); i++)
+            {
+                ValueSet &entry = (*map)[readRef<Value>()];
+                entry.clear();
+                readRefs(&entry);
+            }
+        }
+
+        ByteReader &getReader() { return r; }
+        bool failed() const { return error || r.hasError(); }
+        void fail() { error = true; }
+
+    private:
+        ByteReader &r;
+        const std::vector<Value *> &values;
+        bool error;
+    };
+
+    Module &M;
+    uint64_t options;
+    CacheDigest module_digest; // the globals of the module and the opcodes and operands of its instructions
+    std::vector<GlobalValue *> globals;
+    DenseMap<Value *, unsigned> positions; // of globals in the module, of instructions in their function
+    std::map<Function *, std::vector<Instruction *>> instructions;
+
+    std::vector<std::string> names; // of the values the checkpoint being written refers to
+    DenseMap<Value *, unsigned> name_of;
+    std::map<std::string, Value *> constants; // by printed form, built on the first lookup
+    bool constants_scanned;
+
+    unsigned num_written;
+    size_t written_bytes;
+
+    /// Digests what an operand refers to, without printing it
+    void addOperand(Value *operand)
+    {
+        module_digest.add(operand->getValueID());
+        if (auto *gv = dyn_cast<GlobalValue>(operand))
+        {
+            module_digest.add(positions[gv]);
+        }
+        else if (auto *inst = dyn_cast<Instruction>(operand))
+        {
+            module_digest.add(positions[inst]);
+        }
+        else if (auto *arg = dyn_cast<Argument>(operand))
+        {
+            module_digest.add(arg->getArgNo());
+        }
+        else if (auto *value = dyn_cast<ConstantInt>(operand))
+        {
+            module_digest.add(value->getLimitedValue());
+        }
+        else if (auto *expr = dyn_cast<ConstantExpr>(operand))
+        {
+            for (Value *v : expr->operands())
+            {
+                addOperand(v);
+            }
+        }
+    }
+
+    std::string getGlobalName(GlobalValue *gv)
+    {
+        if (gv->hasName())
+        {
+            return "g" + gv->getName().str();
+        }
+        return "u" + std::to_string(positions[gv]);
+    }
+
+    std::string getValueName(Value *v)
+    {
+        if (auto *gv = dyn_cast<GlobalValue>(v))
+        {
+            return getGlobalName(gv);
+        }
+        if (auto *arg = dyn_cast<Argument>(v))
+        {
+            return "a" + getGlobalName(arg->getParent()) + "|" + std::to_string(arg->getArgNo());
+        }
+        if (auto *inst = dyn_cast<Instruction>(v))
+        {
+            return "i" + getGlobalName(inst->getFunction()) + "|" + std::to_string(positions[inst]);
+        }
+        std::string s;
+        raw_string_ostream os(s);
+        os << "c";
+        v->print(os);
+        return os.str();
+    }
+
+    void scanConstants(Constant *c)
+    {
+        if (isa<GlobalValue>(c) || !constants.insert(std::make_pair(getValueName(c), c)).second)
+        {
+            return;
+        }
+        for (Value *operand : c->operands())
+        {
+            if (auto *constant = dyn_cast<Constant>(operand))
+            {
+                scanConstants(constant);
+            }
+        }
+    }
+
+    /// The value of this module a stored name stands for, null if none
+    Value *resolve(StringRef name)
+    {
+        if (name.empty())
+        {
+            return nullptr;
+        }
+        char kind = name[0];
+        StringRef rest = name.drop_front();
+        if (kind == 'g')
+        {
+            return M.getNamedValue(rest);
+        }
+        if (kind == 'u')
+        {
+            unsigned position;
+            return !rest.getAsInteger(10, position) && position < globals.size() ? globals[position] : nullptr;
+        }
+        if (kind == 'a' || kind == 'i')
+        {
+            size_t bar = rest.rfind('|');
+            unsigned index;
+            if (bar == StringRef::npos || rest.drop_front(bar + 1).getAsInteger(10, index))
+            {
+                return nullptr;
+            }
+            auto *F = dyn_cast_or_null<Function>(resolve(rest.take_front(bar)));
+            if (!F)
+            {
+                return nullptr;
+            }
+            if (kind == 'a')
+            {
+                return index < F->arg_size() ? F->arg_begin() + index : nullptr;
+            }
+            std::vector<Instruction *> &insts = instructions[F];
+            return index < insts.size() ? insts[index] : nullptr;
+        }
+        if (kind == 'c')
+        {
+            if (!constants_scanned)
+            {
+                constants_scanned = true;
+                for (auto &F : M)
+                {
+                    for (inst_iterator ii = inst_begin(F), ie = inst_end(F); ii != ie; ii++)
+                    {
+                        for (Value *operand : ii->operands())
+                        {
+                            if (auto *constant = dyn_cast<Constant>(operand))
+                                scanConstants(constant);
+                        }
+                    }
+                }
+            }
+            auto it = constants.find(name.str());
+            return it == constants.end() ? nullptr : it->second;
+        }
+        return nullptr;
+    }
+
+    void writeRef(ByteWriter &w, Value *v)
+    {
+        auto it = name_of.find(v);
+        if (it == name_of.end())
+        {
+            it = name_of.insert(std::make_pair(v, names.size())).first;
+            names.push_back(getValueName(v));
+        }
+        w.writeVarint(it->second);
+    }
+
+    template <typename T>
+    void writeRefs(ByteWriter &w, const std::set<T *> &set)
+    {
+        w.writeVarint(set.size());
+        for (T *v : set)
+        {
+            writeRef(w, v);
+        }
+    }
+
+    /// Writes map as the keys dropped from base and the entries that differ from it
+    void writeMapDelta(ByteWriter &w, const LiveVarsToMap &base, const LiveVarsToMap &map)
+    {
+        std::vector<Value *> removed;
+        std::vector<LiveVarsToMap::const_iterator> changed;
+        auto bi = base.begin(), be = base.end();
+        for (auto mi = map.begin(), me = map.end(); mi != me; mi++)
+        {
+            for (; bi != be && bi->first < mi->first; bi++)
+            {
+                removed.push_back(bi->first);
+            }
+            if (bi != be && bi->first == mi->first)
+            {
+                if (bi->second != mi->second)
+                    changed.push_back(mi);
+                bi++;
+                continue;
+            }
+            changed.push_back(mi);
+        }
+        for (; bi != be; bi++)
+        {
+            removed.push_back(bi->first);
+        }
+        w.writeVarint(removed.size());
+        for (Value *v : removed)
+        {
+            writeRef(w, v);
+        }
+        w.writeVarint(changed.size());
+        for (auto mi : changed)
+        {
+            writeRef(w, mi->first);
+            writeRefs(w, mi->second);
+        }
+    }
+
+    enum PointFlags
+    {
+        PF_InAsBefore = 1, // the state before the instruction is the state last written
+        PF_OutAsIn = 2     // the instruction does not change the state
+    };
+
+    ///
+    /// The dataflow values of one context, grouped by function and in
+    /// instruction order. Each state is written as its difference from the
+    /// one written before it, which is mostly small or nothing.
+    ///
+    void writeResult(ByteWriter &w, const DataflowResult<LivenessInfo>::Type &result)
+    {
+        std::map<Function *, std::vector<std::pair<unsigned, const std::pair<LivenessInfo, LivenessInfo> *>>> by_function;
+        for (auto ri = result.begin(), re = result.end(); ri != re; ri++)
+        {
+            by_function[ri->first->getFunction()].push_back(std::make_pair(positions[ri->first], &ri->second));
+        }
+        w.writeVarint(by_function.size());
+        for (auto fi = by_function.begin(), fe = by_function.end(); fi != fe; fi++)
+        {
+            std::sort(fi->second.begin(), fi->second.end());
+            writeRef(w, fi->first);
+            w.writeVarint(fi->second.size());
+            LivenessInfo empty;
+            const LivenessInfo *previous = &empty;
+            unsigned last = 0;
+            for (auto pi = fi->second.begin(), pe = fi->second.end(); pi != pe; pi++)
+            {
+                const LivenessInfo &in = pi->second->first, &out = pi->second->second;
+                unsigned flags = (in == *previous ? PF_InAsBefore : 0) | (out == in ? PF_OutAsIn : 0);
+                w.writeVarint(pi->first - last);
+                w.writeVarint(flags);
+                if (!(flags & PF_InAsBefore))
+                {
+                    writeMapDelta(w, previous->LiveVars_map, in.LiveVars_map);
+                    writeMapDelta(w, previous->LiveVars_feild_map, in.LiveVars_feild_map);
+                }
+                if (!(flags & PF_OutAsIn))
+                {
+                    writeMapDelta(w, in.LiveVars_map, out.LiveVars_map);
+                    writeMapDelta(w, in.LiveVars_feild_map, out.LiveVars_feild_map);
+                }
+                previous = &out;
+                last = pi->first;
+            }
+        }
+    }
+
+    void readResult(Decoder &d, DataflowResult<LivenessInfo>::Type *result)
+    {
+        ByteReader &r = d.getReader();
+        for (uint64_t i = 0, e = r.readVarint(); i != e && !d.failed(); i++)
+        {
+            Function *F = d.readRef<Function>();
+            if (d.failed())
+            {
+                return;
+            }
+            const std::vector<Instruction *> &insts = instructions[F];
+            LivenessInfo empty;
+            const LivenessInfo *previous = &empty;
+            uint64_t index = 0;
+            for (uint64_t j = 0, je = r.readVarint(); j != je && !d.failed(); j++)
+            {
+                index += r.readVarint();
+                unsigned flags = r.readVarint();
+                if (index >= insts.size())
+                {
+                    d.fail();
+                    return;
+                }
+                std::pair<LivenessInfo, LivenessInfo> &point = (*result)[insts[index]];
+                point.first = *previous;
+                if (!(flags & PF_InAsBefore))
+                {
+                    d.readMapDelta(&point.first.LiveVars_map);
+                    d.readMapDelta(&point.first.LiveVars_feild_map);
+                }
+                point.second = point.first;
+                if (!(flags & PF_OutAsIn))
+                {
+                    d.readMapDelta(&point.second.LiveVars_map);
+                    d.readMapDelta(&point.second.LiveVars_feild_map);
+                }
+                previous = &point.second;
+            }
+        }
+    }
+};
+
+#endif /* !_CHECKPOINT_H_ */
@@ -0,0 +1,108 @@
+/************************************************************************
+ *
+ * @file Context.h
+ *
+ * k-limited call-string contexts, interned into a call-string tree
+ *
+ ***********************************************************************/
+
+#ifndef _CONTEXT_H_
+#define _CONTEXT_H_
+
+#include <llvm/IR/Instructions.h>
+
+#include <map>
+#include <vector>
+using namespace llvm;
+
+///
+/// Every context is a node of a tree rooted at the empty call string; the
+/// path from the root spells the (at most k) most recent call sites. A
+/// context is identified by the ID of its node, so comparing and storing
+/// contexts is as cheap as for an unsigned.
+///
+class CallStringTable
+{
+public:
+    /// ID of the empty call string, used for all context-insensitive functions.
+    /// An enumerator rather than a static member, so that binding it to a
+    /// reference (as std::make_pair does) needs no definition to link.
+    enum : unsigned
+    {
+        EmptyContext = 0
+    };
+
+    CallStringTable(unsigned k = 0, unsigned budget = 0) : k(k), budget(budget), nodes(1, Node(EmptyContext, nullptr)), children() {}
+
+    unsigned getK() const { return k; }
+    unsigned size() const { return nodes.size(); }
+
+    /// The context ctx extends, and the call site it appends
+    unsigned getParent(unsigned ctx) const { return nodes[ctx].parent; }
+    CallInst *getSite(unsigned ctx) const { return nodes[ctx].site; }
+
+    /// The call string of ctx, oldest call site first
+    std::vector<CallInst *> getCallString(unsigned ctx) const
+    {
+        std::vector<CallInst *> sites;
+        for (; ctx != EmptyContext; ctx = nodes[ctx].parent)
+        {
+            sites.insert(sites.begin(), nodes[ctx].site);
+        }
+        return sites;
+    }
+
+    ///
+    /// Context of a callee invoked at site from ctx: the call string of ctx
+    /// with site appended, keeping the k most recent call sites. When the
+    /// budget of contexts is spent, new call strings fall back to the empty
+    /// context.
+    ///
+    unsigned extend(unsigned ctx, CallInst *site)
+    {
+        if (k == 0)
+        {
+            return EmptyContext;
+        }
+        std::vector<CallInst *> sites = getCallString(ctx);
+        sites.push_back(site);
+        if (sites.size() > k)
+        {
+            sites.erase(sites.begin(), sites.end() - k);
+        }
+
+        unsigned id = EmptyContext;
+        for (CallInst *s : sites)
+        {
+            auto it = children.find(std::make_pair(id, s));
+            if (it != children.end())
+            {
+                id = it->second;
+                continue;
+            }
+            if (budget && nodes.size() >= budget)
+            {
+                return EmptyContext;
+            }
+            nodes.push_back(Node(id, s));
+            children.insert(std::make_pair(std::make_pair(id, s), nodes.size() - 1));
+            id = nodes.size() - 1;
+        }
+        return id;
+    }
+
+private:
+    struct Node
+    {
+        unsigned parent;
+        CallInst *site;
+        Node(unsigned parent, CallInst *site) : parent(parent), site(site) {}
+    };
+
+    unsigned k;
+    unsigned budget; // maximum number of contexts, 0 for unlimited
+    std::vector<Node> nodes;
+    std::map<std::pair<unsigned, CallInst *>, unsigned> children;
+};
+
+#endif /* !_CONTEXT_H_ */
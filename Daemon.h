@@ -0,0 +1,343 @@
+/************************************************************************
+ *
+ * @file Daemon.h
+ *
+ * Resident query mode: an index of the resolved call sites and a line
+ * server answering queries about them on a stream or a Unix socket
+ *
+ ***********************************************************************/
+
+#ifndef _DAEMON_H_
+#define _DAEMON_H_
+
+#include <llvm/IR/Module.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/DebugInfoMetadata.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/Path.h>
+#include <llvm/Support/raw_ostream.h>
+#include "Liveness.h"
+#include "Shard.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+using namespace llvm;
+
+///
+/// The callees of every call site of an analysis, by source location and
+/// by calling function, with the callee lists already printed, so that a
+/// query copies strings and touches no IR. It outlives the modules it was
+/// built from.
+///
+class CallSiteIndex
+{
+public:
+    CallSiteIndex() : sites(), by_line(), by_function() {}
+
+    /// Replaces the index with the call sites of call_func_result
+    void build(const std::map<CallInst *, FunctionSet> &call_func_result)
+    {
+        sites.clear();
+        by_line.clear();
+        by_function.clear();
+        std::map<const Function *, std::pair<std::string, unsigned>> order;
+        for (auto ci = call_func_result.begin(), ce = call_func_result.end(); ci != ce; ci++)
+        {
+            Site site;
+            site.line = ci->first->getDebugLoc().getLine();
+            if (DILocation *loc = ci->first->getDebugLoc().get())
+            {
+                site.file = loc->getFilename().str();
+                site.path = site.file;
+                if (!sys::path::is_absolute(site.file) && !loc->getDirectory().empty())
+                {
+                    SmallString<128> path(loc->getDirectory());
+                    sys::path::append(path, site.file);
+                    site.path = path.str().str();
+                }
+            }
+            site.function = ci->first->getFunction()->getName().str();
+            raw_string_ostream os(site.callees);
+            printCallees(ci->second, &order, os);
+            os.flush();
+            sites.push_back(site);
+        }
+        // 和printCallFuncResult一样按行号排, 行号相同时保持原来的顺序
+        std::stable_sort(sites.begin(), sites.end(), [](const Site &a, const Site &b) { return a.line < b.line; });
+        for (unsigned i = 0; i < sites.size(); i++)
+        {
+            by_line[sites[i].line].push_back(i);
+            by_function[sites[i].function].push_back(i);
+        }
+    }
+
+    ///
+    /// Answers a query, "<file>:<line>" or the name of a function, with the
+    /// lines the analysis prints for the calls there. The file matches the
+    /// debug location by its full path or by any trailing part of it.
+    ///
+    bool answer(StringRef query, raw_ostream &out) const
+    {
+        size_t colon = query.rfind(':');
+        unsigned line;
+        if (colon != StringRef::npos && !query.drop_front(colon + 1).getAsInteger(10, line))
+        {
+            StringRef file = query.take_front(colon);
+            auto li = by_line.find(line);
+            bool found = false;
+            for (unsigned i = 0, e = li == by_line.end() ? 0 : li->second.size(); i != e; i++)
+            {
+                const Site &site = sites[li->second[i]];
+                if (matchesFile(site, file))
+                {
+                    print(site, out);
+                    found = true;
+                }
+            }
+            if (!found)
+            {
+                out << "error: no call at " << query << "\n";
+            }
+            return found;
+        }
+        auto fi = by_function.find(query.str());
+        if (fi == by_function.end())
+        {
+            out << "error: no call in a function named " << query << "\n";
+            return false;
+        }
+        for (unsigned i : fi->second)
+        {
+            print(sites[i], out);
+        }
+        return true;
+    }
+
+    unsigned size() const { return sites.size(); }
+
+private:
+    struct Site
+    {
+        std::string file;     // as in the debug location
+        std::string path;     // with the compilation directory if file is relative
+        unsigned line;
+        std::string function; // caller
+        std::string callees;  // printed
+        Site() : file(), path(), line(0), function(), callees() {}
+    };
+
+    std::vector<Site> sites; // ordered by line
+    std::map<unsigned, std::vector<unsigned>> by_line;
+    std::map<std::string, std::vector<unsigned>> by_function;
+
+    static bool matchesFile(const Site &site, StringRef file)
+    {
+        if (file.empty() || file == site.file || file == site.path)
+        {
+            return true;
+        }
+        StringRef path(site.path);
+        return path.endswith(file) && path.drop_back(file.size()).endswith("/");
+    }
+
+    static void print(const Site &site, raw_ostream &out)
+    {
+        out << site.line << " : " << site.callees << "\n";
+    }
+};
+
+///
+/// Reads queries one per line and writes each answer followed by an
+/// empty line, from a stream or from the clients of a Unix domain socket.
+/// Queries are answered one at a time in the order they arrive.
+///
+class QueryServer
+{
+public:
+    typedef std::function<void(StringRef, raw_ostream &)> Handler;
+
+    QueryServer(Handler handler) : handler(handler) {}
+
+    /// Answers the queries read from in on out until in is closed, the last one with or without a newline
+    bool serveStream(int in, int out)
+    {
+        std::string buffer;
+        char chunk[4096];
+        for (;;)
+        {
+            ssize_t n = read(in, chunk, sizeof(chunk));
+            if (n < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (n < 0)
+            {
+                return false;
+            }
+            if (n == 0)
+            {
+                // 最后一个查询可能没有换行
+                if (!buffer.empty())
+                {
+                    buffer += '\n';
+                }
+                return writeAll(out, answerLines(&buffer));
+            }
+            buffer.append(chunk, n);
+            if (!writeAll(out, answerLines(&buffer)))
+            {
+                return false;
+            }
+        }
+    }
+
+    ///
+    /// Listens on a Unix domain socket at path, replacing a stale socket
+    /// there, until SIGINT or SIGTERM, and removes the socket then. A
+    /// client may send any number of queries over one connection.
+    ///
+    bool serveSocket(StringRef path, std::string *error)
+    {
+        struct sockaddr_un address;
+        if (path.size() >= sizeof(address.sun_path))
+        {
+            *error = "socket path too long";
+            return false;
+        }
+        int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (listener < 0)
+        {
+            *error = strerror(errno);
+            return false;
+        }
+        memset(&address, 0, sizeof(address));
+        address.sun_family = AF_UNIX;
+        memcpy(address.sun_path, path.data(), path.size());
+        sys::fs::file_status status;
+        if (!sys::fs::status(path, status) && status.type() == sys::fs::file_type::socket_file)
+        {
+            unlink(address.sun_path);
+        }
+        if (bind(listener, (struct sockaddr *)&address, sizeof(address)) < 0 || listen(listener, 16) < 0)
+        {
+            *error = strerror(errno);
+            close(listener);
+            return false;
+        }
+
+        // 客户端提前关闭连接时写入不应杀掉进程
+        signal(SIGPIPE, SIG_IGN);
+        stopping() = 0;
+        struct sigaction action;
+        memset(&action, 0, sizeof(action));
+        action.sa_handler = [](int) { stopping() = 1; };
+        sigaction(SIGINT, &action, nullptr);
+        sigaction(SIGTERM, &action, nullptr);
+
+        std::vector<int> clients;
+        std::vector<std::string> buffers;
+        while (!stopping())
+        {
+            std::vector<struct pollfd> fds(1, pollfd{listener, POLLIN, 0});
+            for (int fd : clients)
+            {
+                fds.push_back(pollfd{fd, POLLIN, 0});
+            }
+            if (poll(fds.data(), fds.size(), -1) < 0)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+                *error = strerror(errno);
+                break;
+            }
+            for (unsigned c = clients.size(); c-- > 0;)
+            {
+                if (!fds[c + 1].revents)
+                {
+                    continue;
+                }
+                char chunk[4096];
+                ssize_t n = read(clients[c], chunk, sizeof(chunk));
+                if (n < 0 && errno == EINTR)
+                {
+                    continue;
+                }
+                if (n > 0)
+                {
+                    buffers[c].append(chunk, n);
+                    if (writeAll(clients[c], answerLines(&buffers[c])))
+                    {
+                        continue;
+                    }
+                }
+                else if (n == 0 && !buffers[c].empty())
+                {
+                    buffers[c] += '\n';
+                    writeAll(clients[c], answerLines(&buffers[c]));
+                }
+                close(clients[c]);
+                clients.erase(clients.begin() + c);
+                buffers.erase(buffers.begin() + c);
+            }
+            if (fds[0].revents & POLLIN)
+            {
+                int client = accept(listener, nullptr, nullptr);
+                if (client >= 0)
+                {
+                    clients.push_back(client);
+                    buffers.push_back(std::string());
+                }
+            }
+        }
+        for (int fd : clients)
+        {
+            close(fd);
+        }
+        close(listener);
+        unlink(address.sun_path);
+        return error->empty();
+    }
+
+private:
+    Handler handler;
+
+    static volatile sig_atomic_t &stopping()
+    {
+        static volatile sig_atomic_t flag = 0;
+        return flag;
+    }
+
+    /// Answers the complete lines of buffer and leaves the incomplete rest
+    std::string answerLines(std::string *buffer)
+    {
+        std::string replies;
+        raw_string_ostream out(replies);
+        size_t start = 0;
+        for (size_t end; (end = buffer->find('\n', start)) != std::string::npos; start = end + 1)
+        {
+            StringRef query = StringRef(*buffer).slice(start, end).trim();
+            if (!query.empty())
+            {
+                handler(query, out);
+                out << "\n";
+            }
+        }
+        buffer->erase(0, start);
+        out.flush();
+        return replies;
+    }
+};
+
+#endif /* !_DAEMON_H_ */
@@ -10,6 +10,7 @@
 #define _DATAFLOW_H_
 
 #include <llvm/Support/raw_ostream.h>
+#include <chrono>
 #include <map>
 #include <set>
 #include <vector>
@@ -80,8 +81,55 @@ public:
     /// @return true if dest changed
     ///
     virtual void merge(T *dest, const T &src) = 0;
+
+    ///
+    /// Size of a dfval, checked against DataflowBudget::max_state_size
+    ///
+    virtual size_t stateSize(const T &dfval) { return 0; }
+
+    ///
+    /// Blocks of fn to visit again although their input did not change,
+    /// because facts the visitor keeps outside of the dfvals changed.
+    /// Invoked after every block; the visitor forgets the blocks it hands out.
+    ///
+    virtual void takeDirtyBlocks(Function *fn, std::set<BasicBlock *> *blocks) {}
 };
 
+///
+/// Per-function limits of compForwardDataflow, 0 means unlimited
+///
+struct DataflowBudget
+{
+    unsigned max_block_visits; /// basic blocks taken off the worklist
+    double max_seconds;        /// wall time spent in the function
+    size_t max_state_size;     /// size of any block output, see DataflowVisitor::stateSize
+    DataflowBudget() : max_block_visits(0), max_seconds(0), max_state_size(0) {}
+};
+
+enum DataflowStatus
+{
+    DF_Converged,
+    DF_ExceededBlockVisits,
+    DF_ExceededTime,
+    DF_ExceededStateSize
+};
+
+inline const char *getDataflowStatusName(DataflowStatus status)
+{
+    switch (status)
+    {
+    case DF_Converged:
+        return "converged";
+    case DF_ExceededBlockVisits:
+        return "block visits";
+    case DF_ExceededTime:
+        return "wall time";
+    case DF_ExceededStateSize:
+        return "state size";
+    }
+    return "unknown";
+}
+
 ///
 /// Compute a forward iterated fixedpoint dataflow function, using a user-supplied
 /// visitor function. Note that the caller must ensure that the function is
@@ -91,14 +139,22 @@ public:
 /// @param visitor A function to compute dataflow vals
 /// @param result The results of the dataflow
 /// @initval the Initial dataflow value
+/// @budget Limits after which the iteration is abandoned
+/// @return DF_Converged, or which limit was exceeded; result is then not a fixedpoint
 template <class T>
-void compForwardDataflow(Function *fn,
-                         DataflowVisitor<T> *visitor,
-                         typename DataflowResult<T>::Type *result,
-                         const T &initval)
+DataflowStatus compForwardDataflow(Function *fn,
+                                   DataflowVisitor<T> *visitor,
+                                   typename DataflowResult<T>::Type *result,
+                                   const T &initval,
+                                   const DataflowBudget &budget = DataflowBudget())
 {
+    auto start = std::chrono::steady_clock::now();
+    unsigned block_visits = 0;
 
-    std::set<BasicBlock *> bb_worklist;
+    // blocks are visited in layout order, not in the order of their addresses
+    std::map<BasicBlock *, unsigned> positions;
+    std::set<std::pair<unsigned, BasicBlock *>> bb_worklist;
+    std::set<BasicBlock *> dirty;
     for (Function::iterator bi = fn->begin(), be = fn->end(); bi != be; bi++)
     {
         BasicBlock *bb = dyn_cast<BasicBlock>(bi);
@@ -107,12 +163,22 @@ void compForwardDataflow(Function *fn,
             auto i = dyn_cast<Instruction>(ii);
             result->insert(std::make_pair(i, std::make_pair(initval, initval)));
         }
-        bb_worklist.insert(bb);
+        bb_worklist.insert(std::make_pair(positions.size(), bb));
+        positions.insert(std::make_pair(bb, positions.size()));
     }
     // LivenessInfo initval;
     while (!bb_worklist.empty())
     { // 遍历每个BasicBlock
-        BasicBlock *bb = *bb_worklist.begin();
+        if (budget.max_block_visits && ++block_visits > budget.max_block_visits)
+        {
+            return DF_ExceededBlockVisits;
+        }
+        if (budget.max_seconds &&
+            std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() > budget.max_seconds)
+        {
+            return DF_ExceededTime;
+        }
+        BasicBlock *bb = bb_worklist.begin()->second;
         bb_worklist.erase(bb_worklist.begin());
 
         Instruction *bb_first_inst = dyn_cast<Instruction>(bb->begin());
@@ -129,16 +195,80 @@ void compForwardDataflow(Function *fn,
         (*result)[bb_first_inst].first = bbinval;
         T bb_outval = (*result)[bb_last_inst].second;
         visitor->compDFVal(bb, result, true);
+        visitor->takeDirtyBlocks(fn, &dirty);
+        for (BasicBlock *dirty_bb : dirty)
+        {
+            bb_worklist.insert(std::make_pair(positions[dirty_bb], dirty_bb));
+        }
+        dirty.clear();
+        if (budget.max_state_size && visitor->stateSize((*result)[bb_last_inst].second) > budget.max_state_size)
+        {
+            return DF_ExceededStateSize;
+        }
         if(bb_outval==(*result)[bb_last_inst].second){
             continue;
         }else{
             for(auto bi=succ_begin(bb),be=succ_end(bb);bi!=be;bi++){
-                bb_worklist.insert(*bi);
+                bb_worklist.insert(std::make_pair(positions[*bi], *bi));
             }
         }
 
     }
-    return;
+    return DF_Converged;
+}
+
+///
+/// Flow-insensitive fallback of compForwardDataflow: a single dfval stands
+/// for every program point of the function. Each instruction reads it and
+/// its output is merged back, so updates are weak and the result is a
+/// conservative, cheap approximation of the flow-sensitive fixedpoint.
+///
+/// @param fn The function
+/// @param visitor A function to compute dataflow vals
+/// @param result The results of the dataflow, may hold a partial flow-sensitive result
+template <class T>
+void compFlowInsensitiveDataflow(Function *fn,
+                                 DataflowVisitor<T> *visitor,
+                                 typename DataflowResult<T>::Type *result)
+{
+    // start from everything already known about the function
+    T state;
+    for (Function::iterator bi = fn->begin(), be = fn->end(); bi != be; bi++)
+    {
+        for (auto ii = bi->begin(), ie = bi->end(); ii != ie; ii++)
+        {
+            Instruction *inst = &*ii;
+            visitor->merge(&state, (*result)[inst].first);
+            visitor->merge(&state, (*result)[inst].second);
+        }
+    }
+
+    bool changed = true;
+    while (changed)
+    {
+        T old_state = state;
+        for (Function::iterator bi = fn->begin(), be = fn->end(); bi != be; bi++)
+        {
+            for (auto ii = bi->begin(), ie = bi->end(); ii != ie; ii++)
+            {
+                Instruction *inst = &*ii;
+                (*result)[inst].first = state;
+                visitor->compDFVal(inst, result);
+                visitor->merge(&state, (*result)[inst].second);
+            }
+        }
+        std::set<BasicBlock *> dirty;
+        visitor->takeDirtyBlocks(fn, &dirty);
+        changed = !(old_state == state) || !dirty.empty();
+    }
+
+    for (Function::iterator bi = fn->begin(), be = fn->end(); bi != be; bi++)
+    {
+        for (auto ii = bi->begin(), ie = bi->end(); ii != ie; ii++)
+        {
+            (*result)[&*ii] = std::make_pair(state, state);
+        }
+    }
 }
 ///
 /// Compute a backward iterated fixedpoint dataflow function, using a user-supplied
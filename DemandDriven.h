@@ -0,0 +1,443 @@
+/************************************************************************
+ *
+ * @file DemandDriven.h
+ *
+ * Demand-driven resolution of individual indirect calls over the
+ * Andersen constraint graph
+ *
+ ***********************************************************************/
+
+#ifndef _DEMANDDRIVEN_H_
+#define _DEMANDDRIVEN_H_
+
+#include "Andersen.h"
+#include "Steensgaard.h"
+
+#include <algorithm>
+#include <deque>
+#include <map>
+#include <memory>
+#include <set>
+#include <vector>
+using namespace llvm;
+
+///
+/// Answers "which functions may this call reach" without solving the whole
+/// module. Starting from the called value, the search walks constraints
+/// backwards (the inclusion rules read as a CFL-reachability problem):
+/// address-of gives an object, a copy asks for its source, a load asks for
+/// the contents of every object its pointer may point to, the contents of
+/// an object ask for the stores whose pointer may reach it, and formals and
+/// call results ask across the calls that may bind them.
+///
+/// Which stores may write an object and which indirect calls may bind a
+/// formal depend on points-to sets themselves. A unification pass over the
+/// whole graph, close to linear, narrows both down to the store pointers
+/// and called values in the object's class, and only those are demanded.
+///
+/// Only demanded nodes are evaluated, with a worklist over the dependencies
+/// recorded while evaluating them. When a query closes, every node it
+/// demanded has its final points-to set and is reused by later queries.
+/// Every query has a budget of edge visits; one that runs out falls back to
+/// the whole-program solver, which is run at most once.
+///
+class DemandDrivenResolver
+{
+public:
+    DemandDrivenResolver(unsigned max_steps = 0)
+        : graph(), builder(&graph), addr_in(), copy_in(), load_in(), is_object(), stored_at(), store_index(),
+          object_class(), stores_by_class(), formal_of(), call_of_ret(), call_index(), direct_calls(), callee_calls(),
+          call_index_by_func(), callees_by_class(), indexed(), pts(), users(), solved(), in_demand(), queued(), narrowed_stores(), narrowed_calls(), demanded(),
+          worklist(), fallback(), max_steps(max_steps), last_steps(0), num_fallbacks(0) {}
+
+    void build(Module &M)
+    {
+        builder.build(M);
+        unsigned size = graph.num_nodes;
+        addr_in.resize(size);
+        copy_in.resize(size);
+        load_in.resize(size);
+        is_object.resize(size, false);
+        stored_at.resize(size);
+        store_index.resize(size);
+        callee_calls.resize(size);
+        indexed.resize(size);
+        pts.resize(size);
+        users.resize(size);
+        solved.resize(size, false);
+        in_demand.resize(size, false);
+        queued.resize(size, false);
+        for (const Constraint &c : graph.constraints)
+        {
+            switch (c.kind)
+            {
+            case CK_AddrOf:
+                addr_in[c.dst].push_back(c.src);
+                is_object[c.src] = true;
+                break;
+            case CK_Copy:
+                copy_in[c.dst].push_back(c.src);
+                break;
+            case CK_Load:
+                load_in[c.dst].push_back(c.src);
+                break;
+            case CK_Store:
+                stored_at[c.dst].push_back(c.src);
+                break;
+            }
+        }
+        for (auto fi = graph.functions.begin(), fe = graph.functions.end(); fi != fe; fi++)
+        {
+            for (unsigned i = 0, e = fi->second.formals.size(); i != e; i++)
+            {
+                if (fi->second.formals[i])
+                {
+                    formal_of[fi->second.formals[i]] = std::make_pair(fi->first, i);
+                }
+            }
+        }
+        for (unsigned i = 0, e = graph.calls.size(); i != e; i++)
+        {
+            const CallConstraint &call = graph.calls[i];
+            call_index[call.inst] = i;
+            if (call.ret)
+            {
+                call_of_ret[call.ret] = i;
+            }
+            Value *value = ConstraintBuilder::stripConstantCasts(call.inst->getCalledValue());
+            if (isa<Function>(value))
+            {
+                direct_calls[builder.object_nodes[value]].push_back(i);
+            }
+            else if (call.callee)
+            {
+                callee_calls[call.callee].push_back(i);
+            }
+        }
+
+        // 统一的结果是包含关系的上界: 指针指向的类之外的对象它一定不会指向
+        SteensgaardSolver unification(graph);
+        unification.solve();
+        object_class.resize(size, 0);
+        for (unsigned n = 1; n < size; n++)
+        {
+            if (is_object[n] || graph.functions.count(n))
+            {
+                object_class[n] = unification.getClass(n);
+            }
+            unsigned cls = unification.getPointeeClass(n);
+            if (cls && !stored_at[n].empty())
+            {
+                stores_by_class[cls].push_back(n);
+            }
+            if (cls && !callee_calls[n].empty())
+            {
+                callees_by_class[cls].push_back(n);
+            }
+        }
+    }
+
+    /// Functions callInst may call. complete is cleared if the budget ran
+    /// out and the answer came from the whole-program solver.
+    FunctionSet query(CallInst *callInst, bool *complete = nullptr)
+    {
+        FunctionSet callees;
+        last_steps = 0;
+        if (complete)
+        {
+            *complete = true;
+        }
+        auto it = call_index.find(callInst);
+        if (it == call_index.end() || !graph.calls[it->second].callee)
+        {
+            return callees;
+        }
+        unsigned callee = graph.calls[it->second].callee;
+        if (!demand(callee))
+        {
+            num_fallbacks++;
+            if (complete)
+            {
+                *complete = false;
+            }
+            if (!fallback)
+            {
+                fallback.reset(new AndersenSolver(graph));
+                fallback->solve();
+            }
+            const std::set<unsigned> &targets = fallback->getCallTargets(it->second);
+            for (unsigned target : targets)
+            {
+                callees.insert(graph.functions[target].func);
+            }
+            return callees;
+        }
+        for (unsigned o : pts[callee])
+        {
+            auto fi = graph.functions.find(o);
+            if (fi != graph.functions.end())
+            {
+                callees.insert(fi->second.func);
+            }
+        }
+        return callees;
+    }
+
+    /// Edge visits spent by the last query
+    unsigned getLastSteps() const { return last_steps; }
+    unsigned getNumFallbacks() const { return num_fallbacks; }
+
+private:
+    ConstraintGraph graph;
+    ConstraintBuilder builder;
+    std::vector<std::vector<unsigned>> addr_in, copy_in, load_in; // incoming constraints, by dst
+    std::vector<bool> is_object;
+    std::vector<std::vector<unsigned>> stored_at;   // pointer -> values stored through it
+    std::vector<std::vector<unsigned>> store_index; // object -> pointers of stores that may write it
+    std::vector<unsigned> object_class;             // object or function -> its unification class
+    std::map<unsigned, std::vector<unsigned>> stores_by_class; // class -> store pointers into it
+    std::map<unsigned, std::pair<unsigned, unsigned>> formal_of; // formal -> (function object, index)
+    std::map<unsigned, unsigned> call_of_ret;                    // result node -> call
+    std::map<CallInst *, unsigned> call_index;
+    std::map<unsigned, std::vector<unsigned>> direct_calls; // function object -> calls naming it
+    std::vector<std::vector<unsigned>> callee_calls;        // called value -> indirect calls through it
+    std::map<unsigned, std::vector<unsigned>> call_index_by_func; // function object -> indirect calls that may reach it
+    std::map<unsigned, std::vector<unsigned>> callees_by_class;   // class -> called values pointing into it
+    std::vector<SparseBitVector<>> indexed; // part of pts of a store pointer or called value already indexed
+    std::vector<SparseBitVector<>> pts;
+    std::vector<std::vector<unsigned>> users; // nodes whose evaluation read pts of a node
+    std::vector<bool> solved;                 // points-to set is final
+    std::vector<bool> in_demand;
+    std::vector<bool> queued;
+    std::set<unsigned> narrowed_stores, narrowed_calls; // classes whose stores / calls this query demands
+    std::vector<unsigned> demanded;
+    std::deque<unsigned> worklist;
+    std::unique_ptr<AndersenSolver> fallback;
+    unsigned max_steps; // edge visits per query, 0 for unlimited
+    unsigned last_steps;
+    unsigned num_fallbacks;
+
+    static std::vector<unsigned> toVector(const SparseBitVector<> &bv)
+    {
+        std::vector<unsigned> v;
+        for (unsigned n : bv)
+        {
+            v.push_back(n);
+        }
+        return v;
+    }
+
+    /// Evaluates the nodes root depends on to a fixpoint, false if out of budget
+    bool demand(unsigned root)
+    {
+        if (solved[root])
+        {
+            return true;
+        }
+        need(root, 0);
+        bool in_budget = true;
+        while (!worklist.empty())
+        {
+            if (max_steps && last_steps > max_steps)
+            {
+                in_budget = false;
+                break;
+            }
+            unsigned n = worklist.front();
+            worklist.pop_front();
+            queued[n] = false;
+            if (evaluate(n))
+            {
+                grow(n);
+            }
+        }
+        worklist.clear();
+        for (unsigned n : demanded)
+        {
+            in_demand[n] = queued[n] = false;
+            // 超出预算时保留部分结果, 它们仍是下界, 下次需要时重新计算
+            solved[n] = in_budget;
+        }
+        demanded.clear();
+        narrowed_stores.clear();
+        narrowed_calls.clear();
+        return in_budget;
+    }
+
+    /// Records that reader depends on pts[n] and demands n
+    void need(unsigned n, unsigned reader)
+    {
+        if (solved[n])
+        {
+            return;
+        }
+        if (reader)
+        {
+            users[n].push_back(reader);
+        }
+        if (!in_demand[n])
+        {
+            in_demand[n] = true;
+            demanded.push_back(n);
+            push(n);
+        }
+    }
+
+    void push(unsigned n)
+    {
+        if (in_demand[n] && !queued[n])
+        {
+            queued[n] = true;
+            worklist.push_back(n);
+        }
+    }
+
+    /// pts[n] grew: wake its readers and index the new pointees of stores and calls through n
+    void grow(unsigned n)
+    {
+        std::vector<unsigned> readers;
+        readers.swap(users[n]);
+        std::sort(readers.begin(), readers.end());
+        readers.erase(std::unique(readers.begin(), readers.end()), readers.end());
+        for (unsigned reader : readers)
+        {
+            push(reader);
+        }
+        users[n] = readers;
+        if (stored_at[n].empty() && callee_calls[n].empty())
+        {
+            return;
+        }
+        SparseBitVector<> delta = pts[n];
+        delta.intersectWithComplement(indexed[n]);
+        indexed[n] |= delta;
+        for (unsigned o : delta)
+        {
+            if (!stored_at[n].empty())
+            {
+                store_index[o].push_back(n);
+                push(o);
+            }
+            if (!callee_calls[n].empty() && graph.functions.count(o))
+            {
+                std::vector<unsigned> &calls = call_index_by_func[o];
+                calls.insert(calls.end(), callee_calls[n].begin(), callee_calls[n].end());
+                const FunctionNodes &fn = graph.functions.find(o)->second;
+                for (unsigned formal : fn.formals)
+                {
+                    if (formal)
+                    {
+                        push(formal);
+                    }
+                }
+            }
+        }
+    }
+
+    /// Adds what n's incoming constraints give, true if pts[n] grew
+    bool evaluate(unsigned n)
+    {
+        SparseBitVector<> &out = pts[n];
+        bool changed = false;
+        for (unsigned o : addr_in[n])
+        {
+            changed |= out.test_and_set(o);
+        }
+        last_steps += addr_in[n].size() + 1;
+        for (unsigned src : copy_in[n])
+        {
+            need(src, n);
+            changed |= (out |= pts[src]);
+        }
+        last_steps += copy_in[n].size();
+        for (unsigned src : load_in[n])
+        {
+            need(src, n);
+            std::vector<unsigned> objects = toVector(pts[src]);
+            for (unsigned o : objects)
+            {
+                need(o, n);
+                changed |= (n != o && (out |= pts[o]));
+            }
+            last_steps += objects.size();
+        }
+        if (is_object[n])
+        {
+            // 对象的内容取决于可能写它的store, 要先知道这些store的指针指向哪里
+            auto si = stores_by_class.find(object_class[n]);
+            if (si != stores_by_class.end() && narrowed_stores.insert(si->first).second)
+            {
+                for (unsigned p : si->second)
+                {
+                    need(p, 0);
+                }
+                last_steps += si->second.size();
+            }
+            for (unsigned p : store_index[n])
+            {
+                for (unsigned src : stored_at[p])
+                {
+                    need(src, n);
+                    changed |= (n != src && (out |= pts[src]));
+                }
+                last_steps += stored_at[p].size();
+            }
+        }
+        auto fi = formal_of.find(n);
+        if (fi != formal_of.end())
+        {
+            changed |= evaluateFormal(n, fi->second.first, fi->second.second);
+        }
+        auto ci = call_of_ret.find(n);
+        if (ci != call_of_ret.end())
+        {
+            const CallConstraint &call = graph.calls[ci->second];
+            need(call.callee, n);
+            std::vector<unsigned> targets = toVector(pts[call.callee]);
+            for (unsigned o : targets)
+            {
+                auto ti = graph.functions.find(o);
+                if (ti != graph.functions.end() && ti->second.ret)
+                {
+                    need(ti->second.ret, n);
+                    changed |= (out |= pts[ti->second.ret]);
+                }
+            }
+            last_steps += targets.size();
+        }
+        return changed;
+    }
+
+    /// Arguments bound to the index-th formal of func by the calls reaching it
+    bool evaluateFormal(unsigned n, unsigned func, unsigned index)
+    {
+        // 形参来自哪些间接调用, 要先知道可能调用func的那些间接调用的callee
+        auto ci = callees_by_class.find(object_class[func]);
+        if (ci != callees_by_class.end() && narrowed_calls.insert(ci->first).second)
+        {
+            for (unsigned callee : ci->second)
+            {
+                need(callee, 0);
+            }
+            last_steps += ci->second.size();
+        }
+        SparseBitVector<> &out = pts[n];
+        bool changed = false;
+        std::vector<unsigned> calls = direct_calls[func];
+        std::vector<unsigned> &indirect = call_index_by_func[func];
+        calls.insert(calls.end(), indirect.begin(), indirect.end());
+        for (unsigned call : calls)
+        {
+            const CallConstraint &c = graph.calls[call];
+            if (index < c.args.size() && c.args[index])
+            {
+                need(c.args[index], n);
+                changed |= (out |= pts[c.args[index]]);
+            }
+        }
+        last_steps += calls.size();
+        return changed;
+    }
+};
+
+#endif /* !_DEMANDDRIVEN_H_ */
@@ -0,0 +1,123 @@
+/************************************************************************
+ *
+ * @file FastPath.h
+ *
+ * Syntactic resolution of indirect calls whose callee is a phi, select
+ * or cast of constant functions
+ *
+ ***********************************************************************/
+
+#ifndef _FASTPATH_H_
+#define _FASTPATH_H_
+
+#include <llvm/IR/Module.h>
+#include <llvm/IR/Function.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/IntrinsicInst.h>
+#include <llvm/IR/InstIterator.h>
+#include "TypeIndex.h"
+
+#include <map>
+#include <set>
+#include <vector>
+using namespace llvm;
+
+///
+/// Chases the called value of every indirect call through phis, selects
+/// and pointer casts. When every leaf is a Function (or null/undef), the
+/// callees are known without looking at memory, and the same in every
+/// context, so the solver can take them as given. Any other leaf (a load,
+/// a formal, a call result) leaves the site to the solver.
+///
+class SyntacticCallResolver
+{
+public:
+    SyntacticCallResolver() : resolved(), num_indirect(0) {}
+
+    void run(Module &M)
+    {
+        resolved.clear();
+        num_indirect = 0;
+        for (auto &F : M)
+        {
+            runOnFunction(F);
+        }
+    }
+
+    /// Resolves the indirect calls of F, for functions read after run
+    void runOnFunction(Function &F)
+    {
+        for (inst_iterator ii = inst_begin(&F), ie = inst_end(&F); ii != ie; ii++)
+        {
+            auto *callInst = dyn_cast<CallInst>(&*ii);
+            if (!callInst || isa<IntrinsicInst>(callInst) ||
+                isa<Function>(callInst->getCalledValue()->stripPointerCasts()))
+            {
+                continue;
+            }
+            num_indirect++;
+            std::set<Function *> callees;
+            if (resolve(callInst->getCalledValue(), &callees))
+            {
+                for (auto fi = callees.begin(); fi != callees.end();)
+                {
+                    if (FunctionTypeIndex::isCompatible(callInst, *fi))
+                        fi++;
+                    else
+                        fi = callees.erase(fi);
+                }
+                resolved[callInst] = callees;
+            }
+        }
+    }
+
+    /// Callees of callInst if the fast path closed it, null otherwise
+    const std::set<Function *> *lookup(CallInst *callInst) const
+    {
+        auto it = resolved.find(callInst);
+        return it == resolved.end() ? nullptr : &it->second;
+    }
+
+    const std::map<CallInst *, std::set<Function *>> &getResolved() const { return resolved; }
+    unsigned getNumIndirect() const { return num_indirect; }
+
+private:
+    std::map<CallInst *, std::set<Function *>> resolved;
+    unsigned num_indirect;
+
+    static bool resolve(Value *value, std::set<Function *> *callees)
+    {
+        std::set<Value *> visited;
+        std::vector<Value *> worklist(1, value);
+        while (!worklist.empty())
+        {
+            Value *v = worklist.back()->stripPointerCasts();
+            worklist.pop_back();
+            if (!visited.insert(v).second)
+            {
+                continue;
+            }
+            if (auto *func = dyn_cast<Function>(v))
+            {
+                callees->insert(func);
+            }
+            else if (auto *phiNode = dyn_cast<PHINode>(v))
+            {
+                worklist.insert(worklist.end(), phiNode->incoming_values().begin(), phiNode->incoming_values().end());
+            }
+            else if (auto *selectInst = dyn_cast<SelectInst>(v))
+            {
+                worklist.push_back(selectInst->getTrueValue());
+                worklist.push_back(selectInst->getFalseValue());
+            }
+            else if (!isa<ConstantPointerNull>(v) && !isa<UndefValue>(v))
+            {
+                // 需要内存或过程间信息
+                return false;
+            }
+        }
+        return true;
+    }
+};
+
+#endif /* !_FASTPATH_H_ */
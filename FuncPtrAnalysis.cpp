@@ -0,0 +1,110 @@
+/************************************************************************
+ *
+ * @file FuncPtrAnalysis.cpp
+ *
+ * FuncPtrAnalysis and its printer, and the entry point that loads them
+ * into opt or clang as a pass plugin
+ *
+ ***********************************************************************/
+
+#include <llvm/Config/llvm-config.h>
+#include <llvm/IR/IntrinsicInst.h>
+#include <llvm/Passes/PassBuilder.h>
+#include <llvm/Passes/PassPlugin.h>
+#include <llvm/Support/CommandLine.h>
+#include "FuncPtrAnalysis.h"
+#include "Liveness.h"
+
+static cl::opt<bool>
+    PrintAtEnd("funcptr-print",
+               cl::desc("Print the callees of every call site at the end of the optimization and LTO pipelines"),
+               cl::init(false));
+
+AnalysisKey FuncPtrAnalysis::Key;
+
+bool FuncPtrAnalysis::Result::invalidate(Module &M, const PreservedAnalyses &PA, ModuleAnalysisManager::Invalidator &inv)
+{
+    auto checker = PA.getChecker<FuncPtrAnalysis>();
+    return !checker.preserved() && !checker.preservedSet<AllAnalysesOn<Module>>();
+}
+
+FuncPtrAnalysis::Result FuncPtrAnalysis::run(Module &M, ModuleAnalysisManager &MAM)
+{
+    Result result;
+    result.result = PointerAnalysis::run(M, options, &result.error);
+    return result;
+}
+
+PreservedAnalyses FuncPtrPrinterPass::run(Module &M, ModuleAnalysisManager &MAM)
+{
+    FuncPtrAnalysis::Result &result = MAM.getResult<FuncPtrAnalysis>(M);
+    if (!result.result)
+    {
+        out << result.error << "\n";
+        return PreservedAnalyses::all();
+    }
+    std::map<CallInst *, FunctionSet> call_func_result;
+    for (auto &F : M)
+    {
+        for (inst_iterator ii = inst_begin(F), ie = inst_end(F); ii != ie; ii++)
+        {
+            auto *callInst = dyn_cast<CallInst>(&*ii);
+            if (!callInst || isa<IntrinsicInst>(callInst))
+            {
+                continue;
+            }
+            // 和命令行工具一样, 到达了但没有被调函数的调用也要打印
+            if (result.result->isReached(callInst))
+            {
+                call_func_result[callInst] = result.result->getCallees(callInst);
+            }
+        }
+    }
+    printCallFuncResult(call_func_result, out);
+    return PreservedAnalyses::all();
+}
+
+///
+/// opt -load-pass-plugin=FuncPtrPlugin.so -passes='function(mem2reg),print<funcptr>'
+/// prints the result, require<funcptr> only computes it. -funcptr-print
+/// prints it after the optimizations, on the module in memory; the
+/// option is only known if the plugin is also loaded before options are
+/// parsed, with -load in opt or -fplugin besides -fpass-plugin in clang.
+///
+extern "C" LLVM_ATTRIBUTE_WEAK PassPluginLibraryInfo llvmGetPassPluginInfo()
+{
+    return {LLVM_PLUGIN_API_VERSION, "FuncPtr", LLVM_VERSION_STRING, [](PassBuilder &PB) {
+                PB.registerAnalysisRegistrationCallback([](ModuleAnalysisManager &MAM) {
+                    MAM.registerPass([] { return FuncPtrAnalysis(); });
+                });
+                PB.registerPipelineParsingCallback(
+                    [](StringRef name, ModulePassManager &MPM, ArrayRef<PassBuilder::PipelineElement>) {
+                        if (name == "print<funcptr>")
+                        {
+                            MPM.addPass(FuncPtrPrinterPass(errs()));
+                            return true;
+                        }
+                        if (name == "require<funcptr>")
+                        {
+                            MPM.addPass(RequireAnalysisPass<FuncPtrAnalysis, Module>());
+                            return true;
+                        }
+                        return false;
+                    });
+                // 优化之后模块已经是SSA形式
+                PB.registerOptimizerLastEPCallback([](ModulePassManager &MPM, auto...) {
+                    if (PrintAtEnd)
+                    {
+                        MPM.addPass(FuncPtrPrinterPass(errs()));
+                    }
+                });
+#if LLVM_VERSION_MAJOR >= 15
+                PB.registerFullLinkTimeOptimizationLastEPCallback([](ModulePassManager &MPM, auto...) {
+                    if (PrintAtEnd)
+                    {
+                        MPM.addPass(FuncPtrPrinterPass(errs()));
+                    }
+                });
+#endif
+            }};
+}
@@ -0,0 +1,60 @@
+/************************************************************************
+ *
+ * @file FuncPtrAnalysis.h
+ *
+ * The flow-sensitive analysis for the new pass manager: a module
+ * analysis caching a PointerAnalysisResult and a pass printing it
+ *
+ ***********************************************************************/
+
+#ifndef _FUNCPTRANALYSIS_H_
+#define _FUNCPTRANALYSIS_H_
+
+#include <llvm/IR/PassManager.h>
+#include <llvm/Support/raw_ostream.h>
+#include "PointerAnalysis.h"
+
+///
+/// Runs PointerAnalysis on a module in SSA form. The analysis manager
+/// keeps the result until a pass changes the module without preserving
+/// it, so passes asking for it in between share one analysis.
+///
+class FuncPtrAnalysis : public AnalysisInfoMixin<FuncPtrAnalysis>
+{
+public:
+    struct Result
+    {
+        std::unique_ptr<PointerAnalysisResult> result; // null if the analysis failed
+        std::string error;
+
+        /// Anything not preserving this analysis may have changed the IR the result refers to
+        bool invalidate(Module &M, const PreservedAnalyses &PA, ModuleAnalysisManager::Invalidator &inv);
+    };
+
+    FuncPtrAnalysis(const PointerAnalysisOptions &options = PointerAnalysisOptions()) : options(options) {}
+
+    Result run(Module &M, ModuleAnalysisManager &MAM);
+
+private:
+    friend AnalysisInfoMixin<FuncPtrAnalysis>;
+    static AnalysisKey Key;
+
+    PointerAnalysisOptions options;
+};
+
+///
+/// Prints the callees of every call site, in the format of the
+/// command line tool, from the cached FuncPtrAnalysis result
+///
+class FuncPtrPrinterPass : public PassInfoMixin<FuncPtrPrinterPass>
+{
+public:
+    explicit FuncPtrPrinterPass(raw_ostream &out) : out(out) {}
+
+    PreservedAnalyses run(Module &M, ModuleAnalysisManager &MAM);
+
+private:
+    raw_ostream &out;
+};
+
+#endif /* !_FUNCPTRANALYSIS_H_ */
@@ -18,6 +18,10 @@
 #include <llvm/Support/SourceMgr.h>
 #include <llvm/IR/LegacyPassManager.h>
 #include <llvm/Support/ToolOutputFile.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/Path.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/Format.h>
 
 #if LLVM_VERSION_MAJOR >= 4
 #include <llvm/Bitcode/BitcodeReader.h>
@@ -28,12 +32,44 @@
 #endif
 
 #include <llvm/Transforms/Scalar.h>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <sys/resource.h>
 
 #include "Liveness.h"
+#include "PointerAnalysis.h"
+#include "Andersen.h"
+#include "Steensgaard.h"
+#include "SparseFS.h"
+#include "TypeSignature.h"
+#include "DemandDriven.h"
+#include "Summary.h"
+#include "Shard.h"
+#include "VisitCache.h"
+#include "Checkpoint.h"
+#include "Daemon.h"
 #include "llvm/IR/Function.h"
 #include "llvm/Pass.h"
 #include "llvm/Support/raw_ostream.h"
 using namespace llvm;
+static std::chrono::steady_clock::time_point ToolStart; // time main was entered
+
+/// Milliseconds since main was entered
+static double msSinceStart()
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - ToolStart).count();
+}
+
+/// Peak resident set size of the process in KB
+static long getPeakRSS()
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
 #if LLVM_VERSION_MAJOR >= 4
 static ManagedStatic<LLVMContext> GlobalContext;
 static LLVMContext &getGlobalContext() { return *GlobalContext; }
@@ -60,17 +96,149 @@ struct EnableFunctionOptPass : public FunctionPass
 char EnableFunctionOptPass::ID = 0;
 #endif
 
+static cl::opt<bool>
+    PrintStats("print-stats",
+               cl::desc("Print the wall time of the analysis after its results"),
+               cl::init(false));
+
+static cl::opt<unsigned>
+    ContextDepth("context-k",
+                 cl::desc("Call-string depth for small pointer wrappers, 0 for context-insensitive"),
+                 cl::init(0));
+
+static cl::opt<unsigned>
+    ContextBudget("context-budget",
+                  cl::desc("Maximum number of calling contexts, 0 for unlimited"),
+                  cl::init(1024));
+
+static cl::opt<unsigned>
+    CloneMaxInsts("clone-max-insts",
+                  cl::desc("Largest function, in instructions, analysed per calling context"),
+                  cl::init(32));
+
+static cl::opt<unsigned>
+    MaxBlockVisits("max-block-visits",
+                   cl::desc("Basic block visits per function before it degrades to flow-insensitive, 0 for unlimited"),
+                   cl::init(0));
+
+static cl::opt<double>
+    MaxFunctionSeconds("max-function-seconds",
+                       cl::desc("Wall time per function visit before it degrades to flow-insensitive, 0 for unlimited"),
+                       cl::init(0));
+
+static cl::opt<unsigned>
+    MaxStateSize("max-state-size",
+                 cl::desc("Points-to facts per program point before a function degrades to flow-insensitive, 0 for unlimited"),
+                 cl::init(0));
+
+static cl::opt<std::string>
+    DegradedReport("degraded-report",
+                   cl::desc("Write the functions that exceeded a budget to this file instead of stderr"),
+                   cl::value_desc("filename"),
+                   cl::init(""));
+
+static cl::opt<bool>
+    SliceFirst("slice",
+               cl::desc("Analyse only the instructions that may affect an indirect callee"),
+               cl::init(false));
+
+static cl::opt<bool>
+    LazyLoad("lazy",
+             cl::desc("Map the input and read function bodies when the flow analysis first reaches them"),
+             cl::init(false));
+
+static cl::list<std::string>
+    EntryPoints("entry",
+                cl::desc("Functions the analysis starts from besides callbacks handed to external code, others are analysed once called (default: main and every externally visible function)"),
+                cl::value_desc("function,..."),
+                cl::CommaSeparated);
+
+static cl::opt<unsigned>
+    Shards("shards",
+           cl::desc("Worker processes for the flow analysis, each owning a part of the call graph, 0 or 1 for none"),
+           cl::init(0));
+
+static cl::opt<std::string>
+    CacheDir("cache-dir",
+             cl::desc("Reuse the function visits cached in <dir>/<name>.fpc by an earlier run, and update it. A visit is reused if its function is unchanged and was handed the same set of states, in whatever order, so an edit misses only in the functions it changes and those it hands different states"),
+             cl::value_desc("dir"),
+             cl::init(""));
+
+static cl::opt<std::string>
+    CheckpointDir("checkpoint-dir",
+                  cl::desc("Checkpoint the flow analysis to <dir>/<name>.fpk now and then, and resume from there if a checkpoint exists"),
+                  cl::value_desc("dir"),
+                  cl::init(""));
+
+static cl::opt<double>
+    CheckpointInterval("checkpoint-interval",
+                       cl::desc("Seconds between two checkpoints, 0 for one after every function visit"),
+                       cl::init(300));
+
+static cl::opt<unsigned>
+    CheckpointStop("checkpoint-stop",
+                   cl::desc("Stop the analysis after writing this many checkpoints, as if it was killed there"),
+                   cl::Hidden,
+                   cl::init(0));
+
+static cl::list<unsigned>
+    QueryLines("query",
+               cl::desc("Resolve only the calls on these source lines, on demand"),
+               cl::value_desc("line,..."),
+               cl::CommaSeparated);
+
+static cl::opt<unsigned>
+    QueryBudget("query-budget",
+                cl::desc("Constraint edge visits per query before falling back to the whole-program solver, 0 for unlimited"),
+                cl::init(1000000));
+
 ///!TODO TO BE COMPLETED BY YOU FOR ASSIGNMENT 3
 struct FuncPtrPass : public ModulePass
 {
 private:
-    DataflowResult<LivenessInfo>::Type result;
-    FunctionSet fn_worklist;
+    bool lazy; // function bodies are read, and put into SSA form, when first reached
+    std::vector<Module *> others; // the rest of the program, linked through a symbol table
+    std::string cache_path;       // visit cache of the module, empty for none
+    std::string checkpoint_path;  // where the analysis is checkpointed, empty for nowhere
+
+    void printDegradedReport(const PointerAnalysisResult &result)
+    {
+        const std::map<std::pair<const Function *, unsigned>, std::string> &degraded = result.getDegradedVisits();
+        if (degraded.empty())
+        {
+            return;
+        }
+        std::error_code EC;
+        std::unique_ptr<raw_fd_ostream> file;
+        if (!DegradedReport.empty())
+        {
+            file.reset(new raw_fd_ostream(DegradedReport, EC, sys::fs::F_Text));
+            if (EC)
+            {
+                errs() << "cannot open " << DegradedReport << ": " << EC.message() << "\n";
+                file.reset();
+            }
+        }
+        raw_ostream &report = file ? *file : out;
+        for (auto di = degraded.begin(), de = degraded.end(); di != de; di++)
+        {
+            report << "degraded " << di->first.first->getName() << " (context " << di->first.second
+                << "): " << di->second << "\n";
+        }
+    }
 
 public:
     static char ID; // Pass identification, replacement for typeid
 
-    FuncPtrPass() : ModulePass(ID) {}
+    raw_ostream &out;           // where results are printed
+    CallSiteIndex *index;       // if set, also gets the results, see -serve
+    std::string *cache_buffer;  // if set, the visit cache is kept here rather than in a file
+    bool failed;                // the analysis could not start, nothing was printed but the reason
+
+    FuncPtrPass(bool lazy = false, raw_ostream &out = errs(), const std::vector<Module *> &others = std::vector<Module *>(),
+                const std::string &cache_path = std::string(), const std::string &checkpoint_path = std::string())
+        : ModulePass(ID), lazy(lazy), others(others), cache_path(cache_path), checkpoint_path(checkpoint_path), out(out),
+          index(nullptr), cache_buffer(nullptr), failed(false) {}
 
     bool runOnModule(Module &M) override
     {
@@ -80,30 +248,139 @@ public:
         //M.print(llvm::errs(), nullptr);
         //errs() << "------------------------------\n";
 
-        for (auto &F : M)
+        // 分析本身在库里, 这里只把命令行选项交给它, 再打印结果
+        PointerAnalysisOptions options;
+        options.context_depth = ContextDepth;
+        options.context_budget = ContextBudget;
+        options.clone_max_insts = CloneMaxInsts;
+        options.max_block_visits = MaxBlockVisits;
+        options.max_seconds = MaxFunctionSeconds;
+        options.max_state_size = MaxStateSize;
+        options.slice_first = SliceFirst;
+        options.entry_points.assign(EntryPoints.begin(), EntryPoints.end());
+        options.lazy = lazy;
+        options.others = others;
+        options.shards = Shards;
+        options.cache_path = cache_path;
+        options.cache_buffer = cache_buffer;
+        options.checkpoint_path = checkpoint_path;
+        options.checkpoint_interval = CheckpointInterval;
+        options.checkpoint_stop = CheckpointStop;
+        options.log = &out;
+        double started = msSinceStart();
+        std::string error;
+        std::unique_ptr<PointerAnalysisResult> result = PointerAnalysis::run(M, options, &error);
+        if (!result)
+        {
+            out << error << "\n";
+            failed = true;
+            return false;
+        }
+
+        const std::map<CallInst *, FunctionSet> &call_func_result = result->getCallSites();
+        if (index)
+        {
+            index->build(call_func_result);
+        }
+        std::vector<Module *> modules(1, &M);
+        modules.insert(modules.end(), others.begin(), others.end());
+        if (modules.size() == 1)
+        {
+            printCallFuncResult(call_func_result, out);
+        }
+        else
         {
-            if (F.isIntrinsic())
+            for (Module *module : modules)
             {
-                continue;
+                std::map<CallInst *, FunctionSet> module_result;
+                for (auto ci = call_func_result.begin(), ce = call_func_result.end(); ci != ce; ci++)
+                {
+                    if (ci->first->getModule() == module)
+                    {
+                        module_result.insert(*ci);
+                    }
+                }
+                out << "==> " << module->getModuleIdentifier() << " <==\n";
+                printCallFuncResult(module_result, out);
+            }
+        }
+        printDegradedReport(*result);
+        if (PrintStats)
+        {
+            const PointerAnalysisStats &stats = result->getStats();
+            unsigned closed = stats.fast_path_resolved, indirect = stats.indirect_calls;
+            out << "fast path: " << closed << " of " << indirect << " indirect call sites";
+            if (indirect)
+            {
+                out << format(" (%.1f%%)", 100.0 * closed / indirect);
             }
-            else
+            out << "\n";
+            out << "call targets: " << stats.resolver_hits << " reused, " << stats.resolver_misses << " walked\n";
+            if (stats.first_result_ms >= 0)
             {
-                //errs() << F.getName() << "\n";
-                fn_worklist.insert(&F);
+                out << "first result: " << format("%.3f", started + stats.first_result_ms) << " ms\n";
+            }
+            if (!stats.shard_cpu_ms.empty())
+            {
+                out << "shards: " << Shards << " processes, instructions";
+                for (unsigned insts : stats.shard_insts)
+                {
+                    out << " " << insts;
+                }
+                out << ", CPU ms";
+                for (double cpu : stats.shard_cpu_ms)
+                {
+                    out << " " << format("%.0f", cpu);
+                }
+                out << ", " << stats.shard_messages << " states exchanged (" << stats.shard_bytes / 1024 << " KB)\n";
+            }
+            if (!cache_path.empty() || cache_buffer)
+            {
+                unsigned bodies = 0;
+                for (auto &F : M)
+                {
+                    bodies += !F.isDeclaration();
+                }
+                out << "cache: " << stats.cache_hits << " visits replayed, " << stats.cache_misses << " analysed ("
+                    << stats.cache_analysed << " of " << bodies << " functions), " << stats.cache_saved_bytes / 1024
+                    << " KB written\n";
+            }
+            if (!checkpoint_path.empty())
+            {
+                out << "checkpoint: ";
+                if (stats.resumed)
+                {
+                    out << "resumed with " << stats.resumed_queue << " functions queued, ";
+                }
+                out << stats.checkpoints_written << " written";
+                if (stats.checkpoints_written)
+                {
+                    out << " (last " << stats.checkpoint_bytes / 1024 << " KB)";
+                }
+                out << "\n";
+            }
+            if (lazy)
+            {
+                unsigned bodies = 0, read = 0;
+                for (Module *module : modules)
+                {
+                    for (auto &F : *module)
+                    {
+                        if (!F.isDeclaration())
+                        {
+                            bodies++;
+                            read += !F.isMaterializable();
+                        }
+                    }
+                }
+                out << "function bodies read: " << read << " of " << bodies << " in " << modules.size() << " modules\n";
+            }
+            if (SliceFirst)
+            {
+                out << "slice: " << stats.slice_relevant_insts << " of " << stats.slice_insts << " instructions, "
+                       << stats.slice_relevant_functions << " functions analysed\n";
             }
         }
-
-        LivenessVisitor visitor;
-        while (!fn_worklist.empty())
-        { //遍历每个Function
-            LivenessInfo initval;
-            Function *func = *(fn_worklist.begin());
-            fn_worklist.erase(fn_worklist.begin());
-            compForwardDataflow(func, &visitor, &result, initval);
-            fn_worklist.insert(visitor.fn_worklist.begin(),visitor.fn_worklist.end());
-            visitor.fn_worklist.clear();
-        }
-        visitor.printCallFuncResult();
         return false;
     }
 };
@@ -111,41 +388,721 @@ public:
 char FuncPtrPass::ID = 0;
 static RegisterPass<FuncPtrPass> X("funcptrpass", "Print function call instruction");
 
+/// Flow-insensitive inclusion-based pass, same output as FuncPtrPass
+struct AndersenPass : public ModulePass
+{
+    static char ID;
+    raw_ostream &out; // where results are printed
+
+    AndersenPass(raw_ostream &out = errs()) : ModulePass(ID), out(out) {}
+
+    bool runOnModule(Module &M) override
+    {
+        AndersenAnalysis analysis;
+        analysis.run(M);
+        analysis.printCallFuncResult(out);
+        return false;
+    }
+};
+
+char AndersenPass::ID = 0;
+static RegisterPass<AndersenPass> Z("andersen", "Print function call instruction, inclusion-based");
+
+/// Flow-insensitive unification-based pass, same output as FuncPtrPass
+struct SteensgaardPass : public ModulePass
+{
+    static char ID;
+    raw_ostream &out; // where results are printed
+
+    SteensgaardPass(raw_ostream &out = errs()) : ModulePass(ID), out(out) {}
+
+    bool runOnModule(Module &M) override
+    {
+        SteensgaardAnalysis analysis;
+        analysis.run(M);
+        analysis.printCallFuncResult(out);
+        return false;
+    }
+};
+
+char SteensgaardPass::ID = 0;
+static RegisterPass<SteensgaardPass> S("steensgaard", "Print function call instruction, unification-based");
+
+/// Staged sparse flow-sensitive pass, same output as FuncPtrPass
+struct SparsePass : public ModulePass
+{
+    static char ID;
+    raw_ostream &out; // where results are printed
+
+    SparsePass(raw_ostream &out = errs()) : ModulePass(ID), out(out) {}
+
+    bool runOnModule(Module &M) override
+    {
+        SparseFlowSensitiveAnalysis analysis;
+        analysis.run(M);
+        analysis.printCallFuncResult(out);
+        if (PrintStats)
+        {
+            out << "memory defs: " << analysis.getNumMemDefs()
+                   << ", def-use edges: " << analysis.getNumDefUseEdges() << "\n";
+        }
+        return false;
+    }
+};
+
+char SparsePass::ID = 0;
+static RegisterPass<SparsePass> P("sparse", "Print function call instruction, sparse flow-sensitive");
+
+/// Signature-only pass, answers every indirect call in one linear pass
+struct TypesPass : public ModulePass
+{
+    static char ID;
+    raw_ostream &out; // where results are printed
+
+    TypesPass(raw_ostream &out = errs()) : ModulePass(ID), out(out) {}
+
+    bool runOnModule(Module &M) override
+    {
+        TypeSignatureAnalysis analysis;
+        analysis.run(M);
+        analysis.printCallFuncResult(out);
+        return false;
+    }
+};
+
+char TypesPass::ID = 0;
+static RegisterPass<TypesPass> T("types", "Print function call instruction, by function signature");
+
+/// Demand-driven pass, resolves only the calls on the lines given by -query
+struct QueryPass : public ModulePass
+{
+    static char ID;
+    raw_ostream &out; // where results are printed
+
+    QueryPass(raw_ostream &out = errs()) : ModulePass(ID), out(out) {}
+
+    bool runOnModule(Module &M) override
+    {
+        std::set<unsigned> lines(QueryLines.begin(), QueryLines.end());
+        DemandDrivenResolver resolver(QueryBudget);
+        resolver.build(M);
+        std::map<CallInst *, FunctionSet> call_func_result;
+        for (auto &F : M)
+        {
+            for (inst_iterator ii = inst_begin(&F), ie = inst_end(&F); ii != ie; ii++)
+            {
+                auto *callInst = dyn_cast<CallInst>(&*ii);
+                if (!callInst || isa<IntrinsicInst>(callInst) || !lines.count(callInst->getDebugLoc().getLine()))
+                {
+                    continue;
+                }
+                auto start = std::chrono::steady_clock::now();
+                bool complete;
+                call_func_result[callInst] = resolver.query(callInst, &complete);
+                if (PrintStats)
+                {
+                    out << "query " << callInst->getDebugLoc().getLine() << ": " << resolver.getLastSteps() << " steps, "
+                           << format("%.3f", std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count())
+                           << " ms" << (complete ? "" : ", fell back to whole program") << "\n";
+                }
+            }
+        }
+        printCallFuncResult(call_func_result, out);
+        return false;
+    }
+};
+
+char QueryPass::ID = 0;
+static RegisterPass<QueryPass> Q("query", "Print function call instruction, demand-driven for selected lines");
+
+/// Phase one of the summary analysis, writes the module's pointer summary to path
+struct SummaryPass : public ModulePass
+{
+    static char ID;
+    std::string path;
+    raw_ostream &out; // where errors and statistics are printed
+    bool failed;
+
+    SummaryPass(const std::string &path = "", raw_ostream &out = errs())
+        : ModulePass(ID), path(path), out(out), failed(false) {}
+
+    bool runOnModule(Module &M) override
+    {
+        ModuleSummary summary;
+        buildModuleSummary(M, &summary);
+        std::error_code EC;
+        raw_fd_ostream file(path, EC, sys::fs::F_None);
+        if (EC)
+        {
+            out << "cannot open " << path << ": " << EC.message() << "\n";
+            failed = true;
+            return false;
+        }
+        writeModuleSummary(summary, file);
+        if (PrintStats)
+        {
+            out << "summary: " << summary.num_nodes - 1 << " nodes, " << summary.constraints.size()
+                << " constraints, " << summary.calls.size() << " calls, " << file.tell() << " bytes\n";
+        }
+        return false;
+    }
+};
+
+char SummaryPass::ID = 0;
+static RegisterPass<SummaryPass> W("summary", "Write the pointer summary of a module");
+
 char Liveness::ID = 0;
 static RegisterPass<Liveness> Y("liveness", "Liveness Dataflow Analysis");
 
+enum AnalysisMode
+{
+    FlowSensitiveMode,
+    AndersenMode,
+    SteensgaardMode,
+    SparseMode,
+    TypesMode,
+    QueryMode // implied by -query
+};
+
+static cl::opt<AnalysisMode>
+    Mode("mode",
+         cl::desc("Pointer analysis used to resolve calls"),
+         cl::values(clEnumValN(FlowSensitiveMode, "flow", "flow-sensitive dataflow (default)"),
+                    clEnumValN(AndersenMode, "andersen", "flow-insensitive, inclusion-based"),
+                    clEnumValN(SteensgaardMode, "steensgaard", "flow-insensitive, unification-based, near-linear"),
+                    clEnumValN(SparseMode, "sparse", "flow-sensitive over def-use chains of an Andersen pre-analysis"),
+                    clEnumValN(TypesMode, "types", "address-taken functions of a compatible signature, linear")),
+         cl::init(FlowSensitiveMode));
+
+static cl::list<std::string>
+    InputFilenames(cl::Positional,
+                   cl::desc("<filename>.bc..."),
+                   cl::ZeroOrMore);
+
 static cl::opt<std::string>
-    InputFilename(cl::Positional,
-                  cl::desc("<filename>.bc"),
-                  cl::init(""));
+    BatchInput("batch",
+               cl::desc("Analyse every .bc in this directory, or listed one per line in this file"),
+               cl::value_desc("dir|list"),
+               cl::init(""));
 
-int main(int argc, char **argv)
+static cl::opt<std::string>
+    BatchOutput("batch-output",
+                cl::desc("Write each result of -batch to <dir>/<name>.txt instead of one combined stream"),
+                cl::value_desc("dir"),
+                cl::init(""));
+
+static cl::opt<unsigned>
+    BatchJobs("j",
+              cl::desc("Worker threads for -batch, 0 for one per core"),
+              cl::init(0));
+
+static cl::opt<bool>
+    Serve("serve",
+          cl::desc("Stay resident and answer queries, <file>:<line> or a function name, one per line; inputs that change are analysed again"),
+          cl::init(false));
+
+static cl::opt<std::string>
+    SocketPath("socket",
+               cl::desc("With -serve, take queries from the clients of this Unix domain socket instead of stdin"),
+               cl::value_desc("path"),
+               cl::init(""));
+
+static cl::opt<std::string>
+    SummaryDir("summary-dir",
+               cl::desc("Phase one: write the pointer summary of each input to <dir>/<name>.fps instead of resolving calls"),
+               cl::value_desc("dir"),
+               cl::init(""));
+
+static cl::opt<bool>
+    SummaryIndexInput("summary-index",
+                      cl::desc("Phase two: the inputs are .fps summaries, resolve the calls of all their modules together"),
+                      cl::init(false));
+
+static cl::opt<std::string>
+    SummaryResults("summary-results",
+                   cl::desc("With -summary-index, also write the calls of each module to <dir>/<name>.txt"),
+                   cl::value_desc("dir"),
+                   cl::init(""));
+
+/// Phase one: summarizes each file on its own into SummaryDir
+static bool summarizeFiles(const std::vector<std::string> &filenames, LLVMContext &Context, raw_ostream &out)
 {
-    LLVMContext &Context = getGlobalContext();
     SMDiagnostic Err;
-    // Parse the command line to read the Inputfilename
-    cl::ParseCommandLineOptions(argc, argv,
-                                "FuncPtrPass \n My first LLVM too which does not do much.\n");
+    bool ok = true;
+    for (const std::string &filename : filenames)
+    {
+        std::unique_ptr<Module> M = parseIRFile(filename, Err, Context);
+        if (!M)
+        {
+            Err.print(filename.c_str(), out);
+            ok = false;
+            continue;
+        }
+        SmallString<128> path(SummaryDir);
+        sys::path::append(path, sys::path::stem(filename) + ".fps");
+        llvm::legacy::PassManager Passes;
+#if LLVM_VERSION_MAJOR == 5
+        Passes.add(new EnableFunctionOptPass());
+#endif
+        Passes.add(llvm::createPromoteMemoryToRegisterPass());
+        SummaryPass *summary = new SummaryPass(path.str().str(), out);
+        Passes.add(summary);
+        Passes.run(*M);
+        ok &= !summary->failed;
+    }
+    return ok;
+}
 
-    // Load the input module
-    std::unique_ptr<Module> M = parseIRFile(InputFilename, Err, Context);
-    if (!M)
+///
+/// Phase two: reads the summaries of all modules of a program, solves them
+/// as one and prints the calls of every module, without any bitcode.
+///
+static bool solveSummaries(const std::vector<std::string> &filenames, raw_ostream &out)
+{
+    auto start = std::chrono::steady_clock::now();
+    SummaryIndex index;
+    for (const std::string &filename : filenames)
     {
-        Err.print(argv[0], errs());
-        return 1;
+        ErrorOr<std::unique_ptr<MemoryBuffer>> buffer = MemoryBuffer::getFile(filename);
+        if (!buffer)
+        {
+            out << filename << ": " << buffer.getError().message() << "\n";
+            return false;
+        }
+        ModuleSummary summary;
+        if (!readModuleSummary((*buffer)->getBuffer(), &summary))
+        {
+            out << filename << ": not a pointer summary, or written by another version\n";
+            return false;
+        }
+        index.addModule(summary);
+    }
+    index.solve();
+
+    bool ok = true;
+    for (unsigned m = 0, e = index.getNumModules(); m != e; m++)
+    {
+        if (e > 1)
+        {
+            out << "==> " << index.getModuleID(m) << " <==\n";
+        }
+        index.printCallFuncResult(m, out);
+        if (SummaryResults.empty())
+        {
+            continue;
+        }
+        // 把结果按模块写回
+        SmallString<128> path(SummaryResults);
+        sys::path::append(path, sys::path::stem(filenames[m]) + ".txt");
+        std::error_code EC;
+        raw_fd_ostream file(path, EC, sys::fs::F_Text);
+        if (EC)
+        {
+            out << "cannot open " << path << ": " << EC.message() << "\n";
+            ok = false;
+            continue;
+        }
+        index.printCallFuncResult(m, file);
+    }
+    if (PrintStats)
+    {
+        out << "index: " << index.getNumModules() << " modules, " << index.getNumSymbols() << " symbols, "
+            << index.getNumNodes() - 1 << " nodes, " << index.getNumConstraints() << " constraints, "
+            << index.getNumCalls() << " calls\n";
+        out << "analysis time: "
+            << format("%.3f", std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count())
+            << " ms\n";
+    }
+    return ok;
+}
+
+/// Loads filename into Context, runs the selected analysis and prints to out
+///
+/// Several files are analysed as one program without linking them: each
+/// is loaded lazily into Context, calls and references to external symbols
+/// are resolved through a ProgramSymbolTable, and only the function bodies
+/// the analysis reaches are ever read.
+///
+static bool analyzeFiles(const std::vector<std::string> &filenames, LLVMContext &Context, raw_ostream &out,
+                         CallSiteIndex *index = nullptr, std::string *cache_buffer = nullptr)
+{
+    if (SummaryIndexInput)
+    {
+        return solveSummaries(filenames, out);
+    }
+    if (!SummaryDir.empty())
+    {
+        return summarizeFiles(filenames, Context, out);
+    }
+    auto load_start = std::chrono::steady_clock::now();
+    SMDiagnostic Err;
+    bool whole_program = filenames.size() > 1;
+    if (whole_program && (Mode != FlowSensitiveMode || SliceFirst || !QueryLines.empty()))
+    {
+        out << "several input modules need the flow-sensitive mode, without -slice or -query\n";
+        return false;
+    }
+    if (Shards > 1 && (Mode != FlowSensitiveMode || whole_program || LazyLoad || ContextDepth || !QueryLines.empty()))
+    {
+        out << "-shards needs the flow-sensitive mode on one module, without -lazy, -context-k or -query\n";
+        return false;
+    }
+    // 缓存的访问要能原样重放: context按出现顺序编号, 时间预算每次不同
+    if (!CacheDir.empty() && (Mode != FlowSensitiveMode || whole_program || LazyLoad || SliceFirst || ContextDepth ||
+                              Shards > 1 || MaxFunctionSeconds || !QueryLines.empty()))
+    {
+        out << "-cache-dir needs the flow-sensitive mode on one module, without -lazy, -slice, -context-k, -shards, "
+               "-max-function-seconds or -query\n";
+        return false;
+    }
+    // 检查点按名字引用值, 名字只在一个模块里唯一
+    if (!CheckpointDir.empty() && (Mode != FlowSensitiveMode || whole_program || LazyLoad || Shards > 1 ||
+                                   !CacheDir.empty() || !QueryLines.empty()))
+    {
+        out << "-checkpoint-dir needs the flow-sensitive mode on one module, without -lazy, -shards, -cache-dir or -query\n";
+        return false;
+    }
+    // Load the input modules. Only the flow analysis can read function
+    // bodies on demand; every other mode needs the whole module.
+    bool lazy = whole_program || (LazyLoad && Mode == FlowSensitiveMode && !SliceFirst && QueryLines.empty());
+    std::vector<std::unique_ptr<Module>> modules;
+    for (const std::string &filename : filenames)
+    {
+        std::unique_ptr<Module> M = lazy || LazyLoad ? getLazyIRFileModule(filename, Err, Context)
+                                                     : parseIRFile(filename, Err, Context);
+        if (!M)
+        {
+            Err.print(filename.c_str(), out);
+            return false;
+        }
+        if (LazyLoad && !lazy)
+        {
+            if (Error err = M->materializeAll())
+            {
+                out << filename << ": " << toString(std::move(err)) << "\n";
+                return false;
+            }
+        }
+        modules.push_back(std::move(M));
+    }
+    std::unique_ptr<Module> &M = modules.front();
+    std::vector<Module *> others;
+    for (unsigned i = 1; i < modules.size(); i++)
+    {
+        others.push_back(modules[i].get());
+    }
+    if (PrintStats)
+    {
+        out << "load time: "
+            << format("%.3f", std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - load_start).count())
+            << " ms\n";
     }
 
     llvm::legacy::PassManager Passes;
+    if (!lazy)
+    {
 #if LLVM_VERSION_MAJOR == 5
-    Passes.add(new EnableFunctionOptPass());
+        Passes.add(new EnableFunctionOptPass());
 #endif
-    ///Transform it to SSA
-    Passes.add(llvm::createPromoteMemoryToRegisterPass());
+        ///Transform it to SSA
+        Passes.add(llvm::createPromoteMemoryToRegisterPass());
+    }
 
     /// Your pass to print Function and Call Instructions
     //Passes.add(new Liveness());
-    Passes.add(new FuncPtrPass());
+    FuncPtrPass *flow_pass = nullptr; // owned by Passes
+    switch (QueryLines.empty() ? Mode : QueryMode)
+    {
+    case QueryMode:
+        Passes.add(new QueryPass(out));
+        break;
+    case AndersenMode:
+        Passes.add(new AndersenPass(out));
+        break;
+    case SteensgaardMode:
+        Passes.add(new SteensgaardPass(out));
+        break;
+    case SparseMode:
+        Passes.add(new SparsePass(out));
+        break;
+    case TypesMode:
+        Passes.add(new TypesPass(out));
+        break;
+    default:
+    {
+        std::string cache_path;
+        if (!CacheDir.empty())
+        {
+            SmallString<128> path(CacheDir);
+            sys::path::append(path, sys::path::stem(filenames.front()) + ".fpc");
+            cache_path = path.str().str();
+        }
+        std::string checkpoint_path;
+        if (!CheckpointDir.empty())
+        {
+            SmallString<128> path(CheckpointDir);
+            sys::path::append(path, sys::path::stem(filenames.front()) + ".fpk");
+            checkpoint_path = path.str().str();
+        }
+        flow_pass = new FuncPtrPass(lazy, out, others, cache_path, checkpoint_path);
+        flow_pass->index = index;
+        flow_pass->cache_buffer = cache_buffer;
+        Passes.add(flow_pass);
+        break;
+    }
+    }
+    auto start = std::chrono::steady_clock::now();
     Passes.run(*M.get());
+    if (flow_pass && flow_pass->failed)
+    {
+        return false;
+    }
+    if (PrintStats)
+    {
+        out << "analysis time: "
+            << format("%.3f", std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count())
+            << " ms\n";
+        out << "peak RSS: " << getPeakRSS() << " KB\n";
+    }
+    return true;
+}
+
+/// The inputs of -batch: the .bc files of a directory, or the lines of a list file
+static bool getBatchFiles(std::vector<std::string> *files)
+{
+    if (sys::fs::is_directory(BatchInput))
+    {
+        std::error_code EC;
+        for (sys::fs::directory_iterator di(BatchInput, EC), de; di != de && !EC; di.increment(EC))
+        {
+            if (sys::path::extension(di->path()) == ".bc")
+            {
+                files->push_back(di->path());
+            }
+        }
+        std::sort(files->begin(), files->end());
+        return !EC;
+    }
+    ErrorOr<std::unique_ptr<MemoryBuffer>> buffer = MemoryBuffer::getFile(BatchInput);
+    if (!buffer)
+    {
+        return false;
+    }
+    SmallVector<StringRef, 64> lines;
+    (*buffer)->getBuffer().split(lines, '\n', -1, false);
+    for (StringRef line : lines)
+    {
+        line = line.trim();
+        if (!line.empty())
+        {
+            files->push_back(line.str());
+        }
+    }
+    return true;
+}
+
+///
+/// Analyses many modules in one process. Worker threads take the next file
+/// from a shared index, each into an LLVMContext of its own that lives as
+/// long as the file's module, so no LLVM state is shared between threads.
+/// Results go to one file per input, or are appended whole to a combined
+/// stream in input order.
+///
+static int runBatch()
+{
+    std::vector<std::string> files;
+    if (!getBatchFiles(&files))
+    {
+        errs() << "cannot read batch input " << BatchInput << "\n";
+        return 1;
+    }
+    unsigned jobs = BatchJobs ? BatchJobs : std::max(1u, std::thread::hardware_concurrency());
+    std::vector<std::string> results(files.size());
+    std::vector<bool> done(files.size(), false);
+    std::atomic<unsigned> next(0), failed(0);
+    std::mutex output_mutex;
+    unsigned printed = 0; // results[0, printed) are written to the combined stream
+
+    auto start = std::chrono::steady_clock::now();
+    auto worker = [&]() {
+        for (unsigned i = next++; i < files.size(); i = next++)
+        {
+            std::string result;
+            raw_string_ostream out(result);
+            {
+                LLVMContext Context;
+                if (!analyzeFiles(std::vector<std::string>(1, files[i]), Context, out))
+                {
+                    failed++;
+                }
+            }
+            out.flush();
+            if (!BatchOutput.empty())
+            {
+                SmallString<128> path(BatchOutput);
+                sys::path::append(path, sys::path::stem(files[i]) + ".txt");
+                std::error_code EC;
+                raw_fd_ostream file(path, EC, sys::fs::F_Text);
+                if (EC)
+                {
+                    std::lock_guard<std::mutex> lock(output_mutex);
+                    errs() << "cannot open " << path << ": " << EC.message() << "\n";
+                    failed++;
+                    continue;
+                }
+                file << result;
+                continue;
+            }
+            // 合并输出时按输入顺序写, 每个文件的结果完整连续
+            std::lock_guard<std::mutex> lock(output_mutex);
+            results[i].swap(result);
+            done[i] = true;
+            for (; printed < files.size() && done[printed]; printed++)
+            {
+                errs() << "==> " << files[printed] << " <==\n"
+                       << results[printed];
+                std::string().swap(results[printed]);
+            }
+        }
+    };
+    std::vector<std::thread> threads;
+    for (unsigned t = 1; t < jobs; t++)
+    {
+        threads.emplace_back(worker);
+    }
+    worker();
+    for (std::thread &thread : threads)
+    {
+        thread.join();
+    }
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    errs() << "batch: " << files.size() << " files (" << failed << " failed) in " << format("%.3f", seconds)
+           << " s with " << jobs << " threads, " << format("%.1f", files.size() / seconds) << " files/s\n";
+    return failed ? 1 : 0;
+}
+
+/// Modification time and size of each input, to notice a rebuild
+static std::vector<std::pair<uint64_t, uint64_t>> getInputStamps()
+{
+    std::vector<std::pair<uint64_t, uint64_t>> stamps;
+    for (const std::string &filename : InputFilenames)
+    {
+        sys::fs::file_status status;
+        if (sys::fs::status(filename, status))
+        {
+            stamps.push_back(std::make_pair(0, 0));
+            continue;
+        }
+        stamps.push_back(std::make_pair(status.getLastModificationTime().time_since_epoch().count(), status.getSize()));
+    }
+    return stamps;
+}
+
+///
+/// Analyses the inputs once and answers queries about the result, from
+/// stdin until it is closed or from the clients of -socket. Before each
+/// query the inputs are checked, and analysed again if one changed; if
+/// that fails, the previous result is kept. Where -cache-dir would apply,
+/// the visits of the last analysis are kept in memory and replayed, so
+/// only what the change affects is analysed again. The modules are not
+/// kept: the index holds all that queries need.
+///
+static int runDaemon()
+{
+    if (Mode != FlowSensitiveMode || !QueryLines.empty() || !CheckpointDir.empty())
+    {
+        errs() << "-serve needs the flow-sensitive mode, without -query or -checkpoint-dir\n";
+        return 1;
+    }
+    bool replay = CacheDir.empty() && InputFilenames.size() == 1 && !LazyLoad && !SliceFirst && !ContextDepth &&
+                  Shards <= 1 && !MaxFunctionSeconds;
+    CallSiteIndex index;
+    std::string cache_buffer;
+    std::vector<std::pair<uint64_t, uint64_t>> stamps = getInputStamps();
+    auto analyze = [&]() {
+        auto start = std::chrono::steady_clock::now();
+        std::string result;
+        raw_string_ostream out(result);
+        bool ok;
+        {
+            LLVMContext Context;
+            ok = analyzeFiles(InputFilenames, Context, out, &index, replay ? &cache_buffer : nullptr);
+        }
+        out.flush();
+        if (!ok)
+        {
+            errs() << result << "serve: analysis failed, keeping the previous result\n";
+            return;
+        }
+        errs() << "serve: " << index.size() << " call sites, analysed in "
+               << format("%.3f", std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count())
+               << " ms\n";
+    };
+    analyze();
+
+    QueryServer server([&](StringRef query, raw_ostream &reply) {
+        auto start = std::chrono::steady_clock::now();
+        std::vector<std::pair<uint64_t, uint64_t>> current = getInputStamps();
+        if (current != stamps)
+        {
+            // 输入重新编译过了
+            stamps = current;
+            analyze();
+        }
+        index.answer(query, reply);
+        if (PrintStats)
+        {
+            errs() << "query " << query << ": "
+                   << format("%.3f", std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count())
+                   << " ms\n";
+        }
+    });
+    if (SocketPath.empty())
+    {
+        return server.serveStream(0, 1) ? 0 : 1;
+    }
+    std::string error;
+    if (!server.serveSocket(SocketPath, &error))
+    {
+        errs() << "cannot serve on " << SocketPath << ": " << error << "\n";
+        return 1;
+    }
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    ToolStart = std::chrono::steady_clock::now();
+    // Parse the command line to read the Inputfilename
+    cl::ParseCommandLineOptions(argc, argv,
+                                "FuncPtrPass \n My first LLVM too which does not do much.\n");
+
+    if (!BatchInput.empty())
+    {
+        if (Shards > 1)
+        {
+            // fork只复制调用它的线程
+            errs() << "-shards cannot be combined with -batch, whose threads must not fork\n";
+            return 1;
+        }
+        return runBatch();
+    }
+
+    LLVMContext &Context = getGlobalContext();
+    if (InputFilenames.empty())
+    {
+        errs() << argv[0] << ": no input file\n";
+        return 1;
+    }
+    if (Serve)
+    {
+        return runDaemon();
+    }
+    if (!analyzeFiles(InputFilenames, Context, errs()))
+    {
+        return 1;
+    }
 #ifndef NDEBUG
     system("pause");
 #endif
@@ -12,13 +12,26 @@
 //
 //===----------------------------------------------------------------------===//
 
+#ifndef _LIVENESS_H_
+#define _LIVENESS_H_
+
+#include <llvm/Config/llvm-config.h>
 #include <llvm/IR/Function.h>
 #include <llvm/Pass.h>
+#include <llvm/IR/LegacyPassManager.h>
 #include "llvm/Support/raw_ostream.h"
+#include <llvm/Support/Error.h>
 #include "llvm/IR/IntrinsicInst.h"
 #include <llvm/IR/InstIterator.h>
 #include "Dataflow.h"
+#include "ModRef.h"
+#include "Context.h"
+#include "TypeIndex.h"
+#include "FastPath.h"
+#include "Slice.h"
+#include "SymbolTable.h"
 
+#include <algorithm>
 #include <vector>
 #include <map>
 #include <set>
@@ -27,8 +40,11 @@ using namespace llvm;
 using FunctionSet = std::set<Function *>;
 using ValueSet = std::set<Value *>;
 using LiveVarsToMap = std::map<Value *, ValueSet>;
+using FunctionContext = std::pair<Function *, unsigned>; // function analysed under a calling context
+using FunctionContextSet = std::set<FunctionContext>;
+using CallSite = std::pair<CallInst *, unsigned>;         // call instruction in the caller's context
 
-bool debug = false; //flag for debug
+static bool debug = false; //flag for debug
 
 struct LivenessInfo
 {
@@ -65,137 +81,1064 @@ inline raw_ostream &operator<<(raw_ostream &out, const LiveVarsToMap &v)
         out << i->first->getName() << " " << i->first << " -> ";
         for (auto ii = i->second.begin(), ie = i->second.end(); ii != ie; ++ii)
         {
-            if (ii != i->second.begin())
+            if (ii != i->second.begin())
+            {
+                errs() << ", ";
+            }
+            out << (*ii)->getName() << " " << (*ii);
+        }
+        out << " ; ";
+    }
+    out << "}";
+    return out;
+}
+
+///
+/// Writes the names of callees separated by commas, in definition order
+/// and those of different modules by module name, so the output does not
+/// depend on addresses. order caches the positions of the functions of
+/// the modules seen so far.
+///
+inline void printCallees(const FunctionSet &callee_set, std::map<const Function *, std::pair<std::string, unsigned>> *order,
+                         raw_ostream &out)
+{
+    std::vector<Function *> callees(callee_set.begin(), callee_set.end());
+    for (Function *callee : callees)
+    {
+        if (order->count(callee))
+        {
+            continue;
+        }
+        Module *M = callee->getParent();
+        unsigned position = 0;
+        for (auto &F : *M)
+        {
+            (*order)[&F] = std::make_pair(M->getModuleIdentifier(), position++);
+        }
+    }
+    std::sort(callees.begin(), callees.end(), [order](Function *a, Function *b) { return (*order)[a] < (*order)[b]; });
+    for (auto fi = callees.begin(), fe = callees.end(); fi != fe; fi++)
+    {
+        if (fi != callees.begin())
+        {
+            out << ", ";
+        }
+        out << (*fi)->getName();
+    }
+}
+
+///
+/// Print the callees of every call instruction, ordered by source line.
+/// This is the output format of every analysis mode.
+///
+inline void printCallFuncResult(const std::map<CallInst *, FunctionSet> &call_func_result, raw_ostream &out = errs())
+{
+    // 按行号排序输出, 行号相同时保持call_func_result中的顺序
+    std::vector<std::pair<unsigned, const FunctionSet *>> lines;
+    for (auto ii = call_func_result.begin(), ie = call_func_result.end(); ii != ie; ii++)
+    {
+        lines.push_back(std::make_pair(ii->first->getDebugLoc().getLine(), &ii->second));
+    }
+    std::stable_sort(lines.begin(), lines.end(),
+                     [](const std::pair<unsigned, const FunctionSet *> &a, const std::pair<unsigned, const FunctionSet *> &b) {
+                         return a.first < b.first;
+                     });
+    // 被调函数按定义顺序输出(不同模块的按模块名), 不依赖指针地址
+    std::map<const Function *, std::pair<std::string, unsigned>> order;
+    for (auto li = lines.begin(), le = lines.end(); li != le; li++)
+    {
+        out << li->first << " : ";
+        printCallees(*li->second, &order, out);
+        out << "\n";
+    }
+}
+
+///
+/// Whether F's address may reach code outside the module, which may then
+/// call F at any time: passed to a declaration or through an unresolved
+/// call, stored into memory such code can read, or returned from a
+/// function it can call. The walk follows the address through casts,
+/// copies, the memory it is stored into and the formals and actuals it is
+/// bound to, without points-to information, so it may say yes too often
+/// but does not miss such a callback in the code read so far. If the
+/// answer is no, watched gets the values whose new uses could change it.
+///
+inline bool addressMayEscape(Function *F, std::set<Value *> *watched = nullptr)
+{
+    std::set<Value *> visited;
+    visited.insert(F);
+    std::vector<Value *> worklist(1, F);
+    auto follow = [&](Value *v) {
+        if (visited.insert(v).second)
+        {
+            worklist.push_back(v);
+        }
+    };
+    std::set<Value *> callers; // functions whose calls bind a formal the walk stores into
+    while (!worklist.empty())
+    {
+        Value *v = worklist.back();
+        worklist.pop_back();
+        if (auto *global = dyn_cast<GlobalVariable>(v))
+        {
+            if (!global->hasLocalLinkage())
+            {
+                return true;
+            }
+        }
+        for (User *user : v->users())
+        {
+            if (auto *callInst = dyn_cast<CallInst>(user))
+            {
+                Function *callee = dyn_cast<Function>(callInst->getCalledValue()->stripPointerCasts());
+                for (unsigned i = 0, e = callInst->getNumArgOperands(); i != e; i++)
+                {
+                    if (callInst->getArgOperand(i) != v)
+                    {
+                        continue;
+                    }
+                    // 外部函数或者不知道调用谁, 地址就交出去了
+                    if (!callee || callee->isDeclaration() || i >= callee->arg_size())
+                    {
+                        if (!callee || !callee->isIntrinsic())
+                        {
+                            return true;
+                        }
+                        continue;
+                    }
+                    follow(&*std::next(callee->arg_begin(), i));
+                }
+                follow(callInst);
+            }
+            else if (auto *storeInst = dyn_cast<StoreInst>(user))
+            {
+                // 存进去的内存和指向它的指针一样能被外面看到
+                if (storeInst->getValueOperand() != v)
+                {
+                    continue;
+                }
+                Value *object = storeInst->getPointerOperand()->stripInBoundsOffsets();
+                follow(object);
+                if (auto *arg = dyn_cast<Argument>(object))
+                {
+                    // 存进形参指向的内存, 调用者传进来的对象也就含有这个地址
+                    Function *fn = arg->getParent();
+                    if (!fn->hasLocalLinkage() || fn->hasAddressTaken())
+                    {
+                        return true;
+                    }
+                    callers.insert(fn);
+                    for (User *caller : fn->users())
+                    {
+                        auto *call = dyn_cast<CallInst>(caller);
+                        if (call && call->getCalledValue() == fn && arg->getArgNo() < call->getNumArgOperands())
+                        {
+                            follow(call->getArgOperand(arg->getArgNo()));
+                        }
+                    }
+                }
+            }
+            else if (auto *returnInst = dyn_cast<ReturnInst>(user))
+            {
+                Function *fn = returnInst->getFunction();
+                if (!fn->hasLocalLinkage() || fn->hasAddressTaken())
+                {
+                    return true;
+                }
+                follow(fn);
+            }
+            else if (isa<GlobalVariable>(user) || isa<Constant>(user) || isa<LoadInst>(user) || isa<CastInst>(user) ||
+                     isa<GetElementPtrInst>(user) || isa<PHINode>(user) || isa<SelectInst>(user) ||
+                     isa<InsertValueInst>(user) || isa<ExtractValueInst>(user))
+            {
+                follow(user);
+            }
+        }
+    }
+    if (watched)
+    {
+        watched->swap(visited);
+        watched->insert(callers.begin(), callers.end());
+    }
+    return false;
+}
+
+///
+/// Functions that are not entry points but may turn into callbacks as
+/// bodies are read lazily: the code handing their address to external
+/// code may not have been read when the entry points were chosen. Each
+/// function is watched through the values its escape walk went through,
+/// and checked again when a body read later uses one of them or has a
+/// formal the walk reached.
+///
+class LateCallbacks
+{
+public:
+    LateCallbacks() : watchers(), found(), escaped() {}
+
+    /// Watches F, or takes it as escaped right away
+    void watch(Function *F)
+    {
+        std::set<Value *> watched;
+        if (F->hasAddressTaken() && addressMayEscape(F, &watched))
+        {
+            found.insert(F);
+            escaped.push_back(F);
+            return;
+        }
+        watched.insert(F);
+        for (Value *v : watched)
+        {
+            watchers[v].insert(F);
+        }
+    }
+
+    /// Checks again the functions whose walk reaches into fn, whose body was just read
+    void bodyRead(Function *fn)
+    {
+        std::set<Value *> touched;
+        for (Argument &arg : fn->args())
+        {
+            touched.insert(&arg);
+        }
+        std::vector<Constant *> constants;
+        for (inst_iterator ii = inst_begin(fn), ie = inst_end(fn); ii != ie; ii++)
+        {
+            for (Value *op : ii->operands())
+            {
+                if (isa<Constant>(op) && !isa<ConstantData>(op) && touched.insert(op).second)
+                {
+                    constants.push_back(cast<Constant>(op));
+                }
+            }
+        }
+        // 常量表达式里面的函数和全局变量也算用到了
+        while (!constants.empty())
+        {
+            Constant *c = constants.back();
+            constants.pop_back();
+            if (isa<GlobalValue>(c))
+            {
+                continue;
+            }
+            for (Value *op : c->operands())
+            {
+                if (isa<Constant>(op) && !isa<ConstantData>(op) && touched.insert(op).second)
+                {
+                    constants.push_back(cast<Constant>(op));
+                }
+            }
+        }
+        std::set<Function *> recheck;
+        for (Value *v : touched)
+        {
+            auto wi = watchers.find(v);
+            if (wi != watchers.end())
+            {
+                recheck.insert(wi->second.begin(), wi->second.end());
+            }
+        }
+        for (Function *F : recheck)
+        {
+            if (!found.count(F))
+            {
+                watch(F);
+            }
+        }
+    }
+
+    /// The functions found to escape since the last call, in the order found
+    std::vector<Function *> takeEscaped()
+    {
+        std::vector<Function *> result;
+        result.swap(escaped);
+        return result;
+    }
+
+private:
+    std::map<Value *, std::set<Function *>> watchers;
+    std::set<Function *> found;      // escaped, no longer watched
+    std::vector<Function *> escaped; // not taken yet
+};
+
+///
+/// Resolves the functions a called value may transitively point to. The
+/// walk keeps a visited set, so cyclic points-to chains are expanded once,
+/// and never inserts into the state it reads. The closure of each (call
+/// site, value) is memoized together with the state entries the walk
+/// read; it is reused while those entries are unchanged and walked again
+/// as soon as one of them changes, so revisits of a call whose called
+/// value is bound as before cost a comparison of that part of the state.
+///
+class CallTargetResolver
+{
+public:
+    CallTargetResolver() : closures(), hits(0), misses(0) {}
+
+    FunctionSet resolve(const CallSite &site, const LiveVarsToMap &vars, Value *value)
+    {
+        Closure &closure = closures[std::make_pair(site, value)];
+        if (closure.walked && isUnchanged(closure, vars))
+        {
+            hits++;
+            return closure.callees;
+        }
+        misses++;
+        closure.walked = true;
+        closure.callees.clear();
+        closure.read.clear();
+
+        ValueSet visited;
+        std::vector<Value *> value_worklist(1, value);
+        while (!value_worklist.empty())
+        {
+            Value *v = value_worklist.back();
+            value_worklist.pop_back();
+            if (!visited.insert(v).second)
+            {
+                continue;
+            }
+            if (v != value && isa<Function>(v))
+            {
+                closure.callees.insert(cast<Function>(v));
+                continue;
+            }
+            auto vi = vars.find(v);
+            closure.read.push_back(std::make_pair(v, vi != vars.end() ? vi->second : ValueSet()));
+            if (vi != vars.end())
+            {
+                value_worklist.insert(value_worklist.end(), vi->second.begin(), vi->second.end());
+            }
+        }
+        return closure.callees;
+    }
+
+    /// Resolutions answered from the memo, and walked because none was valid
+    unsigned getNumHits() const { return hits; }
+    unsigned getNumMisses() const { return misses; }
+
+private:
+    struct Closure
+    {
+        bool walked;
+        FunctionSet callees;
+        std::vector<std::pair<Value *, ValueSet>> read; // entries the walk read, absent ones as empty
+        Closure() : walked(false), callees(), read() {}
+    };
+
+    std::map<std::pair<CallSite, Value *>, Closure> closures;
+    unsigned hits, misses;
+
+    static bool isUnchanged(const Closure &closure, const LiveVarsToMap &vars)
+    {
+        for (auto &entry : closure.read)
+        {
+            auto vi = vars.find(entry.first);
+            if (vi == vars.end() ? !entry.second.empty() : vi->second != entry.second)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+};
+
+///
+/// Where the states of functions owned by another process go. For a
+/// callee or caller that is not local, the visitor hands the state it
+/// would have merged to the exchange instead, already mapped to the other
+/// side of the call.
+///
+class StateExchange
+{
+public:
+    virtual ~StateExchange() {}
+    virtual bool isLocal(Function *fn) = 0;
+    /// Entry state of callee from site, null if it passes no pointer
+    virtual void sendEntry(const FunctionContext &callee, const CallSite &site, const LivenessInfo *state) = 0;
+    /// State after site as callee returns it
+    virtual void sendExit(const FunctionContext &callee, const CallSite &site, const LivenessInfo &state) = 0;
+};
+
+///
+/// Sees what a visit hands to other functions, before it is merged, and
+/// which top-level facts of other functions it reads, so that the visit
+/// can be replayed later without analysing the function again, see
+/// VisitCache.
+///
+class VisitObserver
+{
+public:
+    virtual ~VisitObserver() {}
+    /// callee was handed its entry state from site (null if no pointer is passed)
+    virtual void deliverEntry(const FunctionContext &callee, const CallSite &site, const LivenessInfo *state) = 0;
+    /// The caller at site was handed the state callee returns there
+    virtual void deliverExit(const FunctionContext &callee, const CallSite &site, const LivenessInfo &state) = 0;
+    /// A visit of fn looked up the table entry of v, null if v had none
+    virtual void readTopLevel(Function *fn, Value *v, const ValueSet *facts) = 0;
+};
+
+///
+/// What the visitor keeps about one function in one context: the dataflow
+/// values of its instructions in layout order, the table entries of its
+/// top-level pointers, the call sites it returns to and the callees found
+/// at its calls.
+///
+struct FunctionState
+{
+    std::vector<std::pair<LivenessInfo, LivenessInfo>> points;
+    LiveVarsToMap top_level;
+    std::set<CallSite> return_sites;
+    std::map<CallInst *, FunctionSet> callees;
+    FunctionState() : points(), top_level(), return_sites(), callees() {}
+};
+
+class LivenessVisitor : public DataflowVisitor<struct LivenessInfo>
+{
+public:
+    std::map<CallInst *, FunctionSet> call_func_result;
+    FunctionContextSet fn_worklist;
+    const ModRefSummary *modref; // callees that write no pointer are passed straight through
+    SyntacticCallResolver *fast_path;       // call sites whose callees are known without memory
+    std::map<Module *, legacy::FunctionPassManager *> function_passes; // per module, run on each function right after it is read
+    const RelevanceSlice *slice;             // if set, instructions outside it pass their state through
+    const ProgramSymbolTable *symbols;       // if set, external declarations stand for definitions in other modules
+    StateExchange *exchange;                 // if set, functions it does not own are analysed elsewhere
+    VisitObserver *observer;                 // if set, told what each visit hands to other functions
+    LateCallbacks *late_callbacks;           // if set, told of each body read, the callbacks it reveals are queued
+    CallTargetResolver resolver;
+    CallStringTable contexts;
+    unsigned clone_max_insts; // wrappers up to this size are analysed per context
+    unsigned current_ctx;     // context of the function being analysed
+    LivenessVisitor() : call_func_result(), fn_worklist(), modref(nullptr), fast_path(nullptr), function_passes(), slice(nullptr), symbols(nullptr), exchange(nullptr), observer(nullptr), late_callbacks(nullptr), resolver(), contexts(), clone_max_insts(0),
+                        current_ctx(CallStringTable::EmptyContext), ctx_results(), ctx_top_level(), pointer_reps(), top_level_cache(), call_blocks(), dirty_blocks(),
+                        ctx_call_result(), return_sites(), clone_cache() {}
+
+    /// Reads the body of fn if the module was loaded lazily, false on failure
+    bool materialize(Function *fn)
+    {
+        if (!fn->isMaterializable())
+        {
+            return true;
+        }
+        if (Error err = fn->materialize())
+        {
+            errs() << "cannot read " << fn->getName() << ": " << toString(std::move(err)) << "\n";
+            return false;
+        }
+        auto pi = function_passes.find(fn->getParent());
+        if (pi != function_passes.end())
+        {
+#if LLVM_VERSION_MAJOR == 5
+            // clang -O0加的optnone会让mem2reg跳过这个函数
+            fn->removeFnAttr(Attribute::OptimizeNone);
+#endif
+            pi->second->run(*fn);
+        }
+        if (fast_path)
+        {
+            fast_path->runOnFunction(*fn);
+        }
+        if (late_callbacks)
+        {
+            // 新读入的代码可能把函数地址交给外部代码, 这个函数从此也是入口
+            late_callbacks->bodyRead(fn);
+            for (Function *F : late_callbacks->takeEscaped())
+            {
+                if (materialize(F))
+                {
+                    fn_worklist.insert(std::make_pair(F, CallStringTable::EmptyContext));
+                }
+            }
+        }
+        return true;
+    }
+
+    /// Records the direct calls of a function that is reached but not analysed
+    void recordDirectCalls(Function *fn)
+    {
+        for (inst_iterator ii = inst_begin(fn), ie = inst_end(fn); ii != ie; ii++)
+        {
+            auto *callInst = dyn_cast<CallInst>(&*ii);
+            if (!callInst || isa<IntrinsicInst>(callInst))
+            {
+                continue;
+            }
+            if (auto *func = dyn_cast<Function>(callInst->getCalledValue()->stripPointerCasts()))
+            {
+                call_func_result[callInst].insert(func);
+            }
+        }
+    }
+
+    size_t stateSize(const LivenessInfo &dfval) override
+    {
+        size_t size = 0;
+        for (auto ii = dfval.LiveVars_map.begin(), ie = dfval.LiveVars_map.end(); ii != ie; ii++)
+        {
+            size += ii->second.size() + 1;
+        }
+        for (auto ii = dfval.LiveVars_feild_map.begin(), ie = dfval.LiveVars_feild_map.end(); ii != ie; ii++)
+        {
+            size += ii->second.size() + 1;
+        }
+        return size;
+    }
+
+    /// Merges an entry state another process sent for callee, see StateExchange
+    void receiveEntry(const FunctionContext &callee, const CallSite &site, const LivenessInfo *state)
+    {
+        if (return_sites[callee].insert(site).second)
+        {
+            fn_worklist.insert(callee);
+        }
+        if (!state)
+        {
+            return;
+        }
+        LivenessInfo &callee_dfval_in = getResult(callee.second)[&*inst_begin(callee.first)].first;
+        LivenessInfo old_callee_dfval_in = callee_dfval_in;
+        merge(&callee_dfval_in, *state);
+        if (old_callee_dfval_in != callee_dfval_in)
+        {
+            fn_worklist.insert(callee);
+        }
+    }
+
+    /// Merges the state after site that another process's callee returned
+    void receiveExit(const CallSite &site, const LivenessInfo &state)
+    {
+        LivenessInfo &caller_dfval_out = getResult(site.second)[site.first].second;
+        LivenessInfo old_caller_dfval_out = caller_dfval_out;
+        merge(&caller_dfval_out, state);
+        if (caller_dfval_out != old_caller_dfval_out)
+        {
+            fn_worklist.insert(std::make_pair(site.first->getFunction(), site.second));
+        }
+    }
+
+    /// Dataflow result of all functions analysed under context ctx
+    DataflowResult<LivenessInfo>::Type &getResult(unsigned ctx)
+    {
+        return ctx_results[ctx];
+    }
+
+    /// Table entry of the top-level pointer v in context ctx, null if it has none
+    const ValueSet *getTopLevel(unsigned ctx, Value *v) const
+    {
+        auto ti = ctx_top_level.find(ctx);
+        if (ti == ctx_top_level.end())
+        {
+            return nullptr;
+        }
+        auto it = ti->second.find(v);
+        return it == ti->second.end() ? nullptr : &it->second;
+    }
+
+    ///
+    /// Offline pointer equivalence: a pointer bitcast stands for its operand
+    /// and a phi with a single incoming value (ignoring itself) for that
+    /// value, so each class of equivalent values has one key in the state.
+    ///
+    Value *getPointerRep(Value *v)
+    {
+        auto it = pointer_reps.find(v);
+        if (it != pointer_reps.end())
+        {
+            return it->second;
+        }
+        // 先占位, 防止PHI环上的无限递归
+        pointer_reps[v] = v;
+        Value *rep = v;
+        if (auto *bitCast = dyn_cast<BitCastOperator>(v))
+        {
+            if (bitCast->getType()->isPointerTy() && bitCast->getOperand(0)->getType()->isPointerTy())
+                rep = getPointerRep(bitCast->getOperand(0));
+        }
+        else if (auto *global = dyn_cast<GlobalValue>(v))
+        {
+            // 其他模块中的定义
+            if (symbols)
+                rep = symbols->resolve(global);
+        }
+        else if (auto *phiNode = dyn_cast<PHINode>(v))
+        {
+            Value *single = nullptr;
+            for (Value *value : phiNode->incoming_values())
+            {
+                if (value == phiNode || value == single)
+                    continue;
+                if (single)
+                {
+                    single = nullptr;
+                    break;
+                }
+                single = value;
+            }
+            if (single)
+                rep = getPointerRep(single);
+        }
+        pointer_reps[v] = rep;
+        return rep;
+    }
+
+    /// The type of v if it is a struct or array alloca or global, whose
+    /// contents the state keeps as fields, else null
+    Type *getAggregateType(Value *v)
+    {
+        Type *type = nullptr;
+        if (auto *allocaInst = dyn_cast<AllocaInst>(v))
+            type = allocaInst->getAllocatedType();
+        else if (auto *global = dyn_cast<GlobalVariable>(v))
+            type = global->getValueType();
+        return type && type->isAggregateType() ? type : nullptr;
+    }
+
+    ///
+    /// The object whose field a load or store of type accessed reaches
+    /// through pointer (a representative), or null if it reaches the slot
+    /// pointer itself: the base of a GEP, or a struct or array alloca or
+    /// global whose cast stands for its first field, as in
+    /// *(int (**)(int, int))&s.
+    ///
+    Value *getFieldBase(Value *pointer, Type *accessed)
+    {
+        if (auto *getElementPtrInst = dyn_cast<GetElementPtrInst>(pointer))
+        {
+            return getPointerRep(getElementPtrInst->getPointerOperand());
+        }
+        Type *type = getAggregateType(pointer);
+        // 不经过转换时访问的就是对象本身的类型
+        while (type && type != accessed)
+        {
+            if (auto *structType = dyn_cast<StructType>(type))
+                type = structType->getNumElements() ? structType->getElementType(0) : nullptr;
+            else if (auto *arrayType = dyn_cast<ArrayType>(type))
+                type = arrayType->getElementType();
+            else
+                type = nullptr;
+            if (type == accessed)
+                return pointer;
+        }
+        return nullptr;
+    }
+
+    /// What the visitor keeps between visits, besides call_func_result,
+    /// contexts and caches of the IR: dataflow values and top-level tables
+    /// per context, the callees of each call site per context and where
+    /// each function returns to
+    const std::map<unsigned, DataflowResult<LivenessInfo>::Type> &getResults() const { return ctx_results; }
+    const std::map<unsigned, LiveVarsToMap> &getTopLevelTables() const { return ctx_top_level; }
+    const std::map<CallSite, FunctionSet> &getContextCallees() const { return ctx_call_result; }
+    const std::map<FunctionContext, std::set<CallSite>> &getReturnSites() const { return return_sites; }
+
+    /// Exchanges those tables with the given ones, to resume a checkpoint
+    void swapTables(std::map<unsigned, DataflowResult<LivenessInfo>::Type> *results, std::map<unsigned, LiveVarsToMap> *top_level,
+                    std::map<CallSite, FunctionSet> *callees, std::map<FunctionContext, std::set<CallSite>> *sites)
+    {
+        ctx_results.swap(*results);
+        ctx_top_level.swap(*top_level);
+        ctx_call_result.swap(*callees);
+        return_sites.swap(*sites);
+    }
+
+    /// Copies out everything kept about fc itself, see FunctionState,
+    /// leaving out the dataflow values unless with_points is set
+    void saveFunctionState(const FunctionContext &fc, FunctionState *state, bool with_points = true)
+    {
+        DataflowResult<LivenessInfo>::Type &result = getResult(fc.second);
+        const LiveVarsToMap &table = ctx_top_level[fc.second];
+        for (auto ai = fc.first->arg_begin(), ae = fc.first->arg_end(); ai != ae; ai++)
+        {
+            auto it = table.find(&*ai);
+            if (it != table.end())
+            {
+                state->top_level.insert(*it);
+            }
+        }
+        for (inst_iterator ii = inst_begin(fc.first), ie = inst_end(fc.first); ii != ie; ii++)
+        {
+            Instruction *inst = &*ii;
+            if (with_points)
+            {
+                state->points.push_back(result[inst]);
+            }
+            auto it = table.find(inst);
+            if (it != table.end())
+            {
+                state->top_level.insert(*it);
+            }
+            auto *callInst = dyn_cast<CallInst>(inst);
+            auto ci = callInst ? ctx_call_result.find(std::make_pair(callInst, fc.second)) : ctx_call_result.end();
+            if (ci != ctx_call_result.end())
+            {
+                state->callees.insert(std::make_pair(callInst, ci->second));
+            }
+        }
+        auto ri = return_sites.find(fc);
+        if (ri != return_sites.end())
+        {
+            state->return_sites = ri->second;
+        }
+    }
+
+    /// Puts back what saveFunctionState copied out, replacing what is kept
+    /// now. The dataflow values are left alone if state has none.
+    void restoreFunctionState(const FunctionContext &fc, const FunctionState &state)
+    {
+        DataflowResult<LivenessInfo>::Type &result = getResult(fc.second);
+        LiveVarsToMap &table = ctx_top_level[fc.second];
+        for (auto ai = fc.first->arg_begin(), ae = fc.first->arg_end(); ai != ae; ai++)
+        {
+            table.erase(&*ai);
+        }
+        unsigned index = 0;
+        for (inst_iterator ii = inst_begin(fc.first), ie = inst_end(fc.first); ii != ie; ii++, index++)
+        {
+            Instruction *inst = &*ii;
+            if (!state.points.empty())
+            {
+                result[inst] = state.points[index];
+            }
+            table.erase(inst);
+            auto *callInst = dyn_cast<CallInst>(inst);
+            if (!callInst)
+            {
+                continue;
+            }
+            CallSite site = std::make_pair(callInst, fc.second);
+            auto si = state.callees.find(callInst);
+            if (si != state.callees.end())
+            {
+                ctx_call_result[site] = si->second;
+            }
+            else
+            {
+                ctx_call_result.erase(site);
+            }
+            // call_func_result是所有context下结果的并集
+            FunctionSet all_callees;
+            bool visited = false;
+            for (auto ci = ctx_call_result.lower_bound(std::make_pair(callInst, 0u)), ce = ctx_call_result.end();
+                 ci != ce && ci->first.first == callInst; ci++)
+            {
+                all_callees.insert(ci->second.begin(), ci->second.end());
+                visited = true;
+            }
+            if (visited)
+            {
+                call_func_result[callInst] = all_callees;
+            }
+            else
+            {
+                call_func_result.erase(callInst);
+            }
+        }
+        table.insert(state.top_level.begin(), state.top_level.end());
+        return_sites[fc] = state.return_sites;
+    }
+
+    ///
+    /// Cheap cloning heuristic: only small functions taking a pointer are
+    /// worth analysing separately per calling context, typically wrappers
+    /// that just alias or forward their arguments.
+    ///
+    bool shouldClone(Function *fn)
+    {
+        if (contexts.getK() == 0 || fn->isDeclaration())
+        {
+            return false;
+        }
+        auto it = clone_cache.find(fn);
+        if (it != clone_cache.end())
+        {
+            return it->second;
+        }
+        bool has_pointer_arg = false;
+        for (auto ai = fn->arg_begin(), ae = fn->arg_end(); ai != ae; ai++)
+        {
+            if (ai->getType()->isPointerTy())
+            {
+                has_pointer_arg = true;
+            }
+        }
+        unsigned insts = 0;
+        for (auto bi = fn->begin(), be = fn->end(); bi != be; bi++)
+        {
+            insts += bi->size();
+        }
+        bool clone = has_pointer_arg && insts <= clone_max_insts;
+        clone_cache[fn] = clone;
+        return clone;
+    }
+
+    void merge(LivenessInfo *dest, const LivenessInfo &src) override
+    {
+        for (auto ii = src.LiveVars_map.begin(), ie = src.LiveVars_map.end(); ii != ie; ii++)
+        {
+            dest->LiveVars_map[ii->first].insert(ii->second.begin(), ii->second.end());
+        }
+        for (auto ii = src.LiveVars_feild_map.begin(), ie = src.LiveVars_feild_map.end(); ii != ie; ii++)
+        {
+            dest->LiveVars_feild_map[ii->first].insert(ii->second.begin(), ii->second.end());
+        }
+    }
+
+    /// Collect every value reachable in dfval from roots, following both
+    /// LiveVars_map and LiveVars_feild_map edges. Globals are always roots.
+    void collectReachable(const LivenessInfo &dfval, ValueSet roots, ValueSet *reachable)
+    {
+        for (auto ii = dfval.LiveVars_map.begin(), ie = dfval.LiveVars_map.end(); ii != ie; ii++)
+        {
+            if (isa<GlobalValue>(ii->first))
+            {
+                roots.insert(ii->first);
+            }
+        }
+        for (auto ii = dfval.LiveVars_feild_map.begin(), ie = dfval.LiveVars_feild_map.end(); ii != ie; ii++)
+        {
+            if (isa<GlobalValue>(ii->first))
+            {
+                roots.insert(ii->first);
+            }
+        }
+
+        while (!roots.empty())
+        {
+            Value *v = *roots.begin();
+            roots.erase(roots.begin());
+            if (!reachable->insert(v).second)
+            {
+                continue;
+            }
+            auto mi = dfval.LiveVars_map.find(v);
+            if (mi != dfval.LiveVars_map.end())
+            {
+                roots.insert(mi->second.begin(), mi->second.end());
+            }
+            auto fi = dfval.LiveVars_feild_map.find(v);
+            if (fi != dfval.LiveVars_feild_map.end())
+            {
+                roots.insert(fi->second.begin(), fi->second.end());
+            }
+        }
+    }
+
+    /// Split dfval into the facts whose key is in reachable (inside) and the rest (outside)
+    void projectState(const LivenessInfo &dfval, const ValueSet &reachable, LivenessInfo *inside, LivenessInfo *outside)
+    {
+        for (auto ii = dfval.LiveVars_map.begin(), ie = dfval.LiveVars_map.end(); ii != ie; ii++)
+        {
+            if (reachable.count(ii->first))
+            {
+                if (inside)
+                    inside->LiveVars_map.insert(*ii);
+            }
+            else if (outside)
+            {
+                outside->LiveVars_map.insert(*ii);
+            }
+        }
+        for (auto ii = dfval.LiveVars_feild_map.begin(), ie = dfval.LiveVars_feild_map.end(); ii != ie; ii++)
+        {
+            if (reachable.count(ii->first))
             {
-                errs() << ", ";
+                if (inside)
+                    inside->LiveVars_feild_map.insert(*ii);
+            }
+            else if (outside)
+            {
+                outside->LiveVars_feild_map.insert(*ii);
             }
-            out << (*ii)->getName() << " " << (*ii);
         }
-        out << " ; ";
     }
-    out << "}";
-    return out;
-}
-
-class LivenessVisitor : public DataflowVisitor<struct LivenessInfo>
-{
-public:
-    std::map<CallInst *, FunctionSet> call_func_result;
-    FunctionSet fn_worklist;
-    LivenessVisitor() : call_func_result(), fn_worklist() {}
 
-    void merge(LivenessInfo *dest, const LivenessInfo &src) override
+    /// Add what the incoming value (a representative) of a phi or select
+    /// points to: a function or a struct or array object with no entry is
+    /// itself the target, as for the base of a GEP
+    void addPointees(LivenessInfo *dfval, Value *value, ValueSet *pointees)
     {
-        for (auto ii = src.LiveVars_map.begin(), ie = src.LiveVars_map.end(); ii != ie; ii++)
+        ValueSet &values = dfval->LiveVars_map[value];
+        if (isa<Function>(value) || (values.empty() && getAggregateType(value)))
         {
-            dest->LiveVars_map[ii->first].insert(ii->second.begin(), ii->second.end());
+            pointees->insert(value);
         }
-        for (auto ii = src.LiveVars_feild_map.begin(), ie = src.LiveVars_feild_map.end(); ii != ie; ii++)
+        else
         {
-            dest->LiveVars_feild_map[ii->first].insert(ii->second.begin(), ii->second.end());
+            pointees->insert(values.begin(), values.end());
         }
     }
 
     void HandlePHINode(PHINode *phiNode, DataflowResult<LivenessInfo>::Type *result)
     {
         LivenessInfo dfval = (*result)[phiNode].first;
+        if (getPointerRep(phiNode) != phiNode)
+        {
+            // 只有一个输入的PHI与输入共用一个key
+            (*result)[phiNode].second = dfval;
+            return;
+        }
 
         dfval.LiveVars_map[phiNode].clear();
         for (Value *value : phiNode->incoming_values())
         {
-            if (isa<Function>(value))
-            {
-                dfval.LiveVars_map[phiNode].insert(value);
-            }
-            else
-            {
-                ValueSet &values = dfval.LiveVars_map[value];
-                dfval.LiveVars_map[phiNode].insert(values.begin(), values.end());
-            }
             // 对于PHI节点，Union进来的所有set
+            addPointees(&dfval, getPointerRep(value), &dfval.LiveVars_map[phiNode]);
         }
 
         (*result)[phiNode].second = dfval;
     }
 
+    void HandleSelectInst(SelectInst *selectInst, DataflowResult<LivenessInfo>::Type *result)
+    {
+        LivenessInfo dfval = (*result)[selectInst].first;
+        if (!selectInst->getType()->isPointerTy())
+        {
+            (*result)[selectInst].second = dfval;
+            return;
+        }
+
+        // 和PHI一样, 两个分支的set取并
+        dfval.LiveVars_map[selectInst].clear();
+        Value *values[] = {selectInst->getTrueValue(), selectInst->getFalseValue()};
+        for (Value *value : values)
+        {
+            addPointees(&dfval, getPointerRep(value), &dfval.LiveVars_map[selectInst]);
+        }
+
+        (*result)[selectInst].second = dfval;
+    }
+
     void HandleCallInst(CallInst *callInst, DataflowResult<LivenessInfo>::Type *result)
     {
         LivenessInfo dfval = (*result)[callInst].first;
+        CallSite site = std::make_pair(callInst, current_ctx);
 
         FunctionSet callees;
         //callee被调用者，caller调用者
-        Value *value = callInst->getCalledValue();
+        Value *value = getPointerRep(callInst->getCalledValue());
+        const FunctionSet *fast_callees = fast_path ? fast_path->lookup(callInst) : nullptr;
         if (auto *func = dyn_cast<Function>(value))
         {
             callees.insert(func);
         }
-        else
+        else if (fast_callees)
         {
-            ValueSet value_worklist;
-            if (dfval.LiveVars_map.count(value))
+            for (Function *callee : *fast_callees)
             {
-                value_worklist.insert(dfval.LiveVars_map[value].begin(), dfval.LiveVars_map[value].end());
+                callees.insert(cast<Function>(getPointerRep(callee)));
             }
-
-            while (!value_worklist.empty())
+        }
+        else
+        {
+            callees = resolver.resolve(site, dfval.LiveVars_map, value);
+            // 签名对不上的函数不可能被这里调用
+            for (auto fi = callees.begin(); fi != callees.end();)
             {
-                Value *v = *(value_worklist.begin());
-                value_worklist.erase(value_worklist.begin());
-                if (auto *func = dyn_cast<Function>(v))
-                {
-                    callees.insert(func);
-                }
+                if (FunctionTypeIndex::isCompatible(callInst, *fi))
+                    fi++;
                 else
-                {
-                    value_worklist.insert(dfval.LiveVars_map[v].begin(), dfval.LiveVars_map[v].end());
-                }
-                //前向访问找到所有的func
+                    fi = callees.erase(fi);
             }
         }
 
-        call_func_result[callInst].clear();
-        call_func_result[callInst].insert(callees.begin(), callees.end());
+        // call_func_result是所有context下结果的并集
+        ctx_call_result[site] = callees;
+        FunctionSet &all_callees = call_func_result[callInst];
+        all_callees.clear();
+        for (auto ci = ctx_call_result.lower_bound(std::make_pair(callInst, 0u)), ce = ctx_call_result.end();
+             ci != ce && ci->first.first == callInst; ci++)
+        {
+            all_callees.insert(ci->second.begin(), ci->second.end());
+        }
 
         /// Return the function called, or null if this is an
         /// indirect function invocation.
-        if (callInst->getCalledFunction() && callInst->getCalledFunction()->isDeclaration())
+        if (isa<Function>(value) && cast<Function>(value)->isDeclaration())
         {
             (*result)[callInst].second = (*result)[callInst].first;
             return;
         }
 
+        // 只把实参和全局变量可达的部分传给callee，其余部分直接流到call之后
+        ValueSet roots;
+        for (unsigned argi = 0, arge = callInst->getNumArgOperands(); argi < arge; argi++)
+        {
+            Value *caller_arg = callInst->getArgOperand(argi);
+            if (caller_arg->getType()->isPointerTy())
+            {
+                roots.insert(getPointerRep(caller_arg));
+            }
+        }
+        ValueSet reachable;
+        collectReachable(dfval, roots, &reachable);
+        LivenessInfo reachable_dfval, unreachable_dfval;
+        projectState(dfval, reachable, &reachable_dfval, &unreachable_dfval);
+        merge(&(*result)[callInst].second, unreachable_dfval);
+
+        bool has_body = false, all_pure = true, some_pure = false;
         for (auto calleei = callees.begin(), calleee = callees.end(); calleei != calleee; calleei++)
         {
             Function *callee = *calleei;
             // 声明不算
-            if (callee->isDeclaration())
+            if (!materialize(callee) || callee->isDeclaration())
+            {
+                continue;
+            }
+            if (slice && !slice->isRelevant(callee))
             {
+                // 切片之外的函数不分析, 只记下其中的直接调用; 它不写指针, 经过它的路径上状态不变
+                recordDirectCalls(callee);
+                has_body = true;
+                some_pure = true;
                 continue;
             }
+            has_body = true;
+            if (!modref || !modref->isPure(callee))
+            {
+                all_pure = false;
+            }
+            else
+            {
+                some_pure = true;
+            }
+            unsigned callee_ctx = shouldClone(callee) ? contexts.extend(current_ctx, callInst) : CallStringTable::EmptyContext;
+            FunctionContext callee_fc = std::make_pair(callee, callee_ctx);
+            bool remote = exchange && !exchange->isLocal(callee);
+            if (!remote && return_sites[callee_fc].insert(site).second)
+            {
+                // 新的调用点, callee需要重新把返回值传回来
+                fn_worklist.insert(callee_fc);
+            }
             std::map<Value *, Argument *> ValueToArg_map;
 
-            for (int argi = 0, arge = callInst->getNumArgOperands(); argi < arge; argi++)
+            for (int argi = 0, arge = std::min(callInst->getNumArgOperands(), (unsigned)callee->arg_size()); argi < arge; argi++)
             {
                 Value *caller_arg = callInst->getArgOperand(argi);
                 if (caller_arg->getType()->isPointerTy())
                 {
                     // only consider pointer
                     Argument *callee_arg = callee->arg_begin() + argi;
-                    ValueToArg_map.insert(std::make_pair(caller_arg, callee_arg));
+                    ValueToArg_map.insert(std::make_pair(getPointerRep(caller_arg), callee_arg));
                 }
             }
 
             if (ValueToArg_map.empty())
             {
-                LivenessInfo tmpdfval = (*result)[callInst].second;
-                merge(&tmpdfval, (*result)[callInst].first);
+                merge(&(*result)[callInst].second, reachable_dfval);
+                if (remote)
+                {
+                    exchange->sendEntry(callee_fc, site, nullptr);
+                }
+                else if (observer)
+                {
+                    observer->deliverEntry(callee_fc, site, nullptr);
+                }
                 continue;
             }
 
             // replace LiveVars_map
-            LivenessInfo tmpdfval = (*result)[callInst].first;
-            LivenessInfo &callee_dfval_in = (*result)[&*inst_begin(callee)].first;
-            LivenessInfo old_callee_dfval_in = callee_dfval_in;
+            LivenessInfo tmpdfval = reachable_dfval;
             for (auto bi = tmpdfval.LiveVars_map.begin(), be = tmpdfval.LiveVars_map.end(); bi != be; bi++)
             {
                 for (auto argi = ValueToArg_map.begin(), arge = ValueToArg_map.end(); argi != arge; argi++)
@@ -247,12 +1190,35 @@ public:
                 }
             }
 
+            if (remote)
+            {
+                // callee的入口状态由拥有它的进程合并
+                exchange->sendEntry(callee_fc, site, &tmpdfval);
+                continue;
+            }
+            if (observer)
+            {
+                observer->deliverEntry(callee_fc, site, &tmpdfval);
+            }
+            LivenessInfo &callee_dfval_in = getResult(callee_ctx)[&*inst_begin(callee)].first;
+            LivenessInfo old_callee_dfval_in = callee_dfval_in;
             merge(&callee_dfval_in, tmpdfval);
             if (old_callee_dfval_in != callee_dfval_in)
             {
-                fn_worklist.insert(callee);
+                fn_worklist.insert(callee_fc);
             }
         }
+
+        // 没有可分析的callee, 或者callee都不写指针时, caller的状态原样流过
+        if (!has_body || all_pure)
+        {
+            (*result)[callInst].second = dfval;
+        }
+        else if (some_pure)
+        {
+            // 不写指针的callee不从return传回状态, 经过它的那条路径上状态不变
+            merge(&(*result)[callInst].second, dfval);
+        }
     }
 
     void HandleStoreInst(StoreInst *storeInst, DataflowResult<LivenessInfo>::Type *result)
@@ -260,19 +1226,20 @@ public:
         LivenessInfo dfval = (*result)[storeInst].first;
 
         ValueSet values;
-        if (dfval.LiveVars_map[storeInst->getValueOperand()].empty())
+        Value *valueOperand = getPointerRep(storeInst->getValueOperand());
+        if (dfval.LiveVars_map[valueOperand].empty())
         {
-            values.insert(storeInst->getValueOperand());
+            values.insert(valueOperand);
         }
         else
         {
-            ValueSet &tmp = dfval.LiveVars_map[storeInst->getValueOperand()];
+            ValueSet &tmp = dfval.LiveVars_map[valueOperand];
             values.insert(tmp.begin(), tmp.end());
         }
 
-        if (auto *getElementPtrInst = dyn_cast<GetElementPtrInst>(storeInst->getPointerOperand()))
+        Value *storePointer = getPointerRep(storeInst->getPointerOperand());
+        if (Value *pointerOperand = getFieldBase(storePointer, storeInst->getValueOperand()->getType()))
         {
-            Value *pointerOperand = getElementPtrInst->getPointerOperand();
             if (dfval.LiveVars_map[pointerOperand].empty())
             {
                 dfval.LiveVars_feild_map[pointerOperand].clear();
@@ -292,8 +1259,8 @@ public:
         else
         {
             //ptr
-            dfval.LiveVars_map[storeInst->getPointerOperand()].clear();
-            dfval.LiveVars_map[storeInst->getPointerOperand()].insert(values.begin(), values.end());
+            dfval.LiveVars_map[storePointer].clear();
+            dfval.LiveVars_map[storePointer].insert(values.begin(), values.end());
         }
 
         (*result)[storeInst].second = dfval;
@@ -304,9 +1271,9 @@ public:
         LivenessInfo dfval = (*result)[loadInst].first;
 
         dfval.LiveVars_map[loadInst].clear();
-        if (auto *getElementPtrInst = dyn_cast<GetElementPtrInst>(loadInst->getPointerOperand()))
+        Value *loadPointer = getPointerRep(loadInst->getPointerOperand());
+        if (Value *pointerOperand = getFieldBase(loadPointer, loadInst->getType()))
         {
-            Value *pointerOperand = getElementPtrInst->getPointerOperand();
             if (dfval.LiveVars_map[pointerOperand].empty())
             {
                 ValueSet &tmp = dfval.LiveVars_feild_map[pointerOperand];
@@ -326,7 +1293,7 @@ public:
         else
         {
             // ptr
-            ValueSet &tmp = dfval.LiveVars_map[loadInst->getPointerOperand()];
+            ValueSet &tmp = dfval.LiveVars_map[loadPointer];
             dfval.LiveVars_map[loadInst].insert(tmp.begin(), tmp.end());
         }
         (*result)[loadInst].second = dfval;
@@ -337,82 +1304,109 @@ public:
         LivenessInfo dfval = (*result)[returnInst].first;
 
         Function *callee = returnInst->getFunction();
+        if (modref && modref->isPure(callee))
+        {
+            // callers already passed their state through the call
+            (*result)[returnInst].second = dfval;
+            return;
+        }
         //前向找到哪个函数调用了return的函数
-        for (auto funci = call_func_result.begin(), funce = call_func_result.end(); funci != funce; funci++)
+        std::set<CallSite> &sites = return_sites[std::make_pair(callee, current_ctx)];
+        for (auto sitei = sites.begin(), sitee = sites.end(); sitei != sitee; sitei++)
         {
-            if (funci->second.count(callee))
-            { // funci call callee
-                CallInst *callInst = funci->first;
-                Function *caller = callInst->getFunction();
+            CallInst *callInst = sitei->first;
+            FunctionContext caller = std::make_pair(callInst->getFunction(), sitei->second);
 
-                std::map<Value *, Argument *> ValueToArg_map;
-                for (unsigned argi = 0, arge = callInst->getNumArgOperands(); argi < arge; argi++)
-                {
-                    Value *caller_arg = callInst->getArgOperand(argi);
-                    if (!caller_arg->getType()->isPointerTy())
-                        continue;
-                    Argument *callee_arg = callee->arg_begin() + argi;
-                    ValueToArg_map.insert(std::make_pair(caller_arg, callee_arg));
-                }
+            std::map<Value *, Argument *> ValueToArg_map;
+            for (unsigned argi = 0, arge = std::min(callInst->getNumArgOperands(), (unsigned)callee->arg_size()); argi < arge; argi++)
+            {
+                Value *caller_arg = callInst->getArgOperand(argi);
+                if (!caller_arg->getType()->isPointerTy())
+                    continue;
+                Argument *callee_arg = callee->arg_begin() + argi;
+                ValueToArg_map.insert(std::make_pair(getPointerRep(caller_arg), callee_arg));
+            }
+
+            // 只把形参、全局变量和返回值可达的部分带回caller
+            ValueSet roots, reachable;
+            for (auto argi = ValueToArg_map.begin(), arge = ValueToArg_map.end(); argi != arge; argi++)
+            {
+                roots.insert(argi->second);
+            }
+            if (returnInst->getReturnValue())
+            {
+                roots.insert(getPointerRep(returnInst->getReturnValue()));
+            }
+            collectReachable(dfval, roots, &reachable);
 
-                LivenessInfo tmpdfval = (*result)[returnInst].first;
-                LivenessInfo &caller_dfval_out = (*result)[callInst].second;
-                LivenessInfo old_caller_dfval_out = caller_dfval_out;
+            LivenessInfo tmpdfval;
+            projectState(dfval, reachable, &tmpdfval, nullptr);
 
-                if (returnInst->getReturnValue() &&
-                    returnInst->getReturnValue()->getType()->isPointerTy())
-                {
-                    ValueSet values = tmpdfval.LiveVars_map[returnInst->getReturnValue()];
-                    tmpdfval.LiveVars_map.erase(returnInst->getReturnValue());
-                    tmpdfval.LiveVars_map[callInst].insert(values.begin(), values.end());
-                }
-                // // replace LiveVars_map
-                for (auto bi = tmpdfval.LiveVars_map.begin(), be = tmpdfval.LiveVars_map.end(); bi != be; bi++)
+            if (returnInst->getReturnValue() &&
+                returnInst->getReturnValue()->getType()->isPointerTy())
+            {
+                Value *returnValue = getPointerRep(returnInst->getReturnValue());
+                ValueSet values = tmpdfval.LiveVars_map[returnValue];
+                tmpdfval.LiveVars_map.erase(returnValue);
+                tmpdfval.LiveVars_map[callInst].insert(values.begin(), values.end());
+            }
+            // // replace LiveVars_map
+            for (auto bi = tmpdfval.LiveVars_map.begin(), be = tmpdfval.LiveVars_map.end(); bi != be; bi++)
+            {
+                for (auto argi = ValueToArg_map.begin(), arge = ValueToArg_map.end(); argi != arge; argi++)
                 {
-                    for (auto argi = ValueToArg_map.begin(), arge = ValueToArg_map.end(); argi != arge; argi++)
+                    if (bi->second.count(argi->second))
                     {
-                        if (bi->second.count(argi->second))
-                        {
-                            bi->second.erase(argi->second);
-                            bi->second.insert(argi->first);
-                        }
+                        bi->second.erase(argi->second);
+                        bi->second.insert(argi->first);
                     }
                 }
+            }
 
-                // replace LiveVars_feild_map
-                for (auto bi = tmpdfval.LiveVars_feild_map.begin(), be = tmpdfval.LiveVars_feild_map.end(); bi != be; bi++)
+            // replace LiveVars_feild_map
+            for (auto bi = tmpdfval.LiveVars_feild_map.begin(), be = tmpdfval.LiveVars_feild_map.end(); bi != be; bi++)
+            {
+                for (auto argi = ValueToArg_map.begin(), arge = ValueToArg_map.end(); argi != arge; argi++)
                 {
-                    for (auto argi = ValueToArg_map.begin(), arge = ValueToArg_map.end(); argi != arge; argi++)
+                    if (bi->second.count(argi->second))
                     {
-                        if (bi->second.count(argi->second))
-                        {
-                            bi->second.erase(argi->second);
-                            bi->second.insert(argi->first);
-                        }
+                        bi->second.erase(argi->second);
+                        bi->second.insert(argi->first);
                     }
                 }
-                for (auto argi = ValueToArg_map.begin(), arge = ValueToArg_map.end(); argi != arge; argi++)
+            }
+            for (auto argi = ValueToArg_map.begin(), arge = ValueToArg_map.end(); argi != arge; argi++)
+            {
+                if (tmpdfval.LiveVars_map.count(argi->second))
                 {
-                    if (tmpdfval.LiveVars_map.count(argi->second))
-                    {
-                        ValueSet values = tmpdfval.LiveVars_map[argi->second];
-                        tmpdfval.LiveVars_map.erase(argi->second);
-                        tmpdfval.LiveVars_map[argi->first].insert(values.begin(), values.end());
-                    }
-                    if (tmpdfval.LiveVars_feild_map.count(argi->second))
-                    {
-                        ValueSet values = tmpdfval.LiveVars_feild_map[argi->second];
-                        tmpdfval.LiveVars_feild_map.erase(argi->second);
-                        tmpdfval.LiveVars_feild_map[argi->first].insert(values.begin(), values.end());
-                    }
+                    ValueSet values = tmpdfval.LiveVars_map[argi->second];
+                    tmpdfval.LiveVars_map.erase(argi->second);
+                    tmpdfval.LiveVars_map[argi->first].insert(values.begin(), values.end());
                 }
-
-                merge(&caller_dfval_out, tmpdfval);
-                if (caller_dfval_out != old_caller_dfval_out)
+                if (tmpdfval.LiveVars_feild_map.count(argi->second))
                 {
-                    fn_worklist.insert(caller);
+                    ValueSet values = tmpdfval.LiveVars_feild_map[argi->second];
+                    tmpdfval.LiveVars_feild_map.erase(argi->second);
+                    tmpdfval.LiveVars_feild_map[argi->first].insert(values.begin(), values.end());
                 }
             }
+
+            if (exchange && !exchange->isLocal(caller.first))
+            {
+                exchange->sendExit(std::make_pair(callee, current_ctx), *sitei, tmpdfval);
+                continue;
+            }
+            if (observer)
+            {
+                observer->deliverExit(std::make_pair(callee, current_ctx), *sitei, tmpdfval);
+            }
+            LivenessInfo &caller_dfval_out = getResult(sitei->second)[callInst].second;
+            LivenessInfo old_caller_dfval_out = caller_dfval_out;
+            merge(&caller_dfval_out, tmpdfval);
+            if (caller_dfval_out != old_caller_dfval_out)
+            {
+                fn_worklist.insert(caller);
+            }
         }
         (*result)[returnInst].second = dfval;
     }
@@ -423,7 +1417,7 @@ public:
 
         dfval.LiveVars_map[getElementPtrInst].clear();
 
-        Value *pointerOperand = getElementPtrInst->getPointerOperand();
+        Value *pointerOperand = getPointerRep(getElementPtrInst->getPointerOperand());
         if (dfval.LiveVars_map[pointerOperand].empty())
         {
             dfval.LiveVars_map[getElementPtrInst].insert(pointerOperand);
@@ -446,22 +1440,90 @@ public:
     {
         LivenessInfo dfval = (*result)[memCpyInst].first;
 
-        auto *b1 = dyn_cast<BitCastInst>(memCpyInst->getArgOperand(0));
-        auto *b2 = dyn_cast<BitCastInst>(memCpyInst->getArgOperand(1));
-        if (b1 && b2)
+        // 拷贝的是bitcast之前的对象; 两个操作数不都是转换来的时候不知道拷的是什么, 状态不变
+        if (isa<BitCastInst>(memCpyInst->getArgOperand(0)) && isa<BitCastInst>(memCpyInst->getArgOperand(1)))
         {
-            Value *dest = b1->getOperand(0);
-            Value *src = b2->getOperand(0);
-            dfval.LiveVars_map[dest].clear();
-            dfval.LiveVars_map[dest].insert(dfval.LiveVars_map[src].begin(), dfval.LiveVars_map[src].end());
+            Value *dest = getPointerRep(memCpyInst->getArgOperand(0));
+            Value *src = getPointerRep(memCpyInst->getArgOperand(1));
+            // 和GEP的load/store一样: 指针没有指向时它自己就是对象, 否则拷贝的是它指向的对象的域
+            ValueSet src_objects = dfval.LiveVars_map[src];
+            if (src_objects.empty())
+                src_objects.insert(src);
+            ValueSet dest_objects = dfval.LiveVars_map[dest];
+            if (dest_objects.empty())
+                dest_objects.insert(dest);
 
-            dfval.LiveVars_feild_map[dest].clear();
-            dfval.LiveVars_feild_map[dest].insert(dfval.LiveVars_feild_map[src].begin(), dfval.LiveVars_feild_map[src].end());
+            ValueSet values;
+            for (Value *object : src_objects)
+            {
+                ValueSet &tmp = dfval.LiveVars_feild_map[object];
+                values.insert(tmp.begin(), tmp.end());
+            }
+            for (Value *object : dest_objects)
+            {
+                dfval.LiveVars_feild_map[object].clear();
+                dfval.LiveVars_feild_map[object].insert(values.begin(), values.end());
+            }
         }
         (*result)[memCpyInst].second = dfval;
     }
 
+    ///
+    /// Top-level pointers (see isTopLevel) are read from the table of the
+    /// current context for the duration of one instruction, and whatever the
+    /// instruction defines for them is moved back into the table, so they
+    /// never occupy a program point of their own.
+    ///
     void compDFVal(Instruction *inst, DataflowResult<LivenessInfo>::Type *result) override
+    {
+        if (slice && !slice->isRelevant(inst))
+        {
+            (*result)[inst].second = (*result)[inst].first;
+            return;
+        }
+        std::vector<Value *> added;
+        materializeTopLevel(inst, &(*result)[inst].first, &added);
+        HandleInst(inst, result);
+
+        Function *fn = inst->getFunction();
+        LivenessInfo &dfval_in = (*result)[inst].first;
+        for (Value *v : added)
+        {
+            auto it = dfval_in.LiveVars_map.find(v);
+            if (it != dfval_in.LiveVars_map.end())
+            {
+                addTopLevel(fn, v, it->second);
+                dfval_in.LiveVars_map.erase(it);
+            }
+        }
+        LiveVarsToMap &vars = (*result)[inst].second.LiveVars_map;
+        for (auto ii = vars.begin(), ie = vars.end(); ii != ie;)
+        {
+            if (isOwnTopLevel(fn, ii->first))
+            {
+                addTopLevel(fn, ii->first, ii->second);
+                ii = vars.erase(ii);
+            }
+            else
+            {
+                ii++;
+            }
+        }
+    }
+
+    void takeDirtyBlocks(Function *fn, std::set<BasicBlock *> *blocks) override
+    {
+        for (BasicBlock *bb : dirty_blocks)
+        {
+            if (bb->getParent() == fn)
+            {
+                blocks->insert(bb);
+            }
+        }
+        dirty_blocks.clear();
+    }
+
+    void HandleInst(Instruction *inst, DataflowResult<LivenessInfo>::Type *result)
     {
         if (isa<IntrinsicInst>(inst))
         {
@@ -543,6 +1605,15 @@ public:
             }
             HandleBitCastInst(bitCastInst, result);
         }
+        else if (auto *selectInst = dyn_cast<SelectInst>(inst))
+        {
+            if (debug)
+            {
+                errs() << "I am in SelectInst"
+                       << "\n";
+            }
+            HandleSelectInst(selectInst, result);
+        }
         else
         {
             if (debug)
@@ -555,32 +1626,236 @@ public:
         return;
     }
 
-    void printCallFuncResult()
+    void printCallFuncResult(raw_ostream &out = errs())
+    {
+        ::printCallFuncResult(call_func_result, out);
+        call_func_result.clear();
+    }
+
+private:
+    std::map<unsigned, DataflowResult<LivenessInfo>::Type> ctx_results;
+    std::map<unsigned, LiveVarsToMap> ctx_top_level;        // facts of top-level pointers per context
+    std::map<Value *, Value *> pointer_reps;
+    std::map<Value *, bool> top_level_cache;
+    std::map<Function *, std::vector<BasicBlock *>> call_blocks; // blocks reading whole closures of facts
+    std::set<BasicBlock *> dirty_blocks;
+    std::map<CallSite, FunctionSet> ctx_call_result;            // callees of each call site per context
+    std::map<FunctionContext, std::set<CallSite>> return_sites; // where each analysed function returns to
+    std::map<Function *, bool> clone_cache;
+
+    /// v and every bitcast or phi whose representative is v
+    void getPointerAliases(Value *v, std::vector<Value *> *aliases)
+    {
+        ValueSet visited;
+        std::vector<Value *> worklist(1, v);
+        while (!worklist.empty())
+        {
+            Value *alias = worklist.back();
+            worklist.pop_back();
+            if (!visited.insert(alias).second)
+            {
+                continue;
+            }
+            aliases->push_back(alias);
+            for (User *user : alias->users())
+            {
+                if ((isa<BitCastOperator>(user) || isa<PHINode>(user)) && getPointerRep(user) == v)
+                    worklist.push_back(user);
+            }
+        }
+    }
+
+    ///
+    /// After mem2reg a phi, select, load, GEP, call result or formal is assigned
+    /// once, so its facts are the same at every point it reaches and can be
+    /// kept flow-insensitively. Values used as the target of a store or
+    /// memcpy, or passed to a call (whose return writes them back), are
+    /// updated through the state and stay in it.
+    ///
+    bool isTopLevel(Value *v)
+    {
+        if (!isa<PHINode>(v) && !isa<SelectInst>(v) && !isa<LoadInst>(v) && !isa<GetElementPtrInst>(v) && !isa<Argument>(v) &&
+            !(isa<CallInst>(v) && !isa<IntrinsicInst>(v)))
+        {
+            return false;
+        }
+        auto it = top_level_cache.find(v);
+        if (it != top_level_cache.end())
+        {
+            return it->second;
+        }
+        bool top_level = true;
+        std::vector<Value *> aliases;
+        getPointerAliases(v, &aliases);
+        for (Value *alias : aliases)
+        {
+            for (User *user : alias->users())
+            {
+                if (auto *storeInst = dyn_cast<StoreInst>(user))
+                {
+                    if (storeInst->getPointerOperand() == alias)
+                        top_level = false;
+                }
+                else if (auto *memCpyInst = dyn_cast<MemCpyInst>(user))
+                {
+                    if (memCpyInst->getArgOperand(0) == alias)
+                        top_level = false;
+                }
+                else if (auto *callInst = dyn_cast<CallInst>(user))
+                {
+                    if (!isa<IntrinsicInst>(callInst) && callInst->getCalledValue() != alias)
+                        top_level = false;
+                }
+            }
+        }
+        top_level_cache[v] = top_level;
+        return top_level;
+    }
+
+    bool isOwnTopLevel(Function *fn, Value *v)
+    {
+        if (auto *inst = dyn_cast<Instruction>(v))
+        {
+            return inst->getFunction() == fn && isTopLevel(v);
+        }
+        if (auto *arg = dyn_cast<Argument>(v))
+        {
+            return arg->getParent() == fn && isTopLevel(v);
+        }
+        return false;
+    }
+
+    /// Union values into the table entry of v, re-visiting its readers on change
+    void addTopLevel(Function *fn, Value *v, const ValueSet &values)
     {
-        // 每次找到行数最小的，输出对应的结果，然后从call_func_result中删除
-        while (!call_func_result.empty())
+        ValueSet &entry = ctx_top_level[current_ctx][v];
+        size_t old_size = entry.size();
+        entry.insert(values.begin(), values.end());
+        if (entry.size() == old_size)
         {
-            int line = call_func_result.begin()->first->getDebugLoc().getLine();
-            auto p = call_func_result.begin();
-            for (auto ii = call_func_result.begin(), ie = call_func_result.end(); ii != ie; ii++)
+            return;
+        }
+        std::vector<Value *> aliases;
+        getPointerAliases(v, &aliases);
+        for (Value *alias : aliases)
+        {
+            for (User *user : alias->users())
             {
-                if (ii->first->getDebugLoc().getLine() < line)
+                auto *inst = dyn_cast<Instruction>(user);
+                if (!inst)
+                {
+                    continue;
+                }
+                dirty_blocks.insert(inst->getParent());
+                if (isa<GetElementPtrInst>(inst))
                 {
-                    line = ii->first->getDebugLoc().getLine();
-                    p = ii;
+                    // loads and stores read the operand of their GEP
+                    for (User *gep_user : inst->users())
+                    {
+                        if (auto *gep_inst = dyn_cast<Instruction>(gep_user))
+                            dirty_blocks.insert(gep_inst->getParent());
+                    }
                 }
             }
-            errs() << line << " : ";
-            for (auto fi = p->second.begin(), fe = p->second.end(); fi != fe; fi++)
+        }
+        auto bi = call_blocks.find(fn);
+        if (bi == call_blocks.end())
+        {
+            std::vector<BasicBlock *> &blocks = call_blocks[fn];
+            for (auto bbi = fn->begin(), bbe = fn->end(); bbi != bbe; bbi++)
             {
-                if (fi != p->second.begin())
+                for (auto ii = bbi->begin(), ie = bbi->end(); ii != ie; ii++)
                 {
-                    errs() << ", ";
+                    if ((isa<CallInst>(&*ii) && !isa<IntrinsicInst>(&*ii)) || isa<ReturnInst>(&*ii))
+                    {
+                        blocks.push_back(&*bbi);
+                        break;
+                    }
                 }
-                errs() << (*fi)->getName();
             }
-            errs() << "\n";
-            call_func_result.erase(p);
+            bi = call_blocks.find(fn);
+        }
+        dirty_blocks.insert(bi->second.begin(), bi->second.end());
+    }
+
+    ///
+    /// Copy into dfval the table entries inst may read: its operands and
+    /// those of its GEP operands. Calls and returns walk chains of
+    /// facts, so they get everything reachable from their operands, the
+    /// formals and the globals. Keys added are appended to added.
+    ///
+    void materializeTopLevel(Instruction *inst, LivenessInfo *dfval, std::vector<Value *> *added)
+    {
+        auto ti = ctx_top_level.find(current_ctx);
+        if ((ti == ctx_top_level.end() || ti->second.empty()) && !observer)
+        {
+            return;
+        }
+        // 有observer时也要查空表, 它要知道读了哪些其他函数的项
+        const LiveVarsToMap &table = ti != ctx_top_level.end() ? ti->second : ctx_top_level[current_ctx];
+        Function *fn = inst->getFunction();
+
+        std::vector<Value *> worklist;
+        for (Value *operand : inst->operands())
+        {
+            Value *v = getPointerRep(operand);
+            worklist.push_back(v);
+            if (auto *getElementPtrInst = dyn_cast<GetElementPtrInst>(v))
+            {
+                worklist.push_back(getPointerRep(getElementPtrInst->getPointerOperand()));
+            }
+        }
+        bool closure = isa<CallInst>(inst) || isa<ReturnInst>(inst);
+        if (closure)
+        {
+            for (auto ai = fn->arg_begin(), ae = fn->arg_end(); ai != ae; ai++)
+            {
+                worklist.push_back(&*ai);
+            }
+            for (auto ii = dfval->LiveVars_map.begin(), ie = dfval->LiveVars_map.end(); ii != ie; ii++)
+            {
+                if (isa<GlobalValue>(ii->first))
+                    worklist.push_back(ii->first);
+            }
+            for (auto ii = dfval->LiveVars_feild_map.begin(), ie = dfval->LiveVars_feild_map.end(); ii != ie; ii++)
+            {
+                if (isa<GlobalValue>(ii->first))
+                    worklist.push_back(ii->first);
+            }
+        }
+
+        ValueSet visited;
+        while (!worklist.empty())
+        {
+            Value *v = worklist.back();
+            worklist.pop_back();
+            if (!visited.insert(v).second)
+            {
+                continue;
+            }
+            auto it = table.find(v);
+            if (observer)
+            {
+                observer->readTopLevel(fn, v, it == table.end() ? nullptr : &it->second);
+            }
+            if (it != table.end() && dfval->LiveVars_map.insert(*it).second)
+            {
+                added->push_back(v);
+            }
+            if (!closure)
+            {
+                continue;
+            }
+            auto mi = dfval->LiveVars_map.find(v);
+            if (mi != dfval->LiveVars_map.end())
+            {
+                worklist.insert(worklist.end(), mi->second.begin(), mi->second.end());
+            }
+            auto fi = dfval->LiveVars_feild_map.find(v);
+            if (fi != dfval->LiveVars_feild_map.end())
+            {
+                worklist.insert(worklist.end(), fi->second.begin(), fi->second.end());
+            }
         }
     }
 };
@@ -605,3 +1880,5 @@ public:
         return false;
     }
 };
+
+#endif /* !_LIVENESS_H_ */
@@ -0,0 +1,245 @@
+/************************************************************************
+ *
+ * @file ModRef.h
+ *
+ * Interprocedural mod/ref summaries: which abstract locations a function
+ * may write a pointer into, including through its transitive callees.
+ *
+ ***********************************************************************/
+
+#ifndef _MODREF_H_
+#define _MODREF_H_
+
+#include <llvm/IR/Module.h>
+#include <llvm/IR/Function.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/IntrinsicInst.h>
+#include <llvm/IR/Operator.h>
+#include <llvm/IR/InstIterator.h>
+
+#include <map>
+#include <set>
+#include <vector>
+using namespace llvm;
+
+///
+/// Abstract locations written by a function. A location is either one of
+/// the function's own formals or a global; anything else the function may
+/// write through (a loaded pointer, an escaped local, an unresolved indirect
+/// call) is folded into mod_unknown.
+///
+struct ModRefInfo
+{
+    std::set<Value *> mod;
+    bool mod_unknown;
+    ModRefInfo() : mod(), mod_unknown(false) {}
+
+    bool operator==(const ModRefInfo &info) const
+    {
+        return mod == info.mod && mod_unknown == info.mod_unknown;
+    }
+    bool operator!=(const ModRefInfo &info) const
+    {
+        return !(*this == info);
+    }
+};
+
+class ModRefSummary
+{
+public:
+    ModRefSummary() : summaries() {}
+
+    /// Compute the summary of every function in M, iterating over direct
+    /// calls until the transitive mod sets are stable.
+    void compute(Module &M)
+    {
+        summaries.clear();
+        bool changed = true;
+        while (changed)
+        {
+            changed = false;
+            for (auto &F : M)
+            {
+                if (F.isDeclaration())
+                {
+                    continue;
+                }
+                ModRefInfo info = computeLocal(&F);
+                ModRefInfo &old = summaries[&F];
+                if (info != old)
+                {
+                    old = info;
+                    changed = true;
+                }
+            }
+        }
+    }
+
+    /// True if fn may write a pointer into memory visible to its callers
+    bool mayModPointers(Function *fn) const
+    {
+        auto it = summaries.find(fn);
+        if (it == summaries.end())
+        {
+            // not summarised: stay conservative
+            return !fn->isDeclaration();
+        }
+        return it->second.mod_unknown || !it->second.mod.empty();
+    }
+
+    /// True if returning from fn can not change any pointer fact of its callers
+    bool isPure(Function *fn) const
+    {
+        return !fn->getReturnType()->isPointerTy() && !mayModPointers(fn);
+    }
+
+    const ModRefInfo *getSummary(Function *fn) const
+    {
+        auto it = summaries.find(fn);
+        return it == summaries.end() ? nullptr : &it->second;
+    }
+
+private:
+    std::map<Function *, ModRefInfo> summaries;
+
+    static Value *getBaseObject(Value *v)
+    {
+        while (true)
+        {
+            if (auto *gep = dyn_cast<GEPOperator>(v))
+            {
+                v = gep->getPointerOperand();
+            }
+            else if (auto *cast = dyn_cast<BitCastOperator>(v))
+            {
+                v = cast->getOperand(0);
+            }
+            else
+            {
+                return v;
+            }
+        }
+    }
+
+    /// A local escapes if its address is stored, returned or passed to a call
+    static bool isEscapedAlloca(AllocaInst *alloca)
+    {
+        std::set<Value *> visited;
+        std::vector<Value *> worklist(1, alloca);
+        while (!worklist.empty())
+        {
+            Value *v = worklist.back();
+            worklist.pop_back();
+            if (!visited.insert(v).second)
+            {
+                continue;
+            }
+            for (User *user : v->users())
+            {
+                if (auto *storeInst = dyn_cast<StoreInst>(user))
+                {
+                    if (storeInst->getValueOperand() == v)
+                        return true;
+                }
+                else if (isa<IntrinsicInst>(user))
+                {
+                    // memcpy copies the contents, not the address
+                    continue;
+                }
+                else if (isa<CallInst>(user) || isa<InvokeInst>(user) || isa<ReturnInst>(user) ||
+                         isa<PtrToIntInst>(user))
+                {
+                    return true;
+                }
+                else if (isa<GetElementPtrInst>(user) || isa<BitCastInst>(user) ||
+                         isa<PHINode>(user) || isa<SelectInst>(user))
+                {
+                    worklist.push_back(user);
+                }
+            }
+        }
+        return false;
+    }
+
+    static void addLocation(Value *ptr, ModRefInfo *info)
+    {
+        Value *base = getBaseObject(ptr);
+        if (isa<Argument>(base) || isa<GlobalValue>(base))
+        {
+            info->mod.insert(base);
+        }
+        else if (auto *alloca = dyn_cast<AllocaInst>(base))
+        {
+            if (isEscapedAlloca(alloca))
+                info->mod_unknown = true;
+        }
+        else
+        {
+            info->mod_unknown = true;
+        }
+    }
+
+    /// Local writes of fn plus the current summaries of its direct callees,
+    /// with callee formals mapped back to the actual arguments.
+    ModRefInfo computeLocal(Function *fn)
+    {
+        ModRefInfo info;
+        for (inst_iterator ii = inst_begin(fn), ie = inst_end(fn); ii != ie; ii++)
+        {
+            Instruction *inst = &*ii;
+            if (auto *storeInst = dyn_cast<StoreInst>(inst))
+            {
+                Type *type = storeInst->getValueOperand()->getType();
+                if (type->isPointerTy() || type->isAggregateType())
+                {
+                    addLocation(storeInst->getPointerOperand(), &info);
+                }
+            }
+            else if (auto *memCpyInst = dyn_cast<MemCpyInst>(inst))
+            {
+                addLocation(memCpyInst->getArgOperand(0), &info);
+            }
+            else if (isa<IntrinsicInst>(inst))
+            {
+                continue;
+            }
+            else if (auto *callInst = dyn_cast<CallInst>(inst))
+            {
+                Function *callee = dyn_cast<Function>(callInst->getCalledValue()->stripPointerCasts());
+                if (!callee)
+                {
+                    info.mod_unknown = true;
+                    continue;
+                }
+                if (callee->isDeclaration())
+                {
+                    // external functions are passed through by the analysis
+                    continue;
+                }
+                auto it = summaries.find(callee);
+                if (it == summaries.end())
+                {
+                    // not computed yet, the next round will pick it up
+                    continue;
+                }
+                const ModRefInfo &callee_info = it->second;
+                info.mod_unknown |= callee_info.mod_unknown;
+                for (Value *loc : callee_info.mod)
+                {
+                    if (auto *arg = dyn_cast<Argument>(loc))
+                    {
+                        if (arg->getArgNo() < callInst->getNumArgOperands())
+                            addLocation(callInst->getArgOperand(arg->getArgNo()), &info);
+                    }
+                    else
+                    {
+                        info.mod.insert(loc);
+                    }
+                }
+            }
+        }
+        return info;
+    }
+};
+
+#endif /* !_MODREF_H_ */
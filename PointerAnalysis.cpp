@@ -0,0 +1,673 @@
+/************************************************************************
+ *
+ * @file PointerAnalysis.cpp
+ *
+ * Runs the flow-sensitive analysis of Liveness.h for PointerAnalysis.h
+ * and keeps what queries need once it has converged
+ *
+ ***********************************************************************/
+
+#include "PointerAnalysis.h"
+#include "Liveness.h"
+#include "Andersen.h"
+#include "Shard.h"
+#include "VisitCache.h"
+#include "Checkpoint.h"
+
+#include <llvm/Config/llvm-config.h>
+#include <llvm/IR/LegacyPassManager.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Transforms/Scalar.h>
+#if LLVM_VERSION_MAJOR >= 7
+#include <llvm/Transforms/Utils.h>
+#endif
+
+#include <chrono>
+#include <deque>
+#include <sys/resource.h>
+
+struct PointerAnalysisResult::Tables
+{
+    std::map<unsigned, DataflowResult<LivenessInfo>::Type> results;
+    std::map<unsigned, LiveVarsToMap> top_level;
+    std::map<const Value *, Value *> reps; // representatives that differ from the value, see getPointerRep
+};
+
+PointerAnalysisResult::PointerAnalysisResult() : callees(), callers(), degraded(), stats(), tables(new Tables()) {}
+
+PointerAnalysisResult::~PointerAnalysisResult() {}
+
+bool PointerAnalysisResult::isReached(const CallInst *call) const
+{
+    return callees.count(const_cast<CallInst *>(call));
+}
+
+const std::set<Function *> &PointerAnalysisResult::getCallees(const CallInst *call) const
+{
+    static const std::set<Function *> none;
+    auto it = callees.find(const_cast<CallInst *>(call));
+    return it == callees.end() ? none : it->second;
+}
+
+const std::vector<CallInst *> &PointerAnalysisResult::getCallers(const Function *F) const
+{
+    static const std::vector<CallInst *> none;
+    auto it = callers.find(F);
+    return it == callers.end() ? none : it->second;
+}
+
+Value *PointerAnalysisResult::getRep(const Value *v) const
+{
+    auto it = tables->reps.find(v);
+    if (it != tables->reps.end())
+    {
+        return it->second;
+    }
+    // 常量表达式不在表里, bitcast的代表是被转换的全局变量或函数
+    if (isa<Constant>(v))
+    {
+        return const_cast<Value *>(v->stripPointerCasts());
+    }
+    return const_cast<Value *>(v);
+}
+
+std::set<Value *> PointerAnalysisResult::pointsTo(const Value *v, const Instruction *at) const
+{
+    std::set<Value *> values;
+    Value *rep = getRep(v);
+    for (auto ri = tables->results.begin(), re = tables->results.end(); ri != re; ri++)
+    {
+        auto pi = ri->second.find(const_cast<Instruction *>(at));
+        if (pi == ri->second.end())
+        {
+            continue;
+        }
+        const LiveVarsToMap &state = pi->second.first.LiveVars_map;
+        auto si = state.find(rep);
+        if (si != state.end())
+        {
+            values.insert(si->second.begin(), si->second.end());
+        }
+        auto ti = tables->top_level.find(ri->first);
+        if (ti != tables->top_level.end() && (si = ti->second.find(rep)) != ti->second.end())
+        {
+            values.insert(si->second.begin(), si->second.end());
+        }
+    }
+    return values;
+}
+
+std::set<Value *> PointerAnalysisResult::getPointersTo(const Value *target, const Instruction *at) const
+{
+    std::set<Value *> pointers;
+    Value *rep = getRep(target);
+    const Function *fn = at->getFunction();
+    for (auto ri = tables->results.begin(), re = tables->results.end(); ri != re; ri++)
+    {
+        auto pi = ri->second.find(const_cast<Instruction *>(at));
+        if (pi == ri->second.end())
+        {
+            continue;
+        }
+        const LiveVarsToMap &state = pi->second.first.LiveVars_map;
+        for (auto si = state.begin(), se = state.end(); si != se; si++)
+        {
+            if (si->second.count(rep))
+            {
+                pointers.insert(si->first);
+            }
+        }
+        // 表里是这个上下文中所有函数的顶层指针, 只看at所在函数的
+        auto ti = tables->top_level.find(ri->first);
+        if (ti == tables->top_level.end())
+        {
+            continue;
+        }
+        for (auto si = ti->second.begin(), se = ti->second.end(); si != se; si++)
+        {
+            const Instruction *inst = dyn_cast<Instruction>(si->first);
+            const Argument *arg = dyn_cast<Argument>(si->first);
+            if (((inst && inst->getFunction() == fn) || (arg && arg->getParent() == fn)) && si->second.count(rep))
+            {
+                pointers.insert(si->first);
+            }
+        }
+    }
+    return pointers;
+}
+
+bool PointerAnalysisResult::isDegraded(const Function *F) const
+{
+    auto it = degraded.lower_bound(std::make_pair(F, 0u));
+    return it != degraded.end() && it->first.first == F;
+}
+
+///
+/// One run of the flow analysis: picks the entry points, visits functions
+/// from a worklist until nothing changes, and hands what it found to a
+/// PointerAnalysisResult. The visit cache, checkpoints and the sharded run
+/// all hook into the worklist here, so every client gets the same loop.
+///
+class AnalysisDriver
+{
+public:
+    AnalysisDriver(Module &M, const PointerAnalysisOptions &options)
+        : M(M), options(options), modules(1, &M), fn_worklist(), fn_queued(), positions(), degraded(), stats(), cache(),
+          start(std::chrono::steady_clock::now())
+    {
+        modules.insert(modules.end(), options.others.begin(), options.others.end());
+    }
+
+    std::unique_ptr<PointerAnalysisResult> run(std::string *error)
+    {
+        RelevanceSlice slice;
+        if (options.slice_first)
+        {
+            computeRelevanceSlice(M, &slice);
+        }
+
+        // 多个模块不链接, 外部声明通过符号表找到其他模块中的定义
+        ProgramSymbolTable symbols;
+        for (Module *module : modules)
+        {
+            symbols.addModule(*module);
+        }
+
+        SyntacticCallResolver fast_path;
+        fast_path.run(M);
+
+        // 函数体在第一次用到时才读入, 读入后马上转成SSA
+        std::vector<std::unique_ptr<legacy::FunctionPassManager>> function_passes;
+        if (options.lazy)
+        {
+            for (Module *module : modules)
+            {
+                function_passes.emplace_back(new legacy::FunctionPassManager(module));
+                legacy::FunctionPassManager &passes = *function_passes.back();
+                passes.add(createPromoteMemoryToRegisterPass());
+                passes.doInitialization();
+                if (!module->getMaterializer())
+                {
+                    // 文本IR不能按需读入, 函数体已经都在内存里
+                    for (auto &F : *module)
+                    {
+                        if (!F.isDeclaration())
+                        {
+#if LLVM_VERSION_MAJOR == 5
+                            F.removeFnAttr(Attribute::OptimizeNone);
+#endif
+                            passes.run(F);
+                            fast_path.runOnFunction(F);
+                        }
+                    }
+                }
+            }
+        }
+
+        // mod/ref摘要要看到所有函数体, 按需读入时不用
+        ModRefSummary modref;
+        if (!options.lazy)
+        {
+            modref.compute(M);
+        }
+
+        LivenessVisitor visitor;
+        visitor.modref = options.lazy ? nullptr : &modref;
+        for (unsigned i = 0; i < function_passes.size(); i++)
+        {
+            visitor.function_passes[modules[i]] = function_passes[i].get();
+        }
+        visitor.symbols = modules.size() > 1 ? &symbols : nullptr;
+        visitor.fast_path = &fast_path;
+        visitor.slice = options.slice_first ? &slice : nullptr;
+        visitor.contexts = CallStringTable(options.context_depth, options.context_budget);
+        visitor.clone_max_insts = options.clone_max_insts;
+        DataflowBudget budget;
+        budget.max_block_visits = options.max_block_visits;
+        budget.max_seconds = options.max_seconds;
+        budget.max_state_size = options.max_state_size;
+
+        for (Module *module : modules)
+        {
+            for (auto &F : *module)
+            {
+                positions.insert(std::make_pair(&F, positions.size()));
+            }
+        }
+
+        // 从入口开始, 其余函数在被调用时才加入worklist
+        std::vector<Function *> entries;
+        LateCallbacks late_callbacks;
+        if (!getEntryPoints(symbols, options.lazy ? &late_callbacks : nullptr, &entries, error))
+        {
+            return nullptr;
+        }
+        visitor.late_callbacks = options.lazy ? &late_callbacks : nullptr;
+
+        // 上次运行的结果, 没变的函数直接重放
+        if (!options.cache_path.empty() || options.cache_buffer)
+        {
+            CacheDigest digest;
+            digest.add(budget.max_block_visits);
+            digest.add(budget.max_state_size);
+            cache.reset(new VisitCache(M, visitor, modref, digest.lo));
+            std::string problem;
+            if (options.cache_buffer ? !options.cache_buffer->empty() && !cache->loadBuffer(*options.cache_buffer, &problem)
+                                     : !cache->load(options.cache_path, &problem))
+            {
+                log() << "ignoring " << (options.cache_buffer ? "the visits kept from the last run" : options.cache_path)
+                      << ": " << problem << "\n";
+            }
+            visitor.observer = cache.get();
+        }
+
+        // 上次被杀掉时的检查点, 从那里接着分析
+        std::unique_ptr<AnalysisCheckpoint> checkpoint;
+        if (!options.checkpoint_path.empty())
+        {
+            CacheDigest digest;
+            digest.add(budget.max_block_visits);
+            digest.add(budget.max_state_size);
+            digest.add(options.context_depth);
+            digest.add(options.context_budget);
+            digest.add(options.clone_max_insts);
+            digest.add(options.slice_first);
+            for (Function *F : entries)
+            {
+                digest.add(F->getName());
+            }
+            checkpoint.reset(new AnalysisCheckpoint(M, digest.lo));
+            std::string problem;
+            if (!checkpoint->read(options.checkpoint_path, &visitor, &fn_worklist, &degraded, &stats.resumed, &problem))
+            {
+                log() << "ignoring " << options.checkpoint_path << ": " << problem << "\n";
+            }
+            for (const FunctionContext &fc : fn_worklist)
+            {
+                fn_queued.insert(fc);
+            }
+            stats.resumed_queue = fn_worklist.size();
+        }
+
+        bool sharded = false;
+        if (options.shards > 1)
+        {
+            // 子进程什么也没留给这个进程, 失败了就在这里从头分析
+            sharded = runShards(visitor, entries, slice, budget);
+            if (!sharded)
+            {
+                log() << "sharded analysis failed, analysing in one process\n";
+            }
+        }
+        if (!sharded && !stats.resumed)
+        {
+            enqueueEntries(visitor, entries, slice);
+        }
+        auto last_checkpoint = std::chrono::steady_clock::now();
+        while (!fn_worklist.empty())
+        {
+            analyzeNext(visitor, budget);
+            if (stats.first_result_ms < 0 && !visitor.call_func_result.empty())
+            {
+                stats.first_result_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            }
+            if (checkpoint && !fn_worklist.empty() &&
+                std::chrono::duration<double>(std::chrono::steady_clock::now() - last_checkpoint).count() >=
+                    options.checkpoint_interval)
+            {
+                std::string problem;
+                if (!checkpoint->write(options.checkpoint_path, visitor, fn_worklist, degraded, &problem))
+                {
+                    // 写不了就不再试, 分析照常进行
+                    log() << "cannot write " << options.checkpoint_path << ": " << problem << "\n";
+                    checkpoint.reset();
+                }
+                else if (options.checkpoint_stop && checkpoint->getNumWritten() >= options.checkpoint_stop)
+                {
+                    // 检查点留着, 下次从这里接着分析
+                    *error = "stopped after " + std::to_string(checkpoint->getNumWritten()) + " checkpoints";
+                    return nullptr;
+                }
+                last_checkpoint = std::chrono::steady_clock::now();
+            }
+        }
+        if (!options.checkpoint_path.empty())
+        {
+            // 分析完了, 检查点没有用了
+            sys::fs::remove(options.checkpoint_path);
+        }
+        if (checkpoint)
+        {
+            stats.checkpoints_written = checkpoint->getNumWritten();
+            stats.checkpoint_bytes = checkpoint->getWrittenBytes();
+        }
+        if (cache)
+        {
+            std::string problem;
+            if (options.cache_buffer)
+            {
+                cache->saveBuffer(options.cache_buffer);
+            }
+            else if (!cache->save(options.cache_path, &problem))
+            {
+                log() << "cannot write " << options.cache_path << ": " << problem << "\n";
+            }
+            stats.cache_hits = cache->getNumHits();
+            stats.cache_misses = cache->getNumMisses();
+            stats.cache_analysed = cache->getNumAnalysed();
+            stats.cache_saved_bytes = cache->getSavedBytes();
+        }
+        stats.fast_path_resolved = fast_path.getResolved().size();
+        stats.indirect_calls = fast_path.getNumIndirect();
+        stats.resolver_hits = visitor.resolver.getNumHits();
+        stats.resolver_misses = visitor.resolver.getNumMisses();
+        if (options.slice_first)
+        {
+            stats.slice_insts = slice.getNumInsts();
+            stats.slice_relevant_insts = slice.getNumRelevantInsts();
+            stats.slice_relevant_functions = slice.getNumRelevantFunctions();
+        }
+        return takeResult(visitor);
+    }
+
+private:
+    Module &M;
+    const PointerAnalysisOptions &options;
+    std::vector<Module *> modules; // M first
+    // FIFO of functions to (re)analyse. Functions queued together are
+    // appended in module order, so the visiting order, and with it the
+    // result, does not depend on where the Function objects were allocated.
+    std::deque<FunctionContext> fn_worklist;
+    FunctionContextSet fn_queued;
+    std::map<Function *, unsigned> positions;
+    std::map<FunctionContext, DataflowStatus> degraded; // functions over budget, analysed flow-insensitively
+    PointerAnalysisStats stats;
+    std::unique_ptr<VisitCache> cache;
+    std::chrono::steady_clock::time_point start;
+
+    raw_ostream &log() { return options.log ? *options.log : nulls(); }
+
+    void enqueue(const FunctionContext &fc)
+    {
+        if (fn_queued.insert(fc).second)
+        {
+            fn_worklist.push_back(fc);
+        }
+    }
+
+    /// Functions named as entry points, or main and every externally visible function,
+    /// then the functions whose address may reach code outside the program.
+    /// Of several definitions of one symbol, only the one it resolves to counts.
+    /// With late_callbacks, the other functions are watched as bodies are read.
+    bool getEntryPoints(const ProgramSymbolTable &symbols, LateCallbacks *late_callbacks, std::vector<Function *> *entries,
+                        std::string *error)
+    {
+        for (const std::string &name : options.entry_points)
+        {
+            Function *F = nullptr;
+            for (auto mi = modules.begin(), me = modules.end(); mi != me && !F; mi++)
+            {
+                F = (*mi)->getFunction(name);
+                if (F && (F->isDeclaration() || symbols.resolve(F) != F))
+                {
+                    F = nullptr;
+                }
+            }
+            if (!F)
+            {
+                *error = "entry point " + name + " has no body in the module";
+                return false;
+            }
+            entries->push_back(F);
+        }
+        // 交给外部代码的回调随时可能被调用, 和入口一样对待
+        std::set<Function *> named(entries->begin(), entries->end());
+        for (Module *module : modules)
+        {
+            for (auto &F : *module)
+            {
+                if (F.isDeclaration() || symbols.resolve(&F) != &F || named.count(&F))
+                {
+                    continue;
+                }
+                if (options.entry_points.empty() && (F.getName() == "main" || !F.hasLocalLinkage()))
+                {
+                    entries->push_back(&F);
+                }
+                else if (late_callbacks)
+                {
+                    // 还没读入的函数体里可能有别的用法, 读入时再查
+                    late_callbacks->watch(&F);
+                    std::vector<Function *> escaped = late_callbacks->takeEscaped();
+                    entries->insert(entries->end(), escaped.begin(), escaped.end());
+                }
+                else if (F.hasAddressTaken() && addressMayEscape(&F))
+                {
+                    entries->push_back(&F);
+                }
+            }
+        }
+        return true;
+    }
+
+    /// Queues the entry points, or records the direct calls of those outside the slice
+    void enqueueEntries(LivenessVisitor &visitor, const std::vector<Function *> &entries, const RelevanceSlice &slice)
+    {
+        for (Function *F : entries)
+        {
+            if (options.slice_first && !slice.isRelevant(F))
+            {
+                visitor.recordDirectCalls(F);
+            }
+            else if (visitor.materialize(F))
+            {
+                enqueue(std::make_pair(F, CallStringTable::EmptyContext));
+            }
+        }
+    }
+
+    /// Moves the functions the visitor queued to the worklist, in module order
+    void takeQueued(LivenessVisitor &visitor)
+    {
+        std::vector<FunctionContext> queued(visitor.fn_worklist.begin(), visitor.fn_worklist.end());
+        std::sort(queued.begin(), queued.end(), [this](const FunctionContext &a, const FunctionContext &b) {
+            return std::make_pair(positions[a.first], a.second) < std::make_pair(positions[b.first], b.second);
+        });
+        for (const FunctionContext &fc : queued)
+        {
+            enqueue(fc);
+        }
+        visitor.fn_worklist.clear();
+    }
+
+    /// Analyses the function at the front of the worklist
+    void analyzeNext(LivenessVisitor &visitor, const DataflowBudget &budget)
+    {
+        LivenessInfo initval;
+        FunctionContext fc = fn_worklist.front();
+        fn_worklist.pop_front();
+        fn_queued.erase(fc);
+        visitor.current_ctx = fc.second;
+        if (cache)
+        {
+            if (cache->replay(fc, &degraded))
+            {
+                takeQueued(visitor);
+                return;
+            }
+            cache->beginVisit(fc);
+        }
+        DataflowResult<LivenessInfo>::Type &result = visitor.getResult(fc.second);
+        if (degraded.count(fc))
+        {
+            compFlowInsensitiveDataflow(fc.first, &visitor, &result);
+        }
+        else
+        {
+            DataflowStatus status = compForwardDataflow(fc.first, &visitor, &result, initval, budget);
+            if (status != DF_Converged)
+            {
+                degraded[fc] = status;
+                compFlowInsensitiveDataflow(fc.first, &visitor, &result);
+            }
+        }
+        if (cache)
+        {
+            cache->endVisit(fc, degraded);
+        }
+        takeQueued(visitor);
+    }
+
+    ///
+    /// Runs the analysis in options.shards forked processes, each owning
+    /// the functions partitionFunctions gave it, and collects their results
+    /// into visitor.call_func_result and degraded.
+    ///
+    bool runShards(LivenessVisitor &visitor, const std::vector<Function *> &entries, const RelevanceSlice &slice,
+                   const DataflowBudget &budget)
+    {
+        std::map<Function *, unsigned> owner;
+        std::vector<unsigned> shard_insts;
+        partitionFunctions(M, entries, options.shards, &owner, &shard_insts);
+        ShardCoordinator coordinator;
+        std::vector<std::string> results;
+        auto worker_main = [&](unsigned id, int in, int out) {
+            ShardWorker worker(id, owner, in, out);
+            visitor.exchange = &worker;
+            std::vector<Function *> own_entries;
+            for (Function *F : entries)
+            {
+                if (worker.isLocal(F))
+                {
+                    own_entries.push_back(F);
+                }
+            }
+            enqueueEntries(visitor, own_entries, slice);
+            unsigned reported = ~0u;
+            while (!worker.isDone())
+            {
+                if (fn_worklist.empty() && reported != worker.getConsumed())
+                {
+                    worker.sendIdle();
+                    reported = worker.getConsumed();
+                }
+                if (!worker.receive(&visitor, fn_worklist.empty()))
+                {
+                    return false;
+                }
+                takeQueued(visitor);
+                if (!worker.isDone() && !fn_worklist.empty())
+                {
+                    analyzeNext(visitor, budget);
+                    if (!worker.flush())
+                    {
+                        return false;
+                    }
+                }
+            }
+            // 子进程的CPU时间从fork开始算
+            struct rusage usage;
+            getrusage(RUSAGE_SELF, &usage);
+            uint64_t cpu_us = (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000ull +
+                              usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+            worker.sendResult(visitor.call_func_result, degraded, cpu_us);
+            return true;
+        };
+        if (!coordinator.run(options.shards, worker_main, &results))
+        {
+            return false;
+        }
+
+        // 合并各进程的结果, 每个调用点只由拥有它的进程分析; 有一个读不完整就都不要
+        std::map<CallInst *, FunctionSet> call_func_result;
+        std::map<FunctionContext, DataflowStatus> shard_degraded;
+        std::vector<double> cpu;
+        for (const std::string &payload : results)
+        {
+            ByteReader r(payload);
+            r.readVarint(); // SM_Result
+            cpu.push_back(r.readVarint() / 1000.0);
+            for (uint64_t i = 0, e = r.readVarint(); i != e && !r.hasError(); i++)
+            {
+                FunctionSet &callees = call_func_result[readPointer<CallInst>(r)];
+                for (uint64_t j = 0, je = r.readVarint(); j != je && !r.hasError(); j++)
+                {
+                    callees.insert(readPointer<Function>(r));
+                }
+            }
+            for (uint64_t i = 0, e = r.readVarint(); i != e && !r.hasError(); i++)
+            {
+                Function *F = readPointer<Function>(r);
+                unsigned ctx = r.readVarint();
+                shard_degraded[std::make_pair(F, ctx)] = (DataflowStatus)r.readVarint();
+            }
+            if (r.hasError())
+            {
+                log() << "truncated result from a shard\n";
+                return false;
+            }
+        }
+        for (auto ci = call_func_result.begin(), ce = call_func_result.end(); ci != ce; ci++)
+        {
+            visitor.call_func_result[ci->first].insert(ci->second.begin(), ci->second.end());
+        }
+        degraded.insert(shard_degraded.begin(), shard_degraded.end());
+        stats.shard_insts.swap(shard_insts);
+        stats.shard_cpu_ms.swap(cpu);
+        stats.shard_messages = coordinator.getNumMessages();
+        stats.shard_bytes = coordinator.getNumBytes();
+        return true;
+    }
+
+    /// Moves what queries need out of the converged visitor
+    std::unique_ptr<PointerAnalysisResult> takeResult(LivenessVisitor &visitor)
+    {
+        std::unique_ptr<PointerAnalysisResult> result(new PointerAnalysisResult());
+        // 查询时不能再改visitor的缓存, 代表先全部算好
+        for (Module *module : modules)
+        {
+            for (auto &F : *module)
+            {
+                for (auto ai = F.arg_begin(), ae = F.arg_end(); ai != ae; ai++)
+                {
+                    Value *rep = visitor.getPointerRep(&*ai);
+                    if (rep != &*ai)
+                    {
+                        result->tables->reps[&*ai] = rep;
+                    }
+                }
+                for (inst_iterator ii = inst_begin(F), ie = inst_end(F); ii != ie; ii++)
+                {
+                    Value *rep = visitor.getPointerRep(&*ii);
+                    if (rep != &*ii)
+                    {
+                        result->tables->reps[&*ii] = rep;
+                    }
+                }
+            }
+        }
+        std::map<CallSite, FunctionSet> ctx_callees;
+        std::map<FunctionContext, std::set<CallSite>> return_sites;
+        visitor.swapTables(&result->tables->results, &result->tables->top_level, &ctx_callees, &return_sites);
+        result->callees.swap(visitor.call_func_result);
+        for (auto ci = result->callees.begin(), ce = result->callees.end(); ci != ce; ci++)
+        {
+            for (Function *callee : ci->second)
+            {
+                result->callers[callee].push_back(ci->first);
+            }
+        }
+        for (auto di = degraded.begin(), de = degraded.end(); di != de; di++)
+        {
+            result->degraded[di->first] = getDataflowStatusName(di->second);
+        }
+        result->stats = stats;
+        return result;
+    }
+};
+
+std::unique_ptr<PointerAnalysisResult> PointerAnalysis::run(Module &M, const PointerAnalysisOptions &options,
+                                                            std::string *error)
+{
+    return AnalysisDriver(M, options).run(error);
+}
@@ -0,0 +1,153 @@
+/************************************************************************
+ *
+ * @file PointerAnalysis.h
+ *
+ * Library interface of the flow-sensitive analysis: runs it on a module
+ * and answers queries about function pointers from the result
+ *
+ ***********************************************************************/
+
+#ifndef _POINTERANALYSIS_H_
+#define _POINTERANALYSIS_H_
+
+#include <llvm/IR/Module.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+using namespace llvm;
+
+///
+/// Settings of one analysis, with the defaults of the command line tool.
+/// The budgets bound a single visit of a function; a function over
+/// budget is analysed flow-insensitively instead.
+///
+struct PointerAnalysisOptions
+{
+    unsigned context_depth;   // call-string depth for small pointer wrappers, 0 for context-insensitive
+    unsigned context_budget;  // calling contexts, 0 for unlimited
+    unsigned clone_max_insts; // largest function analysed per calling context
+    unsigned max_block_visits;
+    double max_seconds;
+    unsigned max_state_size;
+    bool slice_first;                      // analyse only what may affect an indirect callee
+    std::vector<std::string> entry_points; // empty for main and every externally visible function; callbacks
+                                           // handed to external code are entry points either way
+    bool lazy;                             // bodies are read, and put into SSA form, when first reached
+    std::vector<Module *> others;          // the rest of the program, linked through a symbol table
+    unsigned shards;                       // worker processes, each owning a part of the call graph, 0 or 1 for none
+    std::string cache_path;                // visit cache of the module, empty for none, see VisitCache
+    std::string *cache_buffer;             // if set, the visit cache is kept here rather than in a file
+    std::string checkpoint_path;           // where the analysis is checkpointed, empty for nowhere
+    double checkpoint_interval;            // seconds between two checkpoints, 0 for one after every visit
+    unsigned checkpoint_stop;              // stop after writing this many checkpoints, as if killed there, 0 for never
+    raw_ostream *log;                      // problems the analysis works around, null for none
+    PointerAnalysisOptions()
+        : context_depth(0), context_budget(1024), clone_max_insts(32), max_block_visits(0), max_seconds(0),
+          max_state_size(0), slice_first(false), entry_points(), lazy(false), others(), shards(0), cache_path(),
+          cache_buffer(nullptr), checkpoint_path(), checkpoint_interval(300), checkpoint_stop(0),
+          log(nullptr) {}
+};
+
+///
+/// What it took to reach the result. Each part is only filled in when the
+/// options asked for what it measures.
+///
+struct PointerAnalysisStats
+{
+    unsigned fast_path_resolved, indirect_calls; // indirect calls closed before the flow analysis
+    unsigned resolver_hits, resolver_misses;     // call targets reused from the memo of the resolver, or walked
+    double first_result_ms;                      // from the start until a call was first resolved, negative if none
+    std::vector<unsigned> shard_insts;           // instructions owned by each shard, if the sharded run succeeded
+    std::vector<double> shard_cpu_ms;
+    uint64_t shard_messages, shard_bytes;        // states exchanged between shards
+    unsigned cache_hits, cache_misses, cache_analysed;
+    uint64_t cache_saved_bytes;
+    bool resumed;                                // from a checkpoint
+    size_t resumed_queue;                        // functions queued at the checkpoint
+    unsigned checkpoints_written;
+    uint64_t checkpoint_bytes;                   // size of the last checkpoint
+    unsigned slice_insts, slice_relevant_insts, slice_relevant_functions;
+    PointerAnalysisStats()
+        : fast_path_resolved(0), indirect_calls(0), resolver_hits(0), resolver_misses(0), first_result_ms(-1), shard_insts(), shard_cpu_ms(), shard_messages(0),
+          shard_bytes(0), cache_hits(0), cache_misses(0), cache_analysed(0), cache_saved_bytes(0), resumed(false),
+          resumed_queue(0), checkpoints_written(0), checkpoint_bytes(0), slice_insts(0), slice_relevant_insts(0),
+          slice_relevant_functions(0) {}
+};
+
+///
+/// What the flow analysis found in a module. It is complete when
+/// PointerAnalysis::run returns it and never changes afterwards, so any
+/// number of threads may query it at once without locking. It refers to
+/// the IR of the module, which must outlive it unchanged.
+///
+class PointerAnalysisResult
+{
+public:
+    ~PointerAnalysisResult();
+
+    /// Whether the analysis reached the call; a reached call may still have no callees
+    bool isReached(const CallInst *call) const;
+
+    /// Functions the call may invoke, none if it was never reached
+    const std::set<Function *> &getCallees(const CallInst *call) const;
+
+    /// Every reached call with its callees, in no particular order
+    const std::map<CallInst *, std::set<Function *>> &getCallSites() const { return callees; }
+
+    /// Calls that may invoke F, in no particular order
+    const std::vector<CallInst *> &getCallers(const Function *F) const;
+
+    ///
+    /// The values the analysis binds v to just before at, over every
+    /// context the function of at was analysed in: the functions and
+    /// objects a pointer may hold, or what a stack slot or global may
+    /// contain. Empty if at was never reached or v is bound to nothing,
+    /// and after a sharded run, whose states stay in the workers.
+    ///
+    std::set<Value *> pointsTo(const Value *v, const Instruction *at) const;
+
+    /// The values bound to target just before at, the reverse of pointsTo
+    std::set<Value *> getPointersTo(const Value *target, const Instruction *at) const;
+
+    /// Whether some visit of F exceeded a budget and was made flow-insensitive
+    bool isDegraded(const Function *F) const;
+
+    /// The visits that exceeded a budget, by function and context, with the budget each exceeded
+    const std::map<std::pair<const Function *, unsigned>, std::string> &getDegradedVisits() const { return degraded; }
+
+    const PointerAnalysisStats &getStats() const { return stats; }
+
+private:
+    friend class PointerAnalysis;
+    friend class AnalysisDriver;
+    struct Tables; // dataflow values and top-level tables per context
+
+    std::map<CallInst *, std::set<Function *>> callees;
+    std::map<const Function *, std::vector<CallInst *>> callers;
+    std::map<std::pair<const Function *, unsigned>, std::string> degraded;
+    PointerAnalysisStats stats;
+    std::unique_ptr<Tables> tables;
+
+    PointerAnalysisResult();
+    Value *getRep(const Value *v) const;
+};
+
+///
+/// Runs the analysis the tool runs by default. The module must be in SSA
+/// form, as after mem2reg, and is read but not changed; bodies read
+/// lazily are put into SSA form as they are read.
+///
+class PointerAnalysis
+{
+public:
+    /// The result for M, or null with error set if an entry point has no body or the run stopped at a checkpoint
+    static std::unique_ptr<PointerAnalysisResult> run(Module &M, const PointerAnalysisOptions &options,
+                                                      std::string *error);
+};
+
+#endif /* !_POINTERANALYSIS_H_ */
@@ -0,0 +1,143 @@
+/************************************************************************
+ *
+ * @file PointerAnalysisTest.cpp
+ *
+ * Checks the library interface of PointerAnalysis.h on a small module:
+ * callees and callers of an indirect call, what its callee operand
+ * points to, calls never reached, and a visit over budget. Prints what
+ * differs and exits with 1, or exits with 0 if nothing does.
+ *
+ ***********************************************************************/
+
+#include <llvm/AsmParser/Parser.h>
+#include <llvm/IR/IntrinsicInst.h>
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/Support/SourceMgr.h>
+#include "PointerAnalysis.h"
+
+// 已经是SSA形式: run不做mem2reg
+static const char *Source = R"IR(
+define internal i32 @plus(i32 %a, i32 %b) {
+  %r = add i32 %a, %b
+  ret i32 %r
+}
+
+define internal i32 @minus(i32 %a, i32 %b) {
+  %r = sub i32 %a, %b
+  ret i32 %r
+}
+
+define internal i32 @apply(i32 (i32, i32)* %f, i32 %n) {
+entry:
+  br label %loop
+
+loop:
+  %i = phi i32 [ 0, %entry ], [ %next, %loop ]
+  %r = call i32 %f(i32 %i, i32 %n)
+  %next = add i32 %i, 1
+  %c = icmp slt i32 %next, %n
+  br i1 %c, label %loop, label %done
+
+done:
+  ret i32 %r
+}
+
+define internal i32 @unused() {
+  %r = call i32 @plus(i32 1, i32 2)
+  ret i32 %r
+}
+
+define i32 @main(i32 %argc) {
+  %c = icmp sgt i32 %argc, 1
+  %f = select i1 %c, i32 (i32, i32)* @plus, i32 (i32, i32)* @minus
+  %r = call i32 @apply(i32 (i32, i32)* %f, i32 %argc)
+  ret i32 %r
+}
+)IR";
+
+static unsigned failures = 0;
+
+static void expect(bool ok, const Twine &what)
+{
+    if (!ok)
+    {
+        errs() << "error: " << what << "\n";
+        failures++;
+    }
+}
+
+/// The first call in F that is not an intrinsic
+static CallInst *firstCall(Function *F)
+{
+    for (BasicBlock &BB : *F)
+    {
+        for (Instruction &I : BB)
+        {
+            auto *callInst = dyn_cast<CallInst>(&I);
+            if (callInst && !isa<IntrinsicInst>(callInst))
+                return callInst;
+        }
+    }
+    return nullptr;
+}
+
+static void check(Module &M, const PointerAnalysisOptions &options, bool degraded, const Twine &name)
+{
+    std::string error;
+    std::unique_ptr<PointerAnalysisResult> result = PointerAnalysis::run(M, options, &error);
+    if (!result)
+    {
+        expect(false, name + ": " + error);
+        return;
+    }
+    Function *plus = M.getFunction("plus");
+    Function *minus = M.getFunction("minus");
+    Function *apply = M.getFunction("apply");
+    CallInst *indirect = firstCall(apply);
+    CallInst *unused = firstCall(M.getFunction("unused"));
+
+    std::set<Function *> expected = {plus, minus};
+    expect(result->isReached(indirect), name + ": the call in apply is not reached");
+    expect(result->getCallees(indirect) == expected, name + ": the call in apply does not call plus and minus");
+
+    const std::vector<CallInst *> &callers = result->getCallers(minus);
+    expect(callers.size() == 1 && callers[0] == indirect, name + ": minus is not called from apply only");
+
+    std::set<Value *> pointees = result->pointsTo(indirect->getCalledValue(), indirect);
+    expect(pointees.count(plus) && pointees.count(minus), name + ": the callee of apply does not point to plus and minus");
+    std::set<Value *> pointers = result->getPointersTo(minus, indirect);
+    expect(pointers.count(&*apply->arg_begin()), name + ": the formal of apply does not hold minus");
+
+    expect(!result->isReached(unused), name + ": the call in unused is reached");
+    expect(result->getCallees(unused).empty(), name + ": the call in unused has callees");
+
+    expect(result->isDegraded(apply) == degraded,
+           name + (degraded ? ": apply was not degraded" : ": apply was degraded"));
+    expect(!result->isDegraded(M.getFunction("main")), name + ": main was degraded");
+    if (!degraded)
+    {
+        // 第二次访问循环块时, apply的实参还是同样的绑定
+        expect(result->getStats().resolver_hits > 0, name + ": the call targets in apply were never reused");
+    }
+}
+
+int main(int argc, char **argv)
+{
+    LLVMContext context;
+    SMDiagnostic err;
+    std::unique_ptr<Module> M = parseAssemblyString(Source, err, context);
+    if (!M)
+    {
+        err.print(argv[0], errs());
+        return 1;
+    }
+
+    PointerAnalysisOptions options;
+    check(*M, options, false, "default");
+
+    // 循环块的第二次访问就超出预算, apply改为流不敏感地分析, 结果仍然要完整
+    options.max_block_visits = 1;
+    check(*M, options, true, "max_block_visits=1");
+
+    return failures ? 1 : 0;
+}
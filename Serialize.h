@@ -0,0 +1,153 @@
+/************************************************************************
+ *
+ * @file Serialize.h
+ *
+ * Compact binary encoding of analysis data: unsigned LEB128 varints and
+ * length-prefixed strings
+ *
+ ***********************************************************************/
+
+#ifndef _SERIALIZE_H_
+#define _SERIALIZE_H_
+
+#include <llvm/ADT/ArrayRef.h>
+#include <llvm/ADT/StringRef.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/Path.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include <cstdint>
+#include <string>
+using namespace llvm;
+
+/// Appends varints and strings to a stream
+class ByteWriter
+{
+public:
+    ByteWriter(raw_ostream &out) : out(out) {}
+
+    void writeVarint(uint64_t value)
+    {
+        do
+        {
+            uint8_t byte = value & 0x7f;
+            value >>= 7;
+            if (value)
+            {
+                byte |= 0x80;
+            }
+            out << (char)byte;
+        } while (value);
+    }
+
+    void writeString(StringRef s)
+    {
+        writeVarint(s.size());
+        out << s;
+    }
+
+    void writeBytes(StringRef s) { out << s; }
+
+private:
+    raw_ostream &out;
+};
+
+///
+/// Reads what ByteWriter wrote from a buffer. Reading past the end or a
+/// malformed varint sets the error flag and yields zeros, so callers check
+/// hasError() once after reading a whole record.
+///
+class ByteReader
+{
+public:
+    ByteReader(StringRef buffer) : cur(buffer.begin()), end(buffer.end()), error(false) {}
+
+    uint64_t readVarint()
+    {
+        uint64_t value = 0;
+        for (unsigned shift = 0; shift < 64; shift += 7)
+        {
+            if (cur == end)
+            {
+                break;
+            }
+            uint8_t byte = *cur++;
+            value |= (uint64_t)(byte & 0x7f) << shift;
+            if (!(byte & 0x80))
+            {
+                return value;
+            }
+        }
+        error = true;
+        return 0;
+    }
+
+    std::string readString()
+    {
+        uint64_t size = readVarint();
+        if (error || size > (uint64_t)(end - cur))
+        {
+            error = true;
+            return std::string();
+        }
+        std::string s(cur, size);
+        cur += size;
+        return s;
+    }
+
+    /// Whether the next bytes are exactly s, consuming them if so
+    bool expectBytes(StringRef s)
+    {
+        if ((uint64_t)(end - cur) < s.size() || StringRef(cur, s.size()) != s)
+        {
+            error = true;
+            return false;
+        }
+        cur += s.size();
+        return true;
+    }
+
+    bool atEnd() const { return cur == end; }
+    bool hasError() const { return error; }
+
+private:
+    const char *cur, *end;
+    bool error;
+};
+
+///
+/// Replaces the file at path with the concatenation of parts. They are
+/// written to a temporary file first and renamed, so an interrupted write
+/// leaves the old file. The directory of path is created if needed.
+///
+inline bool writeFileAtomically(StringRef path, ArrayRef<StringRef> parts, std::string *error)
+{
+    std::error_code EC;
+    StringRef dir = sys::path::parent_path(path);
+    if (!dir.empty() && (EC = sys::fs::create_directories(dir)))
+    {
+        *error = EC.message();
+        return false;
+    }
+    std::string temp = (path + ".tmp").str();
+    {
+        raw_fd_ostream file(temp, EC, sys::fs::F_None);
+        if (EC)
+        {
+            *error = EC.message();
+            return false;
+        }
+        for (StringRef part : parts)
+        {
+            file << part;
+        }
+    }
+    if ((EC = sys::fs::rename(temp, path)))
+    {
+        *error = EC.message();
+        return false;
+    }
+    return true;
+}
+
+#endif /* !_SERIALIZE_H_ */
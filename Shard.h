@@ -0,0 +1,691 @@
+/************************************************************************
+ *
+ * @file Shard.h
+ *
+ * Flow-sensitive analysis split over forked worker processes, each
+ * owning a part of the call graph, exchanging states through pipes
+ *
+ ***********************************************************************/
+
+#ifndef _SHARD_H_
+#define _SHARD_H_
+
+#include <llvm/IR/Module.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/IntrinsicInst.h>
+
+#include "Dataflow.h"
+#include "Liveness.h"
+#include "Serialize.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <functional>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+using namespace llvm;
+
+// Workers are forked after the module is loaded, so every Value lives at
+// the same address in every process and is sent as that address.
+
+enum ShardMessageKind
+{
+    SM_Entry,  /// worker -> worker: entry state of a callee
+    SM_Exit,   /// worker -> worker: state after a call site
+    SM_Idle,   /// worker -> parent: worklist empty, with the number of states merged so far
+    SM_Done,   /// parent -> worker: global fixpoint reached
+    SM_Result  /// worker -> parent: call_func_result and degraded functions
+};
+
+inline void writePointer(ByteWriter &w, const void *p)
+{
+    w.writeVarint((uintptr_t)p);
+}
+
+template <class T>
+inline T *readPointer(ByteReader &r)
+{
+    return (T *)(uintptr_t)r.readVarint();
+}
+
+inline void writeValueMap(ByteWriter &w, const LiveVarsToMap &map)
+{
+    w.writeVarint(map.size());
+    for (auto ii = map.begin(), ie = map.end(); ii != ie; ii++)
+    {
+        writePointer(w, ii->first);
+        w.writeVarint(ii->second.size());
+        for (Value *v : ii->second)
+        {
+            writePointer(w, v);
+        }
+    }
+}
+
+inline void readValueMap(ByteReader &r, LiveVarsToMap *map)
+{
+    for (uint64_t i = 0, e = r.readVarint(); i != e && !r.hasError(); i++)
+    {
+        ValueSet &values = (*map)[readPointer<Value>(r)];
+        for (uint64_t j = 0, je = r.readVarint(); j != je && !r.hasError(); j++)
+        {
+            values.insert(readPointer<Value>(r));
+        }
+    }
+}
+
+inline void writeState(ByteWriter &w, const LivenessInfo &state)
+{
+    writeValueMap(w, state.LiveVars_map);
+    writeValueMap(w, state.LiveVars_feild_map);
+}
+
+inline void readState(ByteReader &r, LivenessInfo *state)
+{
+    readValueMap(r, &state->LiveVars_map);
+    readValueMap(r, &state->LiveVars_feild_map);
+}
+
+/// Union src into dest, true if dest grew
+inline bool unionState(LivenessInfo *dest, const LivenessInfo &src)
+{
+    bool changed = false;
+    const LiveVarsToMap *srcs[] = {&src.LiveVars_map, &src.LiveVars_feild_map};
+    LiveVarsToMap *dests[] = {&dest->LiveVars_map, &dest->LiveVars_feild_map};
+    for (unsigned k = 0; k < 2; k++)
+    {
+        for (auto ii = srcs[k]->begin(), ie = srcs[k]->end(); ii != ie; ii++)
+        {
+            auto di = dests[k]->find(ii->first);
+            if (di == dests[k]->end())
+            {
+                dests[k]->insert(*ii);
+                changed = true;
+                continue;
+            }
+            size_t old_size = di->second.size();
+            di->second.insert(ii->second.begin(), ii->second.end());
+            changed |= di->second.size() != old_size;
+        }
+    }
+    return changed;
+}
+
+/// Appends payload to buffer as a frame: its length as a varint, then itself
+inline void appendFrame(std::string *buffer, const std::string &payload)
+{
+    raw_string_ostream out(*buffer);
+    ByteWriter(out).writeVarint(payload.size());
+    out << payload;
+    out.flush();
+}
+
+/// Moves the first complete frame of buffer, from offset on, into payload
+inline bool takeFrame(std::string *buffer, size_t *offset, std::string *payload)
+{
+    uint64_t size = 0;
+    size_t pos = *offset;
+    for (unsigned shift = 0;; shift += 7)
+    {
+        if (pos == buffer->size() || shift >= 64)
+        {
+            return false;
+        }
+        uint8_t byte = (*buffer)[pos++];
+        size |= (uint64_t)(byte & 0x7f) << shift;
+        if (!(byte & 0x80))
+        {
+            break;
+        }
+    }
+    if (buffer->size() - pos < size)
+    {
+        return false;
+    }
+    payload->assign(*buffer, pos, size);
+    *offset = pos + size;
+    if (*offset == buffer->size())
+    {
+        buffer->clear();
+        *offset = 0;
+    }
+    else if (*offset > (1 << 20) && *offset > buffer->size() / 2)
+    {
+        buffer->erase(0, *offset);
+        *offset = 0;
+    }
+    return true;
+}
+
+inline bool writeAll(int fd, const std::string &data)
+{
+    for (size_t done = 0; done < data.size();)
+    {
+        ssize_t n = write(fd, data.data() + done, data.size() - done);
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n <= 0)
+        {
+            return false;
+        }
+        done += n;
+    }
+    return true;
+}
+
+///
+/// Splits the defined functions of M into shards of about the same number
+/// of instructions. Functions are laid out in depth-first order of the
+/// direct call graph from the entry points, then cut into consecutive
+/// runs, so a caller and its callees tend to stay in one process.
+///
+inline void partitionFunctions(Module &M, const std::vector<Function *> &entries, unsigned shards,
+                               std::map<Function *, unsigned> *owner, std::vector<unsigned> *insts)
+{
+    std::vector<Function *> order;
+    std::set<Function *> visited;
+    std::vector<Function *> roots(entries);
+    for (auto &F : M)
+    {
+        roots.push_back(&F);
+    }
+    for (Function *root : roots)
+    {
+        std::vector<Function *> stack(1, root);
+        while (!stack.empty())
+        {
+            Function *F = stack.back();
+            stack.pop_back();
+            if (F->isDeclaration() || !visited.insert(F).second)
+            {
+                continue;
+            }
+            order.push_back(F);
+            std::vector<Function *> callees;
+            for (inst_iterator ii = inst_begin(F), ie = inst_end(F); ii != ie; ii++)
+            {
+                auto *callInst = dyn_cast<CallInst>(&*ii);
+                if (!callInst || isa<IntrinsicInst>(callInst))
+                {
+                    continue;
+                }
+                if (auto *callee = dyn_cast<Function>(callInst->getCalledValue()->stripPointerCasts()))
+                {
+                    callees.push_back(callee);
+                }
+            }
+            // 先访问第一个callee
+            stack.insert(stack.end(), callees.rbegin(), callees.rend());
+        }
+    }
+
+    uint64_t total = 0;
+    std::vector<unsigned> sizes;
+    for (Function *F : order)
+    {
+        unsigned size = 0;
+        for (auto bi = F->begin(), be = F->end(); bi != be; bi++)
+        {
+            size += bi->size();
+        }
+        sizes.push_back(size);
+        total += size;
+    }
+    insts->assign(shards, 0);
+    uint64_t done = 0;
+    unsigned shard = 0;
+    for (unsigned i = 0, e = order.size(); i != e; i++)
+    {
+        // 当前shard达到平均份额就换下一个
+        while (shard + 1 < shards && done >= total * (shard + 1) / shards)
+        {
+            shard++;
+        }
+        (*owner)[order[i]] = shard;
+        (*insts)[shard] += sizes[i];
+        done += sizes[i];
+    }
+}
+
+///
+/// The worker side of a sharded run. States for functions of other shards
+/// go to the parent, which routes them to their owner. What was already
+/// sent for a call edge is remembered, since the owner only ever merges,
+/// so a state that adds nothing new is not sent again.
+///
+class ShardWorker : public StateExchange
+{
+public:
+    ShardWorker(unsigned id, const std::map<Function *, unsigned> &owner, int in, int out)
+        : id(id), owner(owner), in(in), out(out), inbuf(), inbuf_offset(0), outbuf(), sent_entries(),
+          sent_exits(), consumed(0), done(false), failed(false) {}
+
+    bool isLocal(Function *fn) override
+    {
+        auto it = owner.find(fn);
+        return it == owner.end() || it->second == id;
+    }
+
+    void sendEntry(const FunctionContext &callee, const CallSite &site, const LivenessInfo *state) override
+    {
+        auto key = std::make_pair(callee, site);
+        auto it = sent_entries.find(key);
+        bool is_new = it == sent_entries.end();
+        if (is_new)
+        {
+            it = sent_entries.insert(std::make_pair(key, LivenessInfo())).first;
+        }
+        if (!(state ? unionState(&it->second, *state) : false) && !is_new)
+        {
+            return;
+        }
+        std::string payload;
+        raw_string_ostream os(payload);
+        ByteWriter w(os);
+        w.writeVarint(SM_Entry);
+        w.writeVarint(owner.find(callee.first)->second);
+        writePointer(w, callee.first);
+        w.writeVarint(callee.second);
+        writePointer(w, site.first);
+        w.writeVarint(site.second);
+        w.writeVarint(state != nullptr);
+        if (state)
+        {
+            writeState(w, *state);
+        }
+        os.flush();
+        appendFrame(&outbuf, payload);
+    }
+
+    void sendExit(const FunctionContext &callee, const CallSite &site, const LivenessInfo &state) override
+    {
+        LivenessInfo &sent = sent_exits[std::make_pair(callee, site)];
+        if (!unionState(&sent, state))
+        {
+            return;
+        }
+        std::string payload;
+        raw_string_ostream os(payload);
+        ByteWriter w(os);
+        w.writeVarint(SM_Exit);
+        w.writeVarint(owner.find(site.first->getFunction())->second);
+        writePointer(w, site.first);
+        w.writeVarint(site.second);
+        writeState(w, state);
+        os.flush();
+        appendFrame(&outbuf, payload);
+    }
+
+    /// Writes the states sent since the last flush
+    bool flush()
+    {
+        if (outbuf.empty())
+        {
+            return true;
+        }
+        bool ok = writeAll(out, outbuf);
+        outbuf.clear();
+        return ok;
+    }
+
+    void sendIdle()
+    {
+        std::string payload;
+        raw_string_ostream os(payload);
+        ByteWriter w(os);
+        w.writeVarint(SM_Idle);
+        w.writeVarint(consumed);
+        os.flush();
+        appendFrame(&outbuf, payload);
+        flush();
+    }
+
+    /// Sends the worker's results, and the CPU time it used in microseconds
+    void sendResult(const std::map<CallInst *, FunctionSet> &call_func_result,
+                    const std::map<FunctionContext, DataflowStatus> &degraded, uint64_t cpu_us)
+    {
+        std::string payload;
+        raw_string_ostream os(payload);
+        ByteWriter w(os);
+        w.writeVarint(SM_Result);
+        w.writeVarint(cpu_us);
+        w.writeVarint(call_func_result.size());
+        for (auto ci = call_func_result.begin(), ce = call_func_result.end(); ci != ce; ci++)
+        {
+            writePointer(w, ci->first);
+            w.writeVarint(ci->second.size());
+            for (Function *F : ci->second)
+            {
+                writePointer(w, F);
+            }
+        }
+        w.writeVarint(degraded.size());
+        for (auto di = degraded.begin(), de = degraded.end(); di != de; di++)
+        {
+            writePointer(w, di->first.first);
+            w.writeVarint(di->first.second);
+            w.writeVarint(di->second);
+        }
+        os.flush();
+        appendFrame(&outbuf, payload);
+        flush();
+    }
+
+    ///
+    /// Merges the states that arrived into visitor. With wait, blocks
+    /// until something arrives. False if the parent is gone.
+    ///
+    bool receive(LivenessVisitor *visitor, bool wait)
+    {
+        std::string payload;
+        bool applied = false;
+        while (!done)
+        {
+            while (!done && takeFrame(&inbuf, &inbuf_offset, &payload))
+            {
+                apply(visitor, payload);
+                applied = true;
+            }
+            if (done || failed)
+            {
+                break;
+            }
+            struct pollfd pfd = {in, POLLIN, 0};
+            int ready = poll(&pfd, 1, wait && !applied ? -1 : 0);
+            if (ready < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (ready <= 0)
+            {
+                break;
+            }
+            char chunk[65536];
+            ssize_t n = read(in, chunk, sizeof(chunk));
+            if (n < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (n <= 0)
+            {
+                failed = true;
+                break;
+            }
+            inbuf.append(chunk, n);
+        }
+        return !failed;
+    }
+
+    unsigned getConsumed() const { return consumed; }
+    bool isDone() const { return done; }
+
+private:
+    unsigned id;
+    const std::map<Function *, unsigned> &owner;
+    int in, out;
+    std::string inbuf;
+    size_t inbuf_offset;
+    std::string outbuf;
+    std::map<std::pair<FunctionContext, CallSite>, LivenessInfo> sent_entries;
+    std::map<std::pair<FunctionContext, CallSite>, LivenessInfo> sent_exits;
+    unsigned consumed; // states merged, reported with SM_Idle
+    bool done, failed;
+
+    void apply(LivenessVisitor *visitor, const std::string &payload)
+    {
+        ByteReader r(payload);
+        uint64_t kind = r.readVarint();
+        if (kind == SM_Done)
+        {
+            done = true;
+            return;
+        }
+        r.readVarint(); // destination
+        if (kind == SM_Entry)
+        {
+            Function *callee = readPointer<Function>(r);
+            unsigned callee_ctx = r.readVarint();
+            CallInst *callInst = readPointer<CallInst>(r);
+            unsigned site_ctx = r.readVarint();
+            bool has_state = r.readVarint();
+            LivenessInfo state;
+            if (has_state)
+            {
+                readState(r, &state);
+            }
+            visitor->receiveEntry(std::make_pair(callee, callee_ctx), std::make_pair(callInst, site_ctx),
+                                  has_state ? &state : nullptr);
+        }
+        else if (kind == SM_Exit)
+        {
+            CallInst *callInst = readPointer<CallInst>(r);
+            unsigned site_ctx = r.readVarint();
+            LivenessInfo state;
+            readState(r, &state);
+            visitor->receiveExit(std::make_pair(callInst, site_ctx), state);
+        }
+        consumed++;
+    }
+};
+
+///
+/// The parent side of a sharded run: forks the workers, routes the states
+/// they send each other, and detects the global fixpoint. Every worker
+/// reports idle with the number of states it has merged; once all are
+/// idle and have merged every state routed to them, nothing is in flight
+/// and nothing can change any more.
+///
+class ShardCoordinator
+{
+public:
+    ShardCoordinator() : num_messages(0), num_bytes(0) {}
+
+    ///
+    /// Runs worker(id, in, out) in n forked processes and collects the
+    /// payload of the SM_Result each one sends when told to finish.
+    ///
+    bool run(unsigned n, const std::function<bool(unsigned, int, int)> &worker, std::vector<std::string> *results)
+    {
+        std::vector<pid_t> pids;
+        std::vector<int> to_worker, from_worker;
+        for (unsigned w = 0; w < n; w++)
+        {
+            int down[2], up[2];
+            if (pipe(down) || pipe(up))
+            {
+                errs() << "cannot create pipes for shard " << w << "\n";
+                killWorkers(pids);
+                return false;
+            }
+            pid_t pid = fork();
+            if (pid < 0)
+            {
+                errs() << "cannot fork shard " << w << "\n";
+                killWorkers(pids);
+                return false;
+            }
+            if (pid == 0)
+            {
+                for (unsigned v = 0; v < w; v++)
+                {
+                    close(to_worker[v]);
+                    close(from_worker[v]);
+                }
+                close(down[1]);
+                close(up[0]);
+                // 不运行析构函数, 它们属于父进程
+                _exit(worker(w, down[0], up[1]) ? 0 : 1);
+            }
+            close(down[0]);
+            close(up[1]);
+            fcntl(down[1], F_SETFL, fcntl(down[1], F_GETFL) | O_NONBLOCK);
+            pids.push_back(pid);
+            to_worker.push_back(down[1]);
+            from_worker.push_back(up[0]);
+        }
+
+        // 某个子进程提前退出时, 写它的管道应该出错而不是杀掉这个进程
+        struct sigaction ignore, saved_sigpipe;
+        memset(&ignore, 0, sizeof(ignore));
+        ignore.sa_handler = SIG_IGN;
+        sigaction(SIGPIPE, &ignore, &saved_sigpipe);
+
+        std::vector<std::string> inbuf(n), outbuf(n);
+        std::vector<size_t> inbuf_offset(n, 0);
+        std::vector<unsigned> routed(n, 0), consumed(n, 0);
+        std::vector<bool> idle(n, false), finished(n, false);
+        results->assign(n, std::string());
+        unsigned num_finished = 0;
+        bool done = false, ok = true;
+        std::string payload;
+        while (ok && num_finished < n)
+        {
+            std::vector<struct pollfd> fds;
+            for (unsigned w = 0; w < n; w++)
+            {
+                struct pollfd in = {from_worker[w], POLLIN, 0};
+                struct pollfd out = {to_worker[w], (short)(outbuf[w].empty() ? 0 : POLLOUT), 0};
+                fds.push_back(in);
+                fds.push_back(out);
+            }
+            if (poll(fds.data(), fds.size(), -1) < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                ok = false;
+                break;
+            }
+            for (unsigned w = 0; w < n && ok; w++)
+            {
+                if (fds[2 * w + 1].revents & (POLLOUT | POLLERR))
+                {
+                    ssize_t written = write(to_worker[w], outbuf[w].data(), outbuf[w].size());
+                    if (written > 0)
+                        outbuf[w].erase(0, written);
+                    else if (written < 0 && errno != EAGAIN && errno != EINTR)
+                        ok = false;
+                }
+                if (finished[w] || !(fds[2 * w].revents & (POLLIN | POLLHUP | POLLERR)))
+                {
+                    continue;
+                }
+                char chunk[65536];
+                ssize_t count = read(from_worker[w], chunk, sizeof(chunk));
+                if (count < 0 && errno == EINTR)
+                {
+                    continue;
+                }
+                if (count <= 0)
+                {
+                    errs() << "shard " << w << " exited before the analysis finished\n";
+                    ok = false;
+                    break;
+                }
+                inbuf[w].append(chunk, count);
+                while (takeFrame(&inbuf[w], &inbuf_offset[w], &payload))
+                {
+                    ByteReader r(payload);
+                    uint64_t kind = r.readVarint();
+                    if (kind == SM_Entry || kind == SM_Exit)
+                    {
+                        uint64_t dest = r.readVarint();
+                        if (r.hasError() || dest >= n)
+                        {
+                            errs() << "shard " << w << " sent a state to a shard that does not exist\n";
+                            ok = false;
+                            break;
+                        }
+                        appendFrame(&outbuf[dest], payload);
+                        routed[dest]++;
+                        idle[dest] = false;
+                        num_messages++;
+                        num_bytes += payload.size();
+                    }
+                    else if (kind == SM_Idle)
+                    {
+                        idle[w] = true;
+                        consumed[w] = r.readVarint();
+                    }
+                    else if (kind == SM_Result && !finished[w])
+                    {
+                        (*results)[w].swap(payload);
+                        finished[w] = true;
+                        num_finished++;
+                    }
+                }
+            }
+            if (!done && isFixpoint(idle, routed, consumed))
+            {
+                done = true;
+                std::string done_payload;
+                raw_string_ostream os(done_payload);
+                ByteWriter(os).writeVarint(SM_Done);
+                os.flush();
+                for (unsigned w = 0; w < n; w++)
+                {
+                    appendFrame(&outbuf[w], done_payload);
+                }
+            }
+        }
+
+        for (unsigned w = 0; w < n; w++)
+        {
+            close(to_worker[w]);
+            close(from_worker[w]);
+        }
+        sigaction(SIGPIPE, &saved_sigpipe, nullptr);
+        if (!ok)
+        {
+            killWorkers(pids);
+            return false;
+        }
+        for (pid_t pid : pids)
+        {
+            int status;
+            waitpid(pid, &status, 0);
+            ok &= WIFEXITED(status) && WEXITSTATUS(status) == 0;
+        }
+        return ok;
+    }
+
+    /// States routed between workers, and their size in bytes
+    uint64_t getNumMessages() const { return num_messages; }
+    uint64_t getNumBytes() const { return num_bytes; }
+
+private:
+    uint64_t num_messages, num_bytes;
+
+    static bool isFixpoint(const std::vector<bool> &idle, const std::vector<unsigned> &routed,
+                           const std::vector<unsigned> &consumed)
+    {
+        for (unsigned w = 0, e = idle.size(); w != e; w++)
+        {
+            if (!idle[w] || consumed[w] != routed[w])
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    static void killWorkers(const std::vector<pid_t> &pids)
+    {
+        for (pid_t pid : pids)
+        {
+            kill(pid, SIGKILL);
+            waitpid(pid, nullptr, 0);
+        }
+    }
+};
+
+#endif /* !_SHARD_H_ */
@@ -0,0 +1,247 @@
+/************************************************************************
+ *
+ * @file Slice.h
+ *
+ * Backward slice of a module from the called values of indirect calls
+ *
+ ***********************************************************************/
+
+#ifndef _SLICE_H_
+#define _SLICE_H_
+
+#include <llvm/IR/Module.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/IntrinsicInst.h>
+#include <llvm/IR/InstIterator.h>
+
+#include <map>
+#include <set>
+#include <vector>
+using namespace llvm;
+
+///
+/// What the slice needs from a pointer pre-analysis: the abstract objects a
+/// pointer value may point to, and the functions a call may reach.
+///
+class SliceOracle
+{
+public:
+    virtual ~SliceOracle() {}
+    virtual void getPointees(Value *pointer, std::vector<unsigned> *objects) = 0;
+    virtual void getCallees(CallInst *callInst, std::vector<Function *> *callees) = 0;
+};
+
+///
+/// Instructions that may affect the value of an indirect call's callee.
+/// The slice follows SSA operands backwards, from formals to the arguments
+/// of the calls that may bind them, from call results to the callees'
+/// returns, and from a load to every store or memcpy that may write one of
+/// the objects it reads, with aliasing taken from a pre-analysis.
+///
+/// A function is relevant if it holds a relevant instruction or calls a
+/// relevant function, since the flow-sensitive state reaches a callee only
+/// through its callers. Calls and returns of relevant functions are always
+/// analysed; everything else outside the slice transfers its state as is.
+///
+class RelevanceSlice
+{
+public:
+    RelevanceSlice() : relevant(), relevant_funcs(), num_insts(0) {}
+
+    void compute(Module &M, SliceOracle *oracle)
+    {
+        // 被调函数和调用点的双向索引
+        std::map<CallInst *, std::vector<Function *>> targets;
+        std::map<Function *, std::vector<CallInst *>> callers;
+        std::vector<unsigned> objects;
+        for (auto &F : M)
+        {
+            for (inst_iterator ii = inst_begin(&F), ie = inst_end(&F); ii != ie; ii++)
+            {
+                auto *callInst = dyn_cast<CallInst>(&*ii);
+                if (!callInst || isa<IntrinsicInst>(callInst))
+                {
+                    continue;
+                }
+                std::vector<Function *> &callees = targets[callInst];
+                oracle->getCallees(callInst, &callees);
+                for (Function *callee : callees)
+                {
+                    callers[callee].push_back(callInst);
+                }
+            }
+        }
+
+        // 每个对象可能被哪些store/memcpy写
+        std::map<unsigned, std::vector<Instruction *>> writers;
+        std::vector<Value *> worklist;
+        num_insts = 0;
+        for (auto &F : M)
+        {
+            for (inst_iterator ii = inst_begin(&F), ie = inst_end(&F); ii != ie; ii++)
+            {
+                Instruction *inst = &*ii;
+                num_insts++;
+                Value *dest = nullptr;
+                if (auto *storeInst = dyn_cast<StoreInst>(inst))
+                {
+                    dest = storeInst->getPointerOperand();
+                }
+                else if (auto *memCpyInst = dyn_cast<MemCpyInst>(inst))
+                {
+                    dest = memCpyInst->getArgOperand(0);
+                }
+                else if (auto *callInst = dyn_cast<CallInst>(inst))
+                {
+                    Value *value = callInst->getCalledValue();
+                    if (!isa<IntrinsicInst>(callInst) && !isa<Function>(value->stripPointerCasts()))
+                    {
+                        relevant.insert(callInst);
+                        worklist.push_back(value);
+                    }
+                }
+                if (dest)
+                {
+                    objects.clear();
+                    oracle->getPointees(dest, &objects);
+                    for (unsigned o : objects)
+                    {
+                        writers[o].push_back(inst);
+                    }
+                }
+            }
+        }
+
+        std::set<Value *> visited;
+        std::set<unsigned> read_objects;
+        while (!worklist.empty())
+        {
+            Value *v = worklist.back();
+            worklist.pop_back();
+            if (!visited.insert(v).second)
+            {
+                continue;
+            }
+            std::vector<Value *> reads; // pointers whose pointees are read
+            if (auto *arg = dyn_cast<Argument>(v))
+            {
+                std::vector<CallInst *> &sites = callers[arg->getParent()];
+                for (CallInst *callInst : sites)
+                {
+                    relevant.insert(callInst);
+                    if (arg->getArgNo() < callInst->getNumArgOperands())
+                    {
+                        worklist.push_back(callInst->getArgOperand(arg->getArgNo()));
+                    }
+                }
+                continue;
+            }
+            auto *inst = dyn_cast<Instruction>(v);
+            if (!inst)
+            {
+                continue;
+            }
+            relevant.insert(inst);
+            if (auto *loadInst = dyn_cast<LoadInst>(inst))
+            {
+                worklist.push_back(loadInst->getPointerOperand());
+                reads.push_back(loadInst->getPointerOperand());
+            }
+            else if (auto *storeInst = dyn_cast<StoreInst>(inst))
+            {
+                worklist.push_back(storeInst->getPointerOperand());
+                worklist.push_back(storeInst->getValueOperand());
+            }
+            else if (auto *memCpyInst = dyn_cast<MemCpyInst>(inst))
+            {
+                worklist.push_back(memCpyInst->getArgOperand(0));
+                worklist.push_back(memCpyInst->getArgOperand(1));
+                reads.push_back(memCpyInst->getArgOperand(1));
+            }
+            else if (auto *callInst = dyn_cast<CallInst>(inst))
+            {
+                std::vector<Function *> &callees = targets[callInst];
+                for (Function *callee : callees)
+                {
+                    for (inst_iterator ii = inst_begin(callee), ie = inst_end(callee); ii != ie; ii++)
+                    {
+                        if (auto *returnInst = dyn_cast<ReturnInst>(&*ii))
+                        {
+                            relevant.insert(returnInst);
+                            if (returnInst->getReturnValue())
+                            {
+                                worklist.push_back(returnInst->getReturnValue());
+                            }
+                        }
+                    }
+                }
+            }
+            else if (isa<PHINode>(inst) || isa<SelectInst>(inst) || isa<CastInst>(inst) || isa<GetElementPtrInst>(inst))
+            {
+                for (Value *operand : inst->operands())
+                {
+                    worklist.push_back(operand);
+                }
+            }
+
+            for (Value *pointer : reads)
+            {
+                objects.clear();
+                oracle->getPointees(pointer, &objects);
+                for (unsigned o : objects)
+                {
+                    if (!read_objects.insert(o).second)
+                    {
+                        continue;
+                    }
+                    std::vector<Instruction *> &insts = writers[o];
+                    worklist.insert(worklist.end(), insts.begin(), insts.end());
+                }
+            }
+        }
+
+        // 相关函数的调用者也相关, 状态要经过它们才能到达
+        std::vector<Function *> func_worklist;
+        for (Instruction *inst : relevant)
+        {
+            func_worklist.push_back(inst->getFunction());
+        }
+        while (!func_worklist.empty())
+        {
+            Function *func = func_worklist.back();
+            func_worklist.pop_back();
+            if (!relevant_funcs.insert(func).second)
+            {
+                continue;
+            }
+            std::vector<CallInst *> &sites = callers[func];
+            for (CallInst *callInst : sites)
+            {
+                func_worklist.push_back(callInst->getFunction());
+            }
+        }
+    }
+
+    /// Whether the flow-sensitive analysis has to transfer inst
+    bool isRelevant(Instruction *inst) const
+    {
+        if (isa<ReturnInst>(inst) || (isa<CallInst>(inst) && !isa<IntrinsicInst>(inst)))
+        {
+            return true;
+        }
+        return relevant.count(inst);
+    }
+
+    bool isRelevant(Function *func) const { return relevant_funcs.count(func); }
+
+    unsigned getNumRelevantInsts() const { return relevant.size(); }
+    unsigned getNumInsts() const { return num_insts; }
+    unsigned getNumRelevantFunctions() const { return relevant_funcs.size(); }
+
+private:
+    std::set<Instruction *> relevant;
+    std::set<Function *> relevant_funcs;
+    unsigned num_insts;
+};
+
+#endif /* !_SLICE_H_ */
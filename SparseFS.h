@@ -0,0 +1,962 @@
+/************************************************************************
+ *
+ * @file SparseFS.h
+ *
+ * Staged sparse flow-sensitive pointer analysis: an Andersen pre-analysis
+ * yields may-alias sets, those build def-use chains over memory objects,
+ * and the flow-sensitive solve only follows those chains.
+ *
+ ***********************************************************************/
+
+#ifndef _SPARSEFS_H_
+#define _SPARSEFS_H_
+
+#include "Andersen.h"
+
+#include <llvm/ADT/PostOrderIterator.h>
+#include <llvm/IR/CFG.h>
+
+#include <deque>
+#include <map>
+#include <set>
+#include <vector>
+using namespace llvm;
+
+enum MemDefKind
+{
+    MD_Entry,  /// contents of an object when its function is entered
+    MD_Store,  /// a store that may write the object
+    MD_MemCpy, /// a memcpy that may write the object
+    MD_Call    /// a call whose callees may write the object
+};
+
+///
+/// One definition of the contents of one abstract object. Every def except
+/// MD_Entry also reads the old contents, i.e. the defs in reaching, so a
+/// weak update or a call that leaves the object alone passes them on.
+///
+struct MemDef
+{
+    MemDefKind kind;
+    Function *fn;
+    Instruction *inst; /// nullptr for MD_Entry
+    unsigned obj;
+    std::vector<unsigned> reaching;
+    SparseBitVector<> out;
+
+    MemDef(MemDefKind kind, Function *fn, Instruction *inst, unsigned obj)
+        : kind(kind), fn(fn), inst(inst), obj(obj), reaching(), out() {}
+};
+
+///
+/// Flow-sensitive analysis that never copies a whole state from one
+/// program point to the next:
+///   1. an Andersen pre-analysis gives every pointer a may-alias set;
+///   2. for every function, the objects it may touch (directly or through
+///      its callees) get def-use chains, with a def at every store, memcpy
+///      and call that may write them and a use at every load, memcpy and
+///      return that may read them;
+///   3. points-to sets of objects flow only along those chains, while SSA
+///      pointers keep a single flow-insensitive set each.
+/// Stores through a pointer to exactly one single-slot object are strong
+/// updates.
+///
+class SparseFlowSensitiveAnalysis
+{
+public:
+    std::map<CallInst *, FunctionSet> call_func_result;
+
+    SparseFlowSensitiveAnalysis()
+        : call_func_result(), graph(), builder(&graph), object_values(), object_init(), pre_callees(),
+          relevant(), defs(), entry_defs(), inst_defs(), inst_def_list(), uses(), def_users(),
+          def_inst_users(), top(), callers(), returns(), strong_targets(), value_worklist(), value_queued(),
+          def_worklist(), empty() {}
+
+    void run(Module &M)
+    {
+        // stage 1: flow-insensitive pre-analysis
+        builder.build(M);
+        substitutePointerEquivalents(&graph);
+        AndersenSolver solver(graph);
+        solver.solve();
+
+        // stage 2: memory def-use chains over the pre-analysis' may-alias sets
+        collectObjects();
+        for (unsigned i = 0, e = graph.calls.size(); i != e; i++)
+        {
+            FunctionSet &callees = pre_callees[graph.calls[i].inst];
+            const std::set<unsigned> &targets = solver.getCallTargets(i);
+            for (unsigned target : targets)
+            {
+                callees.insert(graph.functions[target].func);
+            }
+        }
+        computeRelevantObjects(M, solver);
+        for (auto &F : M)
+        {
+            if (!F.isDeclaration())
+            {
+                buildDefUse(&F, solver);
+            }
+        }
+        indexDefUsers();
+
+        // stage 3: sparse flow-sensitive propagation
+        propagate(M);
+    }
+
+    void printCallFuncResult(raw_ostream &out = errs())
+    {
+        ::printCallFuncResult(call_func_result, out);
+    }
+
+    /// Number of memory defs and def-use edges built by stage 2
+    unsigned getNumMemDefs() const { return defs.size(); }
+    unsigned getNumDefUseEdges() const
+    {
+        unsigned edges = 0;
+        for (const MemDef &def : defs)
+        {
+            edges += def.reaching.size();
+        }
+        for (auto ui = uses.begin(), ue = uses.end(); ui != ue; ui++)
+        {
+            edges += ui->second.size();
+        }
+        return edges;
+    }
+
+private:
+    typedef std::pair<Instruction *, unsigned> InstObject;
+    typedef std::map<unsigned, std::set<unsigned>> ReachingDefs; // object -> reaching defs
+
+    ConstraintGraph graph;
+    ConstraintBuilder builder;
+    std::map<unsigned, Value *> object_values;           // object node -> allocation site
+    std::map<unsigned, SparseBitVector<>> object_init;   // initial contents of global objects
+    std::map<CallInst *, FunctionSet> pre_callees;       // call graph of the pre-analysis
+    std::map<Function *, SparseBitVector<>> relevant;    // objects a function may touch
+
+    std::vector<MemDef> defs;
+    std::map<std::pair<Function *, unsigned>, unsigned> entry_defs;
+    std::map<InstObject, unsigned> inst_defs;
+    std::map<Instruction *, std::vector<unsigned>> inst_def_list;
+    std::map<InstObject, std::vector<unsigned>> uses; // defs read by a load, memcpy or return
+    std::vector<std::vector<unsigned>> def_users;
+    std::vector<std::vector<Instruction *>> def_inst_users;
+
+    std::map<Value *, SparseBitVector<>> top; // points-to sets of SSA pointers
+    std::map<Function *, std::set<CallInst *>> callers;
+    std::map<Function *, std::vector<ReturnInst *>> returns;
+    std::map<unsigned, bool> strong_targets;
+    std::deque<Value *> value_worklist;
+    std::set<Value *> value_queued;
+    std::set<unsigned> def_worklist; // by ID, which follows the CFG within a function
+    const SparseBitVector<> empty;
+
+    /********************************** stage 2 **********************************/
+
+    void collectObjects()
+    {
+        for (auto oi = builder.object_nodes.begin(), oe = builder.object_nodes.end(); oi != oe; oi++)
+        {
+            object_values[oi->second] = oi->first;
+        }
+        for (const Constraint &c : graph.constraints)
+        {
+            // initializers are the only address-of constraints into an object
+            if (c.kind == CK_AddrOf && object_values.count(c.dst))
+            {
+                object_init[c.dst].set(c.src);
+            }
+        }
+    }
+
+    const SparseBitVector<> &getPrePointsTo(AndersenSolver &solver, Value *v)
+    {
+        unsigned node = builder.lookupValueNode(v);
+        return node ? solver.getPointsTo(node) : empty;
+    }
+
+    ///
+    /// Objects read or written by fn itself, plus those of its callees. A
+    /// stack object only lives while its function is active, so it is
+    /// relevant only to that function and to the functions it may call;
+    /// the pre-analysis merges the stack objects of all callers into the
+    /// formals, and without this limit they would reach every caller of a
+    /// callee, giving each call site a def for each of them.
+    ///
+    void computeRelevantObjects(Module &M, AndersenSolver &solver)
+    {
+        for (auto &F : M)
+        {
+            if (F.isDeclaration())
+            {
+                continue;
+            }
+            SparseBitVector<> &objs = relevant[&F];
+            for (inst_iterator ii = inst_begin(&F), ie = inst_end(&F); ii != ie; ii++)
+            {
+                Instruction *inst = &*ii;
+                if (auto *memCpyInst = dyn_cast<MemCpyInst>(inst))
+                {
+                    objs |= getPrePointsTo(solver, memCpyInst->getArgOperand(0));
+                    objs |= getPrePointsTo(solver, memCpyInst->getArgOperand(1));
+                }
+                else if (auto *storeInst = dyn_cast<StoreInst>(inst))
+                {
+                    if (ConstraintBuilder::isPointerLike(storeInst->getValueOperand()->getType()))
+                        objs |= getPrePointsTo(solver, storeInst->getPointerOperand());
+                }
+                else if (auto *loadInst = dyn_cast<LoadInst>(inst))
+                {
+                    if (ConstraintBuilder::isPointerLike(loadInst->getType()))
+                        objs |= getPrePointsTo(solver, loadInst->getPointerOperand());
+                }
+            }
+        }
+
+        // 栈对象只对所属函数和它(间接)调用的函数可见
+        SparseBitVector<> stack_objs;
+        std::map<Function *, SparseBitVector<>> visible_stack;
+        std::map<Function *, SparseBitVector<>> owned;
+        for (auto oi = object_values.begin(), oe = object_values.end(); oi != oe; oi++)
+        {
+            if (auto *allocaInst = dyn_cast<AllocaInst>(oi->second))
+            {
+                stack_objs.set(oi->first);
+                owned[allocaInst->getFunction()].set(oi->first);
+            }
+        }
+        std::map<Function *, std::set<Function *>> callee_lists;
+        for (auto ci = pre_callees.begin(), ce = pre_callees.end(); ci != ce; ci++)
+        {
+            callee_lists[ci->first->getFunction()].insert(ci->second.begin(), ci->second.end());
+        }
+        for (auto oi = owned.begin(), oe = owned.end(); oi != oe; oi++)
+        {
+            std::set<Function *> visited;
+            std::vector<Function *> worklist(1, oi->first);
+            while (!worklist.empty())
+            {
+                Function *fn = worklist.back();
+                worklist.pop_back();
+                if (!visited.insert(fn).second)
+                {
+                    continue;
+                }
+                visible_stack[fn] |= oi->second;
+                auto li = callee_lists.find(fn);
+                if (li != callee_lists.end())
+                {
+                    worklist.insert(worklist.end(), li->second.begin(), li->second.end());
+                }
+            }
+        }
+
+        bool changed = true;
+        while (changed)
+        {
+            changed = false;
+            for (auto ci = pre_callees.begin(), ce = pre_callees.end(); ci != ce; ci++)
+            {
+                Function *caller = ci->first->getFunction();
+                SparseBitVector<> &objs = relevant[caller];
+                for (Function *callee : ci->second)
+                {
+                    if (callee->isDeclaration())
+                    {
+                        continue;
+                    }
+                    SparseBitVector<> callee_objs = relevant[callee];
+                    callee_objs.intersectWithComplement(stack_objs);
+                    SparseBitVector<> callee_stack = relevant[callee] & visible_stack[caller];
+                    callee_objs |= callee_stack;
+                    if (objs |= callee_objs)
+                    {
+                        changed = true;
+                    }
+                }
+            }
+        }
+    }
+
+    unsigned getDef(MemDefKind kind, Function *fn, Instruction *inst, unsigned obj)
+    {
+        unsigned &d = inst ? inst_defs[std::make_pair(inst, obj)] : entry_defs[std::make_pair(fn, obj)];
+        if (!d)
+        {
+            // ID 0 is never handed out, so it marks a def not created yet
+            if (defs.empty())
+            {
+                defs.push_back(MemDef(MD_Entry, nullptr, nullptr, 0));
+            }
+            d = defs.size();
+            defs.push_back(MemDef(kind, fn, inst, obj));
+            if (inst)
+            {
+                inst_def_list[inst].push_back(d);
+            }
+        }
+        return d;
+    }
+
+    void readObjects(Instruction *inst, const SparseBitVector<> &objs, ReachingDefs *state)
+    {
+        for (unsigned o : objs)
+        {
+            const std::set<unsigned> &reaching = (*state)[o];
+            uses[std::make_pair(inst, o)].assign(reaching.begin(), reaching.end());
+        }
+    }
+
+    void writeObjects(MemDefKind kind, Instruction *inst, const SparseBitVector<> &objs, ReachingDefs *state)
+    {
+        for (unsigned o : objs)
+        {
+            std::set<unsigned> &reaching = (*state)[o];
+            unsigned d = getDef(kind, inst->getFunction(), inst, o);
+            defs[d].reaching.assign(reaching.begin(), reaching.end());
+            reaching.clear();
+            reaching.insert(d);
+        }
+    }
+
+    void transfer(Instruction *inst, AndersenSolver &solver, ReachingDefs *state)
+    {
+        if (auto *memCpyInst = dyn_cast<MemCpyInst>(inst))
+        {
+            readObjects(inst, getPrePointsTo(solver, memCpyInst->getArgOperand(1)), state);
+            writeObjects(MD_MemCpy, inst, getPrePointsTo(solver, memCpyInst->getArgOperand(0)), state);
+        }
+        else if (isa<IntrinsicInst>(inst))
+        {
+            return;
+        }
+        else if (auto *callInst = dyn_cast<CallInst>(inst))
+        {
+            SparseBitVector<> objs;
+            const FunctionSet &callees = pre_callees[callInst];
+            for (Function *callee : callees)
+            {
+                if (!callee->isDeclaration())
+                    objs |= relevant[callee];
+            }
+            // 调用者看不到的对象(其他函数的栈对象)不需要def
+            objs &= relevant[inst->getFunction()];
+            writeObjects(MD_Call, inst, objs, state);
+        }
+        else if (auto *storeInst = dyn_cast<StoreInst>(inst))
+        {
+            if (ConstraintBuilder::isPointerLike(storeInst->getValueOperand()->getType()))
+                writeObjects(MD_Store, inst, getPrePointsTo(solver, storeInst->getPointerOperand()), state);
+        }
+        else if (auto *loadInst = dyn_cast<LoadInst>(inst))
+        {
+            if (ConstraintBuilder::isPointerLike(loadInst->getType()))
+                readObjects(inst, getPrePointsTo(solver, loadInst->getPointerOperand()), state);
+        }
+        else if (isa<ReturnInst>(inst))
+        {
+            readObjects(inst, relevant[inst->getFunction()], state);
+        }
+    }
+
+    ///
+    /// Reaching definitions of every relevant object of fn, iterated over
+    /// the CFG in reverse post order; the last round records the def-use
+    /// chains, as the sets only grow.
+    ///
+    void buildDefUse(Function *fn, AndersenSolver &solver)
+    {
+        const SparseBitVector<> &objs = relevant[fn];
+        if (objs.empty())
+        {
+            return;
+        }
+        ReachingDefs entry;
+        for (unsigned o : objs)
+        {
+            entry[o].insert(getDef(MD_Entry, fn, nullptr, o));
+        }
+
+        std::map<BasicBlock *, ReachingDefs> block_out;
+        ReversePostOrderTraversal<Function *> rpot(fn);
+        bool changed = true;
+        while (changed)
+        {
+            changed = false;
+            for (BasicBlock *block : rpot)
+            {
+                ReachingDefs state;
+                if (block == &fn->getEntryBlock())
+                {
+                    state = entry;
+                }
+                for (BasicBlock *pred : predecessors(block))
+                {
+                    auto it = block_out.find(pred);
+                    if (it == block_out.end())
+                    {
+                        continue;
+                    }
+                    for (auto di = it->second.begin(), de = it->second.end(); di != de; di++)
+                    {
+                        state[di->first].insert(di->second.begin(), di->second.end());
+                    }
+                }
+                for (Instruction &inst : *block)
+                {
+                    transfer(&inst, solver, &state);
+                }
+                ReachingDefs &out = block_out[block];
+                if (out != state)
+                {
+                    out.swap(state);
+                    changed = true;
+                }
+            }
+        }
+    }
+
+    void indexDefUsers()
+    {
+        def_users.resize(defs.size());
+        def_inst_users.resize(defs.size());
+        for (unsigned d = 0, e = defs.size(); d != e; d++)
+        {
+            for (unsigned r : defs[d].reaching)
+            {
+                def_users[r].push_back(d);
+            }
+        }
+        for (auto ui = uses.begin(), ue = uses.end(); ui != ue; ui++)
+        {
+            for (unsigned r : ui->second)
+            {
+                def_inst_users[r].push_back(ui->first.first);
+            }
+        }
+    }
+
+    /********************************** stage 3 **********************************/
+
+    const SparseBitVector<> &getPointsTo(Value *v)
+    {
+        auto it = top.find(ConstraintBuilder::stripConstantCasts(v));
+        return it == top.end() ? empty : it->second;
+    }
+
+    SparseBitVector<> getContents(const std::vector<unsigned> &reaching)
+    {
+        SparseBitVector<> contents;
+        for (unsigned d : reaching)
+        {
+            contents |= defs[d].out;
+        }
+        return contents;
+    }
+
+    SparseBitVector<> getUseContents(Instruction *inst, unsigned obj)
+    {
+        auto it = uses.find(std::make_pair(inst, obj));
+        return it == uses.end() ? SparseBitVector<>() : getContents(it->second);
+    }
+
+    /// Number of pointers an object of type holds, saturating at 2
+    static unsigned countPointerSlots(Type *type)
+    {
+        if (type->isPointerTy())
+        {
+            return 1;
+        }
+        if (auto *structType = dyn_cast<StructType>(type))
+        {
+            unsigned slots = 0;
+            for (Type *element : structType->elements())
+            {
+                slots = std::min(2u, slots + countPointerSlots(element));
+            }
+            return slots;
+        }
+        if (auto *arrayType = dyn_cast<ArrayType>(type))
+        {
+            unsigned slots = countPointerSlots(arrayType->getElementType());
+            return arrayType->getNumElements() > 1 ? std::min(2u, 2 * slots) : slots;
+        }
+        return 0;
+    }
+
+    /// True if block may execute more than once per call of its function
+    static bool isInCycle(BasicBlock *block)
+    {
+        std::set<BasicBlock *> visited;
+        std::vector<BasicBlock *> worklist(succ_begin(block), succ_end(block));
+        while (!worklist.empty())
+        {
+            BasicBlock *bb = worklist.back();
+            worklist.pop_back();
+            if (bb == block)
+            {
+                return true;
+            }
+            if (visited.insert(bb).second)
+            {
+                worklist.insert(worklist.end(), succ_begin(bb), succ_end(bb));
+            }
+        }
+        return false;
+    }
+
+    ///
+    /// An object that holds at most one pointer and stands for one memory
+    /// location per call, so a store through a pointer to it alone
+    /// overwrites it. Heap objects qualify when allocated outside of loops
+    /// and only ever accessed as such a slot.
+    ///
+    bool isStrongUpdateTarget(unsigned obj)
+    {
+        auto it = strong_targets.find(obj);
+        if (it != strong_targets.end())
+        {
+            return it->second;
+        }
+        bool strong = false;
+        Value *v = object_values[obj];
+        if (auto *allocaInst = dyn_cast<AllocaInst>(v))
+        {
+            strong = !allocaInst->isArrayAllocation() && countPointerSlots(allocaInst->getAllocatedType()) <= 1;
+        }
+        else if (auto *global = dyn_cast<GlobalVariable>(v))
+        {
+            strong = countPointerSlots(global->getValueType()) <= 1;
+        }
+        else if (auto *callInst = dyn_cast<CallInst>(v))
+        {
+            // 堆对象没有声明的类型, 看它经过bitcast之后被怎样访问
+            strong = !isInCycle(callInst->getParent());
+            std::vector<Value *> worklist(1, callInst);
+            while (strong && !worklist.empty())
+            {
+                Value *ptr = worklist.back();
+                worklist.pop_back();
+                for (User *user : ptr->users())
+                {
+                    Type *accessed = nullptr;
+                    if (isa<BitCastInst>(user))
+                    {
+                        worklist.push_back(user);
+                    }
+                    else if (auto *gep = dyn_cast<GetElementPtrInst>(user))
+                    {
+                        accessed = gep->getSourceElementType();
+                    }
+                    else if (auto *loadInst = dyn_cast<LoadInst>(user))
+                    {
+                        accessed = loadInst->getType();
+                    }
+                    else if (auto *storeInst = dyn_cast<StoreInst>(user))
+                    {
+                        accessed = storeInst->getPointerOperand() == ptr ? storeInst->getValueOperand()->getType() : nullptr;
+                    }
+                    if (accessed && countPointerSlots(accessed) > 1)
+                    {
+                        strong = false;
+                    }
+                }
+            }
+        }
+        strong_targets[obj] = strong;
+        return strong;
+    }
+
+    void pushValue(Value *v)
+    {
+        if (value_queued.insert(v).second)
+        {
+            value_worklist.push_back(v);
+        }
+    }
+
+    void pushDef(unsigned d)
+    {
+        def_worklist.insert(d);
+    }
+
+    void pushInstDefs(Instruction *inst)
+    {
+        auto it = inst_def_list.find(inst);
+        if (it != inst_def_list.end())
+        {
+            for (unsigned d : it->second)
+            {
+                pushDef(d);
+            }
+        }
+    }
+
+    void pushEntryDef(Function *fn, unsigned obj)
+    {
+        auto it = entry_defs.find(std::make_pair(fn, obj));
+        if (it != entry_defs.end())
+        {
+            pushDef(it->second);
+        }
+    }
+
+    void pushFormals(Function *fn)
+    {
+        for (auto ai = fn->arg_begin(), ae = fn->arg_end(); ai != ae; ai++)
+        {
+            if (ai->getType()->isPointerTy())
+            {
+                pushValue(&*ai);
+            }
+        }
+    }
+
+    /// Bind the callees of callInst its called value points to now
+    void resolveCall(CallInst *callInst)
+    {
+        Value *value = ConstraintBuilder::stripConstantCasts(callInst->getCalledValue());
+        FunctionSet targets;
+        if (Function *func = dyn_cast<Function>(value))
+        {
+            targets.insert(func);
+        }
+        else
+        {
+            for (unsigned o : getPointsTo(value))
+            {
+                auto fi = graph.functions.find(o);
+                if (fi != graph.functions.end())
+                {
+                    targets.insert(fi->second.func);
+                }
+            }
+        }
+
+        FunctionSet &callees = call_func_result[callInst];
+        for (Function *callee : targets)
+        {
+            if (!callees.insert(callee).second)
+            {
+                continue;
+            }
+            callers[callee].insert(callInst);
+            pushValue(callInst);
+            pushInstDefs(callInst);
+            pushFormals(callee);
+            auto ri = relevant.find(callee);
+            if (ri != relevant.end())
+            {
+                for (unsigned o : ri->second)
+                {
+                    pushEntryDef(callee, o);
+                }
+            }
+        }
+    }
+
+    SparseBitVector<> evalValue(Value *v)
+    {
+        SparseBitVector<> pts;
+        if (auto *arg = dyn_cast<Argument>(v))
+        {
+            const std::set<CallInst *> &sites = callers[arg->getParent()];
+            for (CallInst *callInst : sites)
+            {
+                if (arg->getArgNo() < callInst->getNumArgOperands())
+                    pts |= getPointsTo(callInst->getArgOperand(arg->getArgNo()));
+            }
+        }
+        else if (isa<AllocaInst>(v))
+        {
+            pts.set(builder.object_nodes[v]);
+        }
+        else if (auto *getElementPtrInst = dyn_cast<GetElementPtrInst>(v))
+        {
+            pts |= getPointsTo(getElementPtrInst->getPointerOperand());
+        }
+        else if (auto *bitCastInst = dyn_cast<BitCastInst>(v))
+        {
+            pts |= getPointsTo(bitCastInst->getOperand(0));
+        }
+        else if (auto *phiNode = dyn_cast<PHINode>(v))
+        {
+            for (Value *value : phiNode->incoming_values())
+            {
+                pts |= getPointsTo(value);
+            }
+        }
+        else if (auto *selectInst = dyn_cast<SelectInst>(v))
+        {
+            pts |= getPointsTo(selectInst->getTrueValue());
+            pts |= getPointsTo(selectInst->getFalseValue());
+        }
+        else if (auto *loadInst = dyn_cast<LoadInst>(v))
+        {
+            for (unsigned o : getPointsTo(loadInst->getPointerOperand()))
+            {
+                pts |= getUseContents(loadInst, o);
+            }
+        }
+        else if (auto *callInst = dyn_cast<CallInst>(v))
+        {
+            const FunctionSet &callees = call_func_result[callInst];
+            for (Function *callee : callees)
+            {
+                if (callee->isDeclaration())
+                {
+                    auto oi = builder.object_nodes.find(callInst);
+                    if (oi != builder.object_nodes.end())
+                        pts.set(oi->second);
+                    continue;
+                }
+                const std::vector<ReturnInst *> &rets = returns[callee];
+                for (ReturnInst *returnInst : rets)
+                {
+                    if (returnInst->getReturnValue())
+                        pts |= getPointsTo(returnInst->getReturnValue());
+                }
+            }
+        }
+        return pts;
+    }
+
+    SparseBitVector<> evalDef(unsigned d)
+    {
+        const MemDef &def = defs[d];
+        SparseBitVector<> in = getContents(def.reaching);
+        SparseBitVector<> out;
+        switch (def.kind)
+        {
+        case MD_Entry:
+        {
+            auto ii = object_init.find(def.obj);
+            if (ii != object_init.end())
+            {
+                out = ii->second;
+            }
+            const std::set<CallInst *> &sites = callers[def.fn];
+            for (CallInst *callInst : sites)
+            {
+                auto it = inst_defs.find(std::make_pair(callInst, def.obj));
+                if (it != inst_defs.end())
+                {
+                    out |= getContents(defs[it->second].reaching);
+                }
+            }
+            break;
+        }
+        case MD_Store:
+        {
+            auto *storeInst = cast<StoreInst>(def.inst);
+            const SparseBitVector<> &ptr = getPointsTo(storeInst->getPointerOperand());
+            const SparseBitVector<> &value = getPointsTo(storeInst->getValueOperand());
+            if (!ptr.test(def.obj))
+            {
+                out = in;
+            }
+            else if (ptr.count() == 1 && isStrongUpdateTarget(def.obj))
+            {
+                out = value;
+            }
+            else
+            {
+                out = in;
+                out |= value;
+            }
+            break;
+        }
+        case MD_MemCpy:
+        {
+            auto *memCpyInst = cast<MemCpyInst>(def.inst);
+            out = in;
+            if (getPointsTo(memCpyInst->getArgOperand(0)).test(def.obj))
+            {
+                for (unsigned o : getPointsTo(memCpyInst->getArgOperand(1)))
+                {
+                    out |= getUseContents(memCpyInst, o);
+                }
+            }
+            break;
+        }
+        case MD_Call:
+        {
+            const FunctionSet &callees = call_func_result[cast<CallInst>(def.inst)];
+            bool pass = callees.empty();
+            for (Function *callee : callees)
+            {
+                if (callee->isDeclaration() || !relevant[callee].test(def.obj))
+                {
+                    // 被调用函数不涉及该对象, 内容原样传过调用点
+                    pass = true;
+                    continue;
+                }
+                const std::vector<ReturnInst *> &rets = returns[callee];
+                for (ReturnInst *returnInst : rets)
+                {
+                    out |= getUseContents(returnInst, def.obj);
+                }
+            }
+            if (pass)
+            {
+                out |= in;
+            }
+            break;
+        }
+        }
+        return out;
+    }
+
+    void valueChanged(Value *v)
+    {
+        for (User *user : v->users())
+        {
+            Instruction *inst = dyn_cast<Instruction>(user);
+            if (!inst)
+            {
+                continue;
+            }
+            if (isa<StoreInst>(inst) || isa<MemCpyInst>(inst))
+            {
+                pushInstDefs(inst);
+            }
+            else if (isa<IntrinsicInst>(inst))
+            {
+                continue;
+            }
+            else if (auto *callInst = dyn_cast<CallInst>(inst))
+            {
+                resolveCall(callInst);
+                const FunctionSet &callees = call_func_result[callInst];
+                for (Function *callee : callees)
+                {
+                    pushFormals(callee);
+                }
+            }
+            else if (isa<ReturnInst>(inst))
+            {
+                const std::set<CallInst *> &sites = callers[inst->getFunction()];
+                for (CallInst *callInst : sites)
+                {
+                    pushValue(callInst);
+                }
+            }
+            else
+            {
+                pushValue(inst);
+            }
+        }
+    }
+
+    void defChanged(unsigned d)
+    {
+        for (unsigned user : def_users[d])
+        {
+            pushDef(user);
+            if (defs[user].kind == MD_Call)
+            {
+                // the def is part of what the callees see on entry
+                const FunctionSet &callees = call_func_result[cast<CallInst>(defs[user].inst)];
+                for (Function *callee : callees)
+                {
+                    pushEntryDef(callee, defs[user].obj);
+                }
+            }
+        }
+        for (Instruction *inst : def_inst_users[d])
+        {
+            if (isa<LoadInst>(inst))
+            {
+                pushValue(inst);
+            }
+            else if (isa<MemCpyInst>(inst))
+            {
+                pushInstDefs(inst);
+            }
+            else if (isa<ReturnInst>(inst))
+            {
+                const std::set<CallInst *> &sites = callers[inst->getFunction()];
+                for (CallInst *callInst : sites)
+                {
+                    auto it = inst_defs.find(std::make_pair(callInst, defs[d].obj));
+                    if (it != inst_defs.end())
+                    {
+                        pushDef(it->second);
+                    }
+                }
+            }
+        }
+    }
+
+    ///
+    /// Worklist over SSA pointers and memory defs, SSA pointers first. SSA
+    /// sets only grow; a def is recomputed from scratch so that a strong
+    /// update can drop the contents it overwrites.
+    ///
+    void propagate(Module &M)
+    {
+        for (auto vi = builder.object_nodes.begin(), ve = builder.object_nodes.end(); vi != ve; vi++)
+        {
+            if (isa<GlobalValue>(vi->first))
+            {
+                top[vi->first].set(vi->second);
+            }
+        }
+        for (auto &F : M)
+        {
+            if (F.isDeclaration())
+            {
+                continue;
+            }
+            pushFormals(&F);
+            for (inst_iterator ii = inst_begin(&F), ie = inst_end(&F); ii != ie; ii++)
+            {
+                Instruction *inst = &*ii;
+                if (auto *returnInst = dyn_cast<ReturnInst>(inst))
+                {
+                    returns[&F].push_back(returnInst);
+                }
+                else if (ConstraintBuilder::isPointerLike(inst->getType()))
+                {
+                    pushValue(inst);
+                }
+            }
+        }
+        for (unsigned d = 0, e = defs.size(); d != e; d++)
+        {
+            pushDef(d);
+        }
+        for (const CallConstraint &call : graph.calls)
+        {
+            resolveCall(call.inst);
+        }
+
+        while (!value_worklist.empty() || !def_worklist.empty())
+        {
+            if (!value_worklist.empty())
+            {
+                Value *v = value_worklist.front();
+                value_worklist.pop_front();
+                value_queued.erase(v);
+                if (top[v] |= evalValue(v))
+                {
+                    valueChanged(v);
+                }
+                continue;
+            }
+            unsigned d = *def_worklist.begin();
+            def_worklist.erase(def_worklist.begin());
+            SparseBitVector<> out = evalDef(d);
+            if (out != defs[d].out)
+            {
+                defs[d].out = out;
+                defChanged(d);
+            }
+        }
+    }
+};
+
+#endif /* !_SPARSEFS_H_ */
@@ -0,0 +1,242 @@
+/************************************************************************
+ *
+ * @file Steensgaard.h
+ *
+ * Unification-based (Steensgaard-style) pointer analysis
+ *
+ ***********************************************************************/
+
+#ifndef _STEENSGAARD_H_
+#define _STEENSGAARD_H_
+
+#include "Andersen.h"
+
+#include <set>
+#include <vector>
+using namespace llvm;
+
+///
+/// Solves the same constraint graph as AndersenSolver, but by unification:
+/// every equivalence class of nodes has at most one pointee class, and
+/// every constraint joins classes instead of adding subset edges. Apart
+/// from re-binding calls whose callee class grew, this is a single pass
+/// over the constraints with union-find, so time and memory stay close to
+/// linear.
+///
+class SteensgaardSolver
+{
+public:
+    SteensgaardSolver(const ConstraintGraph &graph)
+        : graph(graph), parent(), size(), pointee(), funcs(), call_bound() {}
+
+    void solve()
+    {
+        for (unsigned n = 0; n < graph.num_nodes; n++)
+        {
+            addClass();
+        }
+        for (auto fi = graph.functions.begin(), fe = graph.functions.end(); fi != fe; fi++)
+        {
+            funcs[fi->first].push_back(fi->first);
+        }
+        for (unsigned n = 1, e = graph.equiv.size(); n < e; n++)
+        {
+            if (graph.equiv[n] != n)
+            {
+                join(n, graph.equiv[n]);
+            }
+        }
+
+        for (const Constraint &c : graph.constraints)
+        {
+            switch (c.kind)
+            {
+            case CK_AddrOf:
+                join(deref(c.dst), c.src);
+                break;
+            case CK_Copy:
+                join(deref(c.dst), deref(c.src));
+                break;
+            case CK_Load:
+                join(deref(c.dst), deref(deref(c.src)));
+                break;
+            case CK_Store:
+                join(deref(deref(c.dst)), deref(c.src));
+                break;
+            }
+        }
+
+        // binding a call may grow the callee class of another call
+        call_bound.resize(graph.calls.size());
+        bool changed = true;
+        while (changed)
+        {
+            changed = false;
+            for (unsigned i = 0, e = graph.calls.size(); i != e; i++)
+            {
+                const CallConstraint &call = graph.calls[i];
+                if (!call.callee)
+                {
+                    continue;
+                }
+                std::vector<unsigned> targets = funcs[find(deref(call.callee))];
+                for (unsigned func : targets)
+                {
+                    if (call_bound[i].insert(func).second)
+                    {
+                        bindCall(call, graph.functions.find(func)->second);
+                        changed = true;
+                    }
+                }
+            }
+        }
+    }
+
+    /// Object nodes of the functions called by graph.calls[call]
+    std::set<unsigned> getCallTargets(unsigned call)
+    {
+        const CallConstraint &c = graph.calls[call];
+        std::set<unsigned> targets;
+        if (c.callee)
+        {
+            const std::vector<unsigned> &f = funcs[find(deref(c.callee))];
+            targets.insert(f.begin(), f.end());
+        }
+        return targets;
+    }
+
+    /// Class of node n once solved
+    unsigned getClass(unsigned n) { return find(n); }
+
+    /// Class of the nodes n may point to once solved, 0 if n points to nothing
+    unsigned getPointeeClass(unsigned n)
+    {
+        n = find(n);
+        return pointee[n] ? find(pointee[n]) : 0;
+    }
+
+private:
+    const ConstraintGraph &graph;
+    std::vector<unsigned> parent, size;
+    std::vector<unsigned> pointee;           // pointee class of a class, 0 if none yet
+    std::vector<std::vector<unsigned>> funcs; // function objects in a class
+    std::vector<std::set<unsigned>> call_bound;
+
+    unsigned addClass()
+    {
+        unsigned n = parent.size();
+        parent.push_back(n);
+        size.push_back(1);
+        pointee.push_back(0);
+        funcs.push_back(std::vector<unsigned>());
+        return n;
+    }
+
+    unsigned find(unsigned n)
+    {
+        while (parent[n] != n)
+        {
+            parent[n] = parent[parent[n]];
+            n = parent[n];
+        }
+        return n;
+    }
+
+    /// Pointee class of n, created on first use
+    unsigned deref(unsigned n)
+    {
+        n = find(n);
+        if (!pointee[n])
+        {
+            unsigned p = addClass();
+            pointee[n] = p;
+        }
+        return find(pointee[n]);
+    }
+
+    void join(unsigned a, unsigned b)
+    {
+        std::vector<std::pair<unsigned, unsigned>> pending(1, std::make_pair(a, b));
+        while (!pending.empty())
+        {
+            a = find(pending.back().first);
+            b = find(pending.back().second);
+            pending.pop_back();
+            if (a == b)
+            {
+                continue;
+            }
+            if (size[a] < size[b])
+            {
+                std::swap(a, b);
+            }
+            parent[b] = a;
+            size[a] += size[b];
+            funcs[a].insert(funcs[a].end(), funcs[b].begin(), funcs[b].end());
+            std::vector<unsigned>().swap(funcs[b]);
+            if (!pointee[a])
+            {
+                pointee[a] = pointee[b];
+            }
+            else if (pointee[b])
+            {
+                pending.push_back(std::make_pair(pointee[a], pointee[b]));
+            }
+        }
+    }
+
+    void bindCall(const CallConstraint &call, const FunctionNodes &fn)
+    {
+        for (unsigned i = 0, e = std::min(call.args.size(), fn.formals.size()); i != e; i++)
+        {
+            if (call.args[i] && fn.formals[i])
+            {
+                join(deref(fn.formals[i]), deref(call.args[i]));
+            }
+        }
+        if (call.ret && fn.ret)
+        {
+            join(deref(call.ret), deref(fn.ret));
+        }
+    }
+};
+
+///
+/// Steensgaard-style analysis of a whole module, filling call_func_result
+/// for every call instruction.
+///
+class SteensgaardAnalysis
+{
+public:
+    std::map<CallInst *, FunctionSet> call_func_result;
+
+    SteensgaardAnalysis() : call_func_result(), graph(), builder(&graph) {}
+
+    void run(Module &M)
+    {
+        builder.build(M);
+        substitutePointerEquivalents(&graph);
+        SteensgaardSolver solver(graph);
+        solver.solve();
+        for (unsigned i = 0, e = graph.calls.size(); i != e; i++)
+        {
+            FunctionSet &callees = call_func_result[graph.calls[i].inst];
+            std::set<unsigned> targets = solver.getCallTargets(i);
+            for (unsigned target : targets)
+            {
+                callees.insert(graph.functions[target].func);
+            }
+        }
+    }
+
+    void printCallFuncResult(raw_ostream &out = errs())
+    {
+        ::printCallFuncResult(call_func_result, out);
+    }
+
+private:
+    ConstraintGraph graph;
+    ConstraintBuilder builder;
+};
+
+#endif /* !_STEENSGAARD_H_ */
@@ -0,0 +1,568 @@
+/************************************************************************
+ *
+ * @file Summary.h
+ *
+ * Per-module pointer summaries and a global index that resolves
+ * indirect calls across modules from the summaries alone
+ *
+ ***********************************************************************/
+
+#ifndef _SUMMARY_H_
+#define _SUMMARY_H_
+
+#include <llvm/IR/Module.h>
+#include <llvm/IR/Instructions.h>
+
+#include "Andersen.h"
+#include "Serialize.h"
+
+#include <algorithm>
+#include <map>
+#include <set>
+#include <string>
+#include <tuple>
+#include <vector>
+using namespace llvm;
+
+/// How a symbol takes part in cross-module resolution, weakest first
+enum SymbolLinkage
+{
+    SL_Local,       /// internal or private, never bound across modules
+    SL_Declaration, /// stands for a definition in some other module
+    SL_Weak,        /// a definition the linker may replace
+    SL_Strong       /// a definition
+};
+
+/// A function of the module, in module order; node is 0 if it is never used
+struct FunctionRecord
+{
+    std::string name;
+    SymbolLinkage linkage;
+    unsigned node;                 /// object node
+    std::vector<unsigned> formals; /// 0 for parameters that are not pointers
+    unsigned ret;                  /// 0 if the function does not return a pointer
+    FunctionRecord() : name(), linkage(SL_Local), node(0), formals(), ret(0) {}
+};
+
+/// An external global variable and its object node
+struct GlobalRecord
+{
+    std::string name;
+    SymbolLinkage linkage;
+    unsigned node;
+    GlobalRecord() : name(), linkage(SL_Local), node(0) {}
+};
+
+///
+/// A call site. When the callee is an external declaration, heap is the
+/// object the call returns if no module defines the callee (malloc and
+/// friends), and external is that declaration's index in functions plus 1.
+///
+struct CallRecord
+{
+    unsigned line;
+    unsigned callee;
+    std::vector<unsigned> args; /// 0 for arguments that are not pointers
+    unsigned ret;               /// 0 if the result is not a pointer
+    unsigned heap;
+    unsigned external;
+    CallRecord() : line(0), callee(0), args(), ret(0), heap(0), external(0) {}
+};
+
+///
+/// The pointer effects of one module on its own: the constraints of its
+/// functions over nodes local to the summary, the interface nodes through
+/// which they reach parameters and return values, and the object nodes of
+/// the external symbols through which they reach other modules' globals
+/// and functions. Pointer-equivalent nodes are merged before the summary
+/// is written, so it is usually much smaller than the constraint graph.
+///
+struct ModuleSummary
+{
+    std::string module_id;
+    unsigned num_nodes;
+    std::vector<Constraint> constraints;
+    std::vector<FunctionRecord> functions;
+    std::vector<GlobalRecord> globals;
+    std::vector<CallRecord> calls;
+    ModuleSummary() : module_id(), num_nodes(1), constraints(), functions(), globals(), calls() {}
+};
+
+inline SymbolLinkage getSymbolLinkage(const GlobalValue *gv)
+{
+    if (gv->hasLocalLinkage() || !gv->hasName())
+    {
+        return SL_Local;
+    }
+    if (gv->isDeclaration())
+    {
+        return SL_Declaration;
+    }
+    return gv->isWeakForLinker() ? SL_Weak : SL_Strong;
+}
+
+/// Phase one: summarizes M, which must be in SSA form
+inline void buildModuleSummary(Module &M, ModuleSummary *summary)
+{
+    ConstraintGraph graph;
+    ConstraintBuilder builder(&graph);
+    // 其他模块可能调用任何定义, 所以每个定义都要有接口结点
+    for (auto &F : M)
+    {
+        if (!F.isDeclaration())
+        {
+            builder.getObjectNode(&F);
+        }
+    }
+    builder.build(M);
+    substitutePointerEquivalents(&graph);
+
+    // The heap object of a call to an external declaration only exists if
+    // no other module defines the callee, so it is left to the index.
+    std::map<Function *, unsigned> func_index;
+    unsigned position = 0;
+    for (auto &F : M)
+    {
+        func_index[&F] = position++;
+    }
+    std::map<unsigned, unsigned> heap_calls; // heap object -> call
+    for (unsigned i = 0, e = graph.calls.size(); i != e; i++)
+    {
+        CallInst *callInst = graph.calls[i].inst;
+        auto *func = dyn_cast<Function>(ConstraintBuilder::stripConstantCasts(callInst->getCalledValue()));
+        auto it = builder.object_nodes.find(callInst);
+        if (func && func->isDeclaration() && it != builder.object_nodes.end())
+        {
+            heap_calls[it->second] = i;
+        }
+    }
+
+    // Number the representatives that are still used, in order
+    std::vector<unsigned> compact(graph.num_nodes, 0);
+    summary->num_nodes = 1;
+    auto node = [&](unsigned n) -> unsigned {
+        if (!n)
+        {
+            return 0;
+        }
+        unsigned &c = compact[graph.equiv[n]];
+        if (!c)
+        {
+            c = summary->num_nodes++;
+        }
+        return c;
+    };
+
+    summary->module_id = M.getModuleIdentifier();
+    std::set<std::tuple<unsigned, unsigned, unsigned>> seen;
+    for (const Constraint &c : graph.constraints)
+    {
+        if (c.kind == CK_AddrOf && heap_calls.count(c.src))
+        {
+            continue;
+        }
+        unsigned dst = node(c.dst), src = node(c.src);
+        if ((c.kind == CK_Copy && dst == src) || !seen.insert(std::make_tuple(c.kind, dst, src)).second)
+        {
+            continue;
+        }
+        summary->constraints.push_back(Constraint(c.kind, dst, src));
+    }
+    for (auto &F : M)
+    {
+        FunctionRecord fs;
+        fs.name = F.getName().str();
+        fs.linkage = getSymbolLinkage(&F);
+        auto it = builder.object_nodes.find(&F);
+        if (it != builder.object_nodes.end())
+        {
+            const FunctionNodes &fn = graph.functions[it->second];
+            fs.node = node(it->second);
+            for (unsigned formal : fn.formals)
+            {
+                fs.formals.push_back(node(formal));
+            }
+            fs.ret = node(fn.ret);
+        }
+        summary->functions.push_back(fs);
+    }
+    for (auto &G : M.globals())
+    {
+        auto it = builder.object_nodes.find(&G);
+        if (getSymbolLinkage(&G) == SL_Local || it == builder.object_nodes.end())
+        {
+            continue;
+        }
+        GlobalRecord gs;
+        gs.name = G.getName().str();
+        gs.linkage = getSymbolLinkage(&G);
+        gs.node = node(it->second);
+        summary->globals.push_back(gs);
+    }
+    for (const CallConstraint &call : graph.calls)
+    {
+        CallRecord cs;
+        cs.line = call.inst->getDebugLoc().getLine();
+        cs.callee = node(call.callee);
+        for (unsigned arg : call.args)
+        {
+            cs.args.push_back(node(arg));
+        }
+        cs.ret = node(call.ret);
+        auto it = builder.object_nodes.find(call.inst);
+        if (it != builder.object_nodes.end() && heap_calls.count(it->second))
+        {
+            cs.heap = node(it->second);
+            auto *func = cast<Function>(ConstraintBuilder::stripConstantCasts(call.inst->getCalledValue()));
+            cs.external = func_index[func] + 1;
+        }
+        summary->calls.push_back(cs);
+    }
+}
+
+static const char SummaryMagic[] = "FPSUM";
+static const unsigned SummaryVersion = 1;
+
+inline void writeModuleSummary(const ModuleSummary &summary, raw_ostream &out)
+{
+    ByteWriter w(out);
+    w.writeBytes(SummaryMagic);
+    w.writeVarint(SummaryVersion);
+    w.writeString(summary.module_id);
+    w.writeVarint(summary.num_nodes);
+    w.writeVarint(summary.constraints.size());
+    for (const Constraint &c : summary.constraints)
+    {
+        w.writeVarint(c.kind);
+        w.writeVarint(c.dst);
+        w.writeVarint(c.src);
+    }
+    w.writeVarint(summary.functions.size());
+    for (const FunctionRecord &fs : summary.functions)
+    {
+        w.writeString(fs.name);
+        w.writeVarint(fs.linkage);
+        w.writeVarint(fs.node);
+        w.writeVarint(fs.formals.size());
+        for (unsigned formal : fs.formals)
+        {
+            w.writeVarint(formal);
+        }
+        w.writeVarint(fs.ret);
+    }
+    w.writeVarint(summary.globals.size());
+    for (const GlobalRecord &gs : summary.globals)
+    {
+        w.writeString(gs.name);
+        w.writeVarint(gs.linkage);
+        w.writeVarint(gs.node);
+    }
+    w.writeVarint(summary.calls.size());
+    for (const CallRecord &cs : summary.calls)
+    {
+        w.writeVarint(cs.line);
+        w.writeVarint(cs.callee);
+        w.writeVarint(cs.args.size());
+        for (unsigned arg : cs.args)
+        {
+            w.writeVarint(arg);
+        }
+        w.writeVarint(cs.ret);
+        w.writeVarint(cs.heap);
+        w.writeVarint(cs.external);
+    }
+}
+
+///
+/// Reads a summary written by writeModuleSummary. Every node and function
+/// index is checked, so a truncated or foreign file is rejected instead of
+/// corrupting the index.
+///
+inline bool readModuleSummary(StringRef buffer, ModuleSummary *summary)
+{
+    ByteReader r(buffer);
+    if (!r.expectBytes(SummaryMagic) || r.readVarint() != SummaryVersion)
+    {
+        return false;
+    }
+    summary->module_id = r.readString();
+    summary->num_nodes = r.readVarint();
+    bool valid = summary->num_nodes > 0;
+    auto node = [&]() -> unsigned {
+        uint64_t n = r.readVarint();
+        if (n >= summary->num_nodes)
+        {
+            valid = false;
+            return 0;
+        }
+        return n;
+    };
+    auto linkage = [&]() -> SymbolLinkage {
+        uint64_t l = r.readVarint();
+        if (l > SL_Strong)
+        {
+            valid = false;
+            return SL_Local;
+        }
+        return (SymbolLinkage)l;
+    };
+
+    for (uint64_t i = 0, e = r.readVarint(); i != e && valid && !r.hasError(); i++)
+    {
+        uint64_t kind = r.readVarint();
+        unsigned dst = node(), src = node();
+        valid &= kind <= CK_Store && dst && src;
+        summary->constraints.push_back(Constraint((ConstraintKind)kind, dst, src));
+    }
+    for (uint64_t i = 0, e = r.readVarint(); i != e && valid && !r.hasError(); i++)
+    {
+        FunctionRecord fs;
+        fs.name = r.readString();
+        fs.linkage = linkage();
+        fs.node = node();
+        for (uint64_t j = 0, je = r.readVarint(); j != je && valid && !r.hasError(); j++)
+        {
+            fs.formals.push_back(node());
+        }
+        fs.ret = node();
+        summary->functions.push_back(fs);
+    }
+    for (uint64_t i = 0, e = r.readVarint(); i != e && valid && !r.hasError(); i++)
+    {
+        GlobalRecord gs;
+        gs.name = r.readString();
+        gs.linkage = linkage();
+        gs.node = node();
+        valid &= gs.linkage != SL_Local && gs.node;
+        summary->globals.push_back(gs);
+    }
+    for (uint64_t i = 0, e = r.readVarint(); i != e && valid && !r.hasError(); i++)
+    {
+        CallRecord cs;
+        cs.line = r.readVarint();
+        cs.callee = node();
+        for (uint64_t j = 0, je = r.readVarint(); j != je && valid && !r.hasError(); j++)
+        {
+            cs.args.push_back(node());
+        }
+        cs.ret = node();
+        cs.heap = node();
+        cs.external = r.readVarint();
+        valid &= cs.external <= summary->functions.size();
+        summary->calls.push_back(cs);
+    }
+    return valid && !r.hasError() && r.atEnd();
+}
+
+///
+/// Phase two: links the summaries of all modules of a program into one
+/// constraint graph and solves it. The object nodes of an external symbol
+/// in every module become one node, whose interface is that of the
+/// definition the linker would pick (a strong one over a weak one, else
+/// the first), so cross-module calls bind exactly as in the linked program.
+///
+class SummaryIndex
+{
+public:
+    SummaryIndex() : modules(), graph(), symbols(), functions(), call_base(), call_targets() {}
+
+    void addModule(ModuleSummary &summary)
+    {
+        modules.push_back(ModuleSummary());
+        std::swap(modules.back(), summary);
+    }
+
+    void solve()
+    {
+        for (unsigned m = 0, me = modules.size(); m != me; m++)
+        {
+            const ModuleSummary &summary = modules[m];
+            for (unsigned i = 0, e = summary.functions.size(); i != e; i++)
+            {
+                const FunctionRecord &fs = summary.functions[i];
+                if (fs.linkage != SL_Local && fs.node)
+                {
+                    addSymbol(fs.name, fs.linkage, m, i);
+                }
+            }
+            for (const GlobalRecord &gs : summary.globals)
+            {
+                addSymbol(gs.name, gs.linkage, m, ~0u);
+            }
+        }
+        for (auto si = symbols.begin(), se = symbols.end(); si != se; si++)
+        {
+            si->second.node = graph.addNode();
+        }
+
+        for (unsigned m = 0, me = modules.size(); m != me; m++)
+        {
+            linkModule(m);
+        }
+        substitutePointerEquivalents(&graph);
+        AndersenSolver solver(graph);
+        solver.solve();
+
+        // 被调函数按定义所在模块和位置排序
+        call_targets.resize(graph.calls.size());
+        for (unsigned i = 0, e = graph.calls.size(); i != e; i++)
+        {
+            const std::set<unsigned> &targets = solver.getCallTargets(i);
+            std::vector<unsigned> &callees = call_targets[i];
+            callees.assign(targets.begin(), targets.end());
+            std::sort(callees.begin(), callees.end(), [this](unsigned a, unsigned b) {
+                const FunctionInfo &fa = functions[a], &fb = functions[b];
+                return std::make_pair(modules[fa.module].module_id, fa.position) <
+                       std::make_pair(modules[fb.module].module_id, fb.position);
+            });
+        }
+    }
+
+    /// Prints the calls of module m in the format of ::printCallFuncResult
+    void printCallFuncResult(unsigned m, raw_ostream &out = errs())
+    {
+        const ModuleSummary &summary = modules[m];
+        std::vector<unsigned> order;
+        for (unsigned i = 0, e = summary.calls.size(); i != e; i++)
+        {
+            order.push_back(i);
+        }
+        std::stable_sort(order.begin(), order.end(), [&summary](unsigned a, unsigned b) {
+            return summary.calls[a].line < summary.calls[b].line;
+        });
+        for (unsigned i : order)
+        {
+            out << summary.calls[i].line << " : ";
+            const std::vector<unsigned> &callees = call_targets[call_base[m] + i];
+            for (auto fi = callees.begin(), fe = callees.end(); fi != fe; fi++)
+            {
+                if (fi != callees.begin())
+                {
+                    out << ", ";
+                }
+                const FunctionInfo &info = functions[*fi];
+                out << modules[info.module].functions[info.position].name;
+            }
+            out << "\n";
+        }
+    }
+
+    unsigned getNumModules() const { return modules.size(); }
+    const std::string &getModuleID(unsigned m) const { return modules[m].module_id; }
+    unsigned getNumSymbols() const { return symbols.size(); }
+    unsigned getNumNodes() const { return graph.num_nodes; }
+    unsigned getNumConstraints() const { return graph.constraints.size(); }
+    unsigned getNumCalls() const { return graph.calls.size(); }
+
+private:
+    /// The definition an external name binds to, see addSymbol
+    struct Symbol
+    {
+        SymbolLinkage linkage;
+        unsigned module;
+        unsigned function; /// index in the module's functions, ~0u for a global
+        unsigned node;
+    };
+
+    /// Where a function of the merged graph comes from
+    struct FunctionInfo
+    {
+        unsigned module;
+        unsigned position;
+    };
+
+    std::vector<ModuleSummary> modules;
+    ConstraintGraph graph;
+    std::map<std::string, Symbol> symbols;
+    std::map<unsigned, FunctionInfo> functions;
+    std::vector<unsigned> call_base; // index of each module's first call in graph.calls
+    std::vector<std::vector<unsigned>> call_targets;
+
+    /// A stronger definition wins, otherwise the first module
+    void addSymbol(const std::string &name, SymbolLinkage linkage, unsigned module, unsigned function)
+    {
+        auto it = symbols.find(name);
+        if (it == symbols.end() || linkage > it->second.linkage)
+        {
+            Symbol &symbol = symbols[name];
+            symbol.linkage = linkage;
+            symbol.module = module;
+            symbol.function = function;
+            symbol.node = 0;
+        }
+    }
+
+    void linkModule(unsigned m)
+    {
+        const ModuleSummary &summary = modules[m];
+        std::vector<unsigned> map(summary.num_nodes, 0);
+        for (const FunctionRecord &fs : summary.functions)
+        {
+            if (fs.linkage != SL_Local && fs.node)
+            {
+                map[fs.node] = symbols[fs.name].node;
+            }
+        }
+        for (const GlobalRecord &gs : summary.globals)
+        {
+            map[gs.node] = symbols[gs.name].node;
+        }
+        for (unsigned n = 1; n < summary.num_nodes; n++)
+        {
+            if (!map[n])
+            {
+                map[n] = graph.addNode();
+            }
+        }
+
+        for (const Constraint &c : summary.constraints)
+        {
+            graph.addConstraint(c.kind, map[c.dst], map[c.src]);
+        }
+        for (unsigned i = 0, e = summary.functions.size(); i != e; i++)
+        {
+            const FunctionRecord &fs = summary.functions[i];
+            if (!fs.node)
+            {
+                continue;
+            }
+            if (fs.linkage != SL_Local)
+            {
+                // 只有被选中的定义(或唯一的声明)提供接口
+                const Symbol &symbol = symbols[fs.name];
+                if (symbol.module != m || symbol.function != i)
+                {
+                    continue;
+                }
+            }
+            FunctionNodes &fn = graph.functions[map[fs.node]];
+            for (unsigned formal : fs.formals)
+            {
+                fn.formals.push_back(map[formal]);
+            }
+            fn.ret = map[fs.ret];
+            FunctionInfo &info = functions[map[fs.node]];
+            info.module = m;
+            info.position = i;
+        }
+
+        call_base.push_back(graph.calls.size());
+        for (const CallRecord &cs : summary.calls)
+        {
+            CallConstraint call(map[cs.callee], nullptr);
+            for (unsigned arg : cs.args)
+            {
+                call.args.push_back(map[arg]);
+            }
+            call.ret = map[cs.ret];
+            if (cs.external && symbols[summary.functions[cs.external - 1].name].linkage == SL_Declaration)
+            {
+                // 没有模块定义它, 与单模块时一样返回新的堆对象
+                graph.addConstraint(CK_AddrOf, call.ret, map[cs.heap]);
+            }
+            graph.calls.push_back(call);
+        }
+    }
+};
+
+#endif /* !_SUMMARY_H_ */
@@ -0,0 +1,82 @@
+/************************************************************************
+ *
+ * @file SymbolTable.h
+ *
+ * Cross-module symbol resolution for analysing a program given as
+ * several unlinked bitcode modules
+ *
+ ***********************************************************************/
+
+#ifndef _SYMBOLTABLE_H_
+#define _SYMBOLTABLE_H_
+
+#include <llvm/IR/Module.h>
+#include <llvm/IR/GlobalValue.h>
+
+#include <map>
+#include <string>
+using namespace llvm;
+
+///
+/// What the linker would make of the external symbols of a set of modules
+/// loaded into one LLVMContext: every declaration of a function or global
+/// variable stands for the definition of the same name in whichever module
+/// provides it. A strong definition wins over a weak or linkonce one, and
+/// otherwise the first module added wins. Lazily loaded function bodies
+/// count as definitions, so nothing has to be read to build the table.
+///
+class ProgramSymbolTable
+{
+public:
+    ProgramSymbolTable() : definitions() {}
+
+    void addModule(Module &M)
+    {
+        for (auto &F : M)
+        {
+            addDefinition(&F);
+        }
+        for (auto &G : M.globals())
+        {
+            addDefinition(&G);
+        }
+    }
+
+    /// The definition gv stands for, or gv itself if no module defines it
+    GlobalValue *resolve(GlobalValue *gv) const
+    {
+        if (gv->hasLocalLinkage() || !gv->hasName())
+        {
+            return gv;
+        }
+        auto it = definitions.find(gv->getName().str());
+        return it == definitions.end() ? gv : it->second;
+    }
+
+    /// The definition of an external symbol, null if no module defines it
+    GlobalValue *lookup(StringRef name) const
+    {
+        auto it = definitions.find(name.str());
+        return it == definitions.end() ? nullptr : it->second;
+    }
+
+    unsigned getNumDefinitions() const { return definitions.size(); }
+
+private:
+    std::map<std::string, GlobalValue *> definitions;
+
+    void addDefinition(GlobalValue *gv)
+    {
+        if (gv->isDeclaration() || gv->hasLocalLinkage() || !gv->hasName())
+        {
+            return;
+        }
+        GlobalValue *&definition = definitions[gv->getName().str()];
+        if (!definition || (definition->isWeakForLinker() && !gv->isWeakForLinker()))
+        {
+            definition = gv;
+        }
+    }
+};
+
+#endif /* !_SYMBOLTABLE_H_ */
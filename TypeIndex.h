@@ -0,0 +1,115 @@
+/************************************************************************
+ *
+ * @file TypeIndex.h
+ *
+ * Index of address-taken functions by type, and the signature check
+ * used to filter impossible callees
+ *
+ ***********************************************************************/
+
+#ifndef _TYPEINDEX_H_
+#define _TYPEINDEX_H_
+
+#include <llvm/IR/Module.h>
+#include <llvm/IR/Function.h>
+#include <llvm/IR/Instructions.h>
+
+#include <map>
+#include <set>
+#include <vector>
+using namespace llvm;
+
+///
+/// Address-taken functions bucketed by their FunctionType. A call can only
+/// reach a function whose signature is compatible with the type it is
+/// called through; since the C front end casts function pointers freely,
+/// compatible means the same arity and, position by position, equal types
+/// or two pointers or two integers of the same width.
+///
+class FunctionTypeIndex
+{
+public:
+    FunctionTypeIndex() : buckets(), candidates() {}
+
+    void build(Module &M)
+    {
+        buckets.clear();
+        candidates.clear();
+        for (auto &F : M)
+        {
+            if (!F.isIntrinsic() && F.hasAddressTaken())
+            {
+                buckets[F.getFunctionType()].push_back(&F);
+            }
+        }
+    }
+
+    /// Type a call instruction calls through
+    static FunctionType *getCallType(CallInst *callInst)
+    {
+        return callInst->getFunctionType();
+    }
+
+    static bool isCompatible(FunctionType *callType, FunctionType *calleeType)
+    {
+        if (callType == calleeType)
+        {
+            return true;
+        }
+        unsigned params = calleeType->getNumParams();
+        if (calleeType->isVarArg() ? callType->getNumParams() < params : callType->getNumParams() != params)
+        {
+            return false;
+        }
+        for (unsigned i = 0; i < params; i++)
+        {
+            if (!isCompatible(callType->getParamType(i), calleeType->getParamType(i)))
+            {
+                return false;
+            }
+        }
+        // 调用点不使用返回值时, 返回类型无所谓
+        return callType->getReturnType()->isVoidTy() ||
+               isCompatible(callType->getReturnType(), calleeType->getReturnType());
+    }
+
+    static bool isCompatible(CallInst *callInst, Function *callee)
+    {
+        return isCompatible(getCallType(callInst), callee->getFunctionType());
+    }
+
+    /// Address-taken functions callInst may call, judging by signature only
+    const std::set<Function *> &getCandidates(CallInst *callInst)
+    {
+        FunctionType *callType = getCallType(callInst);
+        auto it = candidates.find(callType);
+        if (it != candidates.end())
+        {
+            return it->second;
+        }
+        std::set<Function *> &functions = candidates[callType];
+        for (auto bi = buckets.begin(), be = buckets.end(); bi != be; bi++)
+        {
+            if (isCompatible(callType, bi->first))
+            {
+                functions.insert(bi->second.begin(), bi->second.end());
+            }
+        }
+        return functions;
+    }
+
+private:
+    std::map<FunctionType *, std::vector<Function *>> buckets;
+    std::map<FunctionType *, std::set<Function *>> candidates; // per call type, filled on demand
+
+    static bool isCompatible(Type *a, Type *b)
+    {
+        if (a == b || (a->isPointerTy() && b->isPointerTy()))
+        {
+            return true;
+        }
+        return a->isIntegerTy() && b->isIntegerTy() && a->getIntegerBitWidth() == b->getIntegerBitWidth();
+    }
+};
+
+#endif /* !_TYPEINDEX_H_ */
@@ -0,0 +1,68 @@
+/************************************************************************
+ *
+ * @file TypeSignature.h
+ *
+ * Fast call resolution by function signature alone
+ *
+ ***********************************************************************/
+
+#ifndef _TYPESIGNATURE_H_
+#define _TYPESIGNATURE_H_
+
+#include <llvm/IR/Module.h>
+#include <llvm/IR/IntrinsicInst.h>
+#include <llvm/IR/InstIterator.h>
+#include "Liveness.h"
+#include "TypeIndex.h"
+
+#include <map>
+using namespace llvm;
+
+///
+/// Fast mode: one pass over the module answering every indirect call with
+/// the compatible address-taken functions, and every direct call with its
+/// callee.
+///
+class TypeSignatureAnalysis
+{
+public:
+    std::map<CallInst *, FunctionSet> call_func_result;
+
+    TypeSignatureAnalysis() : call_func_result(), index() {}
+
+    void run(Module &M)
+    {
+        index.build(M);
+        for (auto &F : M)
+        {
+            for (inst_iterator ii = inst_begin(&F), ie = inst_end(&F); ii != ie; ii++)
+            {
+                auto *callInst = dyn_cast<CallInst>(&*ii);
+                if (!callInst || isa<IntrinsicInst>(callInst))
+                {
+                    continue;
+                }
+                FunctionSet &callees = call_func_result[callInst];
+                if (Function *func = dyn_cast<Function>(callInst->getCalledValue()->stripPointerCasts()))
+                {
+                    callees.insert(func);
+                }
+                else
+                {
+                    const std::set<Function *> &functions = index.getCandidates(callInst);
+                    callees.insert(functions.begin(), functions.end());
+                }
+            }
+        }
+    }
+
+    void printCallFuncResult(raw_ostream &out = errs())
+    {
+        ::printCallFuncResult(call_func_result, out);
+    }
+
+private:
+    FunctionTypeIndex index;
+};
+
+#endif /* !_TYPESIGNATURE_H_ */
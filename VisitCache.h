@@ -0,0 +1,1415 @@
+/************************************************************************
+ *
+ * @file VisitCache.h
+ *
+ * Persistent cache of the function visits of the flow analysis, so that
+ * a run over a slightly changed module analyses only what changed
+ *
+ ***********************************************************************/
+
+#ifndef _VISITCACHE_H_
+#define _VISITCACHE_H_
+
+#include <llvm/IR/Module.h>
+#include <llvm/IR/Function.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/InstIterator.h>
+#include <llvm/ADT/DenseMap.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/raw_ostream.h>
+#include "Liveness.h"
+#include "Serialize.h"
+
+#include <cstdint>
+#include <map>
+#include <set>
+#include <string>
+#include <tuple>
+#include <vector>
+using namespace llvm;
+
+inline uint64_t mixDigestBits(uint64_t x)
+{
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ull;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebull;
+    x ^= x >> 31;
+    return x;
+}
+
+///
+/// 128-bit content digest. add() absorbs its argument in order; combine()
+/// sums digests, so a set hashes the same whatever order it is walked in.
+///
+struct CacheDigest
+{
+    uint64_t lo, hi;
+    CacheDigest() : lo(0), hi(0) {}
+    CacheDigest(uint64_t lo, uint64_t hi) : lo(lo), hi(hi) {}
+
+    void add(uint64_t v)
+    {
+        lo = mixDigestBits(lo ^ v);
+        hi = mixDigestBits(hi + ((v << 29) | (v >> 35)) + 0x9e3779b97f4a7c15ull);
+    }
+    void add(const CacheDigest &d)
+    {
+        add(d.lo);
+        add(d.hi);
+    }
+    void add(StringRef s)
+    {
+        add(s.size());
+        for (size_t i = 0; i < s.size(); i += 8)
+        {
+            uint64_t chunk = 0;
+            for (size_t j = i; j < s.size() && j < i + 8; j++)
+            {
+                chunk |= (uint64_t)(uint8_t)s[j] << (8 * (j - i));
+            }
+            add(chunk);
+        }
+    }
+    void combine(const CacheDigest &d)
+    {
+        lo += d.lo;
+        hi += d.hi;
+    }
+
+    bool operator==(const CacheDigest &d) const { return lo == d.lo && hi == d.hi; }
+    bool operator!=(const CacheDigest &d) const { return !(*this == d); }
+    bool operator<(const CacheDigest &d) const { return lo < d.lo || (lo == d.lo && hi < d.hi); }
+};
+
+///
+/// Cache of the visits of the flow analysis, one file per module.
+///
+/// A visit runs the function to the fixpoint of everything it was handed
+/// so far (entry states and states after its calls, which only grow) and
+/// of the top-level facts of other functions it reads, so what it leaves
+/// does not depend on the order in which those arrived. The cached visits
+/// are keyed on a digest of the function's IR and of the set of its
+/// inputs: each state handed to it by kind, call site and contents, and
+/// the facts its earlier visits read. The facts the visit itself reads
+/// are recorded with it and compared on lookup. A visit found in the
+/// cache is replayed: the function's state is restored as the visit left
+/// it and everything the function handed to other functions up to that
+/// visit is delivered again. A changed function misses from its first
+/// visit on, and so does every function that is handed a different state
+/// because of it; an edit that only reorders the worklist does not. A
+/// visit over a budget depends on the order, so a function that had one
+/// is no longer cached in that run.
+///
+/// Values are stored by name: a function by its name and a digest of its
+/// signature, a formal by its function and position, an instruction by
+/// its function, a digest of that function's IR and its position. The
+/// analysis must be context-insensitive, as the calling contexts are
+/// numbered in the order they are met.
+///
+class VisitCache : public VisitObserver
+{
+public:
+    VisitCache(Module &M, LivenessVisitor &visitor, const ModRefSummary &modref, uint64_t options)
+        : M(M), visitor(visitor), modref(modref), options(options), names(), name_index(), name_digests(), name_of(), resolved(),
+          module_values(), constants_scanned(false), states(), state_index(), state_checked(), records(),
+          record_index(), fn_hashes(), fn_signatures(), positions(), instructions(), inputs(), delivered(), ordered(), pending(),
+          visiting(nullptr), recording(), read_values(), hits(0), misses(0), analysed(), saved_bytes(0)
+    {
+        unsigned position = 0;
+        for (auto &G : M.global_values())
+        {
+            positions[&G] = position++;
+        }
+        for (auto &F : M)
+        {
+            fn_signatures[&F] = hashSignature(&F);
+            std::vector<Instruction *> &insts = instructions[&F];
+            for (inst_iterator ii = inst_begin(F), ie = inst_end(F); ii != ie; ii++)
+            {
+                positions[&*ii] = insts.size();
+                insts.push_back(&*ii);
+            }
+        }
+        for (auto &F : M)
+        {
+            if (!F.isDeclaration())
+            {
+                fn_hashes[&F] = hashFunction(&F);
+            }
+        }
+    }
+
+    /// Reads the visits cached by an earlier run; a missing file is an empty cache
+    bool load(StringRef path, std::string *error)
+    {
+        ErrorOr<std::unique_ptr<MemoryBuffer>> buffer = MemoryBuffer::getFile(path);
+        if (!buffer)
+        {
+            if (buffer.getError() == std::errc::no_such_file_or_directory)
+            {
+                return true;
+            }
+            *error = buffer.getError().message();
+            return false;
+        }
+        return loadBuffer((*buffer)->getBuffer(), error);
+    }
+
+    /// Reads visits from what save or saveBuffer wrote
+    bool loadBuffer(StringRef contents, std::string *error)
+    {
+        ByteReader header(contents);
+        if (header.expectBytes("FPCACHE") && (header.readVarint() != 2 || header.readVarint() != options))
+        {
+            // 其他版本或其他选项写的, 当作空的
+            return true;
+        }
+        if (!read(contents))
+        {
+            names.clear();
+            name_index.clear();
+            name_digests.clear();
+            resolved.clear();
+            states.clear();
+            state_index.clear();
+            records.clear();
+            record_index.clear();
+            *error = "not a visit cache";
+            return false;
+        }
+        return true;
+    }
+
+    /// Writes the visits of this run, replayed or new, and nothing else
+    bool save(StringRef path, std::string *error)
+    {
+        std::string buffer;
+        saveBuffer(&buffer);
+
+        // 先写临时文件再改名, 中断时不会留下半个cache
+        return writeFileAtomically(path, StringRef(buffer), error);
+    }
+
+    /// What save writes, kept in memory instead
+    void saveBuffer(std::string *buffer)
+    {
+        buffer->clear();
+        raw_string_ostream os(*buffer);
+        write(os);
+        os.flush();
+        saved_bytes = buffer->size();
+    }
+
+    ///
+    /// Replays the cached visit of fc if there is one: restores its state,
+    /// records its degraded status and delivers what it handed to other
+    /// functions. False if fc has to be analysed.
+    ///
+    bool replay(const FunctionContext &fc, std::map<FunctionContext, DataflowStatus> *degraded)
+    {
+        if (ordered.count(fc.first))
+        {
+            return false;
+        }
+        CacheDigest key = getKey(fc.first);
+        unsigned fn_name = getName(fc.first);
+        for (auto ri = record_index.lower_bound(key), re = record_index.end(); ri != re && ri->first == key; ri++)
+        {
+            VisitRecord &record = records[ri->second];
+            if (record.function != fn_name || !checkReads(fc.second, record))
+            {
+                continue;
+            }
+            FunctionState state;
+            std::vector<DecodedDelivery> deliveries;
+            if (!decodeRecord(record, fc, &state, &deliveries))
+            {
+                continue;
+            }
+
+            // 数据流值等用到时再解码, 多数函数下一次访问也是重放
+            visitor.restoreFunctionState(fc, state);
+            Pending &points = pending[fc.first];
+            points.record = ri->second;
+            points.done.assign(2 * record.points.size(), false);
+            if (record.status)
+            {
+                (*degraded)[fc] = (DataflowStatus)(record.status - 1);
+            }
+            else
+            {
+                degraded->erase(fc);
+            }
+            for (unsigned i = 0; i < deliveries.size(); i++)
+            {
+                const Delivery &delivery = record.deliveries[i];
+                const DecodedDelivery &decoded = deliveries[i];
+                CacheDigest digest = delivery.state ? states[delivery.state - 1].digest : CacheDigest();
+                if (delivery.exit)
+                {
+                    Function *caller = decoded.site.first->getFunction();
+                    addInput(caller, 2, delivery.site, digest);
+                    restorePoint(caller, positions[decoded.site.first], 1);
+                    visitor.receiveExit(decoded.site, decoded.state);
+                }
+                else
+                {
+                    addInput(decoded.target, 1, delivery.site, digest);
+                    if (delivery.state)
+                    {
+                        restorePoint(decoded.target, 0, 0);
+                    }
+                    visitor.receiveEntry(std::make_pair(decoded.target, fc.second), decoded.site,
+                                         delivery.state ? &decoded.state : nullptr);
+                }
+            }
+            if (record.requeue)
+            {
+                visitor.fn_worklist.insert(fc);
+            }
+            addDelivered(fc.first, record.deliveries);
+            endInputs(fc.first, record);
+            record.used = true;
+            hits++;
+            return true;
+        }
+        return false;
+    }
+
+    /// Starts recording the analysis of fc
+    void beginVisit(const FunctionContext &fc)
+    {
+        restoreAllPoints(fc.first);
+        visiting = fc.first;
+        recording = VisitRecord();
+        recording.key = getKey(fc.first);
+        recording.function = getName(fc.first);
+        read_values.clear();
+    }
+
+    /// Stores the visit of fc that beginVisit started
+    void endVisit(const FunctionContext &fc, const std::map<FunctionContext, DataflowStatus> &degraded)
+    {
+        FunctionState state;
+        visitor.saveFunctionState(fc, &state, false);
+        // 相邻的程序点多半状态相同
+        DataflowResult<LivenessInfo>::Type &result = visitor.getResult(fc.second);
+        const LivenessInfo *last = nullptr;
+        unsigned last_index = 0;
+        for (Instruction *inst : instructions[fc.first])
+        {
+            const std::pair<LivenessInfo, LivenessInfo> &point = result[inst];
+            unsigned in = last && *last == point.first ? last_index : addState(point.first);
+            unsigned out = point.second == point.first ? in : addState(point.second);
+            recording.points.push_back(std::make_pair(in, out));
+            last = &point.second;
+            last_index = out;
+        }
+        recording.top_level = encodeMap(state.top_level);
+        for (const CallSite &site : state.return_sites)
+        {
+            recording.return_sites.push_back(getName(site.first));
+        }
+        for (auto ci = state.callees.begin(), ce = state.callees.end(); ci != ce; ci++)
+        {
+            std::vector<unsigned> callees;
+            for (Function *callee : ci->second)
+            {
+                callees.push_back(getName(callee));
+            }
+            recording.callees.push_back(std::make_pair(getName(ci->first), callees));
+        }
+        auto di = degraded.find(fc);
+        recording.status = di == degraded.end() ? 0 : di->second + 1;
+        recording.requeue = visitor.fn_worklist.count(fc);
+        recording.used = true;
+        // 重放时要把到这次访问为止交出去的都交一遍
+        addDelivered(fc.first, recording.deliveries);
+        recording.deliveries = delivered[fc.first].list;
+
+        if (recording.status)
+        {
+            ordered.insert(fc.first);
+        }
+        if (!ordered.count(fc.first))
+        {
+            record_index.insert(std::make_pair(recording.key, records.size()));
+            records.push_back(recording);
+        }
+        endInputs(fc.first, recording);
+        recording = VisitRecord();
+        visiting = nullptr;
+        misses++;
+        analysed.insert(fc.first);
+    }
+
+    void deliverEntry(const FunctionContext &callee, const CallSite &site, const LivenessInfo *state) override
+    {
+        // 自己调用自己的效果已经在保存的状态里
+        if (callee.first == visiting)
+        {
+            return;
+        }
+        if (state)
+        {
+            restorePoint(callee.first, 0, 0);
+        }
+        Delivery delivery;
+        delivery.exit = false;
+        delivery.target = getName(callee.first);
+        delivery.site = getName(site.first);
+        delivery.state = state ? addState(*state) + 1 : 0;
+        recording.deliveries.push_back(delivery);
+        addInput(callee.first, 1, delivery.site, state ? states[delivery.state - 1].digest : CacheDigest());
+    }
+
+    void deliverExit(const FunctionContext &callee, const CallSite &site, const LivenessInfo &state) override
+    {
+        Function *caller = site.first->getFunction();
+        if (caller == visiting)
+        {
+            return;
+        }
+        restorePoint(caller, positions[site.first], 1);
+        Delivery delivery;
+        delivery.exit = true;
+        delivery.target = getName(callee.first);
+        delivery.site = getName(site.first);
+        delivery.state = addState(state) + 1;
+        recording.deliveries.push_back(delivery);
+        addInput(caller, 2, delivery.site, states[delivery.state - 1].digest);
+    }
+
+    void readTopLevel(Function *fn, Value *v, const ValueSet *facts) override
+    {
+        Function *owner = nullptr;
+        if (auto *inst = dyn_cast<Instruction>(v))
+        {
+            owner = inst->getFunction();
+        }
+        else if (auto *arg = dyn_cast<Argument>(v))
+        {
+            owner = arg->getParent();
+        }
+        if (!owner || owner == fn || !read_values.insert(v).second)
+        {
+            return;
+        }
+        recording.reads.push_back(std::make_pair(getName(v), digestFacts(facts)));
+    }
+
+    unsigned getNumHits() const { return hits; }
+    unsigned getNumMisses() const { return misses; }
+    unsigned getNumAnalysed() const { return analysed.size(); }
+    size_t getSavedBytes() const { return saved_bytes; }
+
+private:
+    /// A state handed to another function: its entry state, or the state after a call
+    struct Delivery
+    {
+        bool exit;
+        unsigned target; // callee, by name index
+        unsigned site;   // call instruction, by name index
+        unsigned state;  // 1 + state index, 0 for none
+
+        bool operator<(const Delivery &d) const
+        {
+            return std::make_tuple(exit, target, site, state) < std::make_tuple(d.exit, d.target, d.site, d.state);
+        }
+    };
+
+    struct DecodedDelivery
+    {
+        Function *target;
+        CallSite site;
+        LivenessInfo state;
+    };
+
+    struct EncodedState
+    {
+        std::vector<std::pair<unsigned, std::vector<unsigned>>> vars, fields;
+        CacheDigest digest;
+    };
+
+    struct VisitRecord
+    {
+        CacheDigest key;   // digest of the function and its inputs before the visit, see getKey
+        unsigned function; // name index
+        std::vector<std::pair<unsigned, CacheDigest>> reads;             // top-level facts of other functions read
+        std::vector<std::pair<unsigned, unsigned>> points;               // state indices before and after each instruction
+        std::vector<std::pair<unsigned, std::vector<unsigned>>> top_level;
+        std::vector<unsigned> return_sites;
+        std::vector<std::pair<unsigned, std::vector<unsigned>>> callees;
+        unsigned status; // 1 + DataflowStatus if degraded, 0 otherwise
+        bool requeue;    // the visit queued the function again
+        std::vector<Delivery> deliveries; // of this visit and the earlier ones of the function
+        bool used;       // replayed or recorded by this run, so it is saved
+        VisitRecord() : key(), function(0), reads(), points(), top_level(), return_sites(), callees(), status(0),
+                        requeue(false), deliveries(), used(false) {}
+    };
+
+    Module &M;
+    LivenessVisitor &visitor;
+    const ModRefSummary &modref;
+    uint64_t options;
+
+    std::vector<std::string> names;                // stable names of the values in the cache
+    std::map<std::string, unsigned> name_index;
+    std::vector<CacheDigest> name_digests;
+    DenseMap<Value *, unsigned> name_of;
+    std::vector<Value *> resolved;                 // per name, null until looked up
+    std::map<std::string, Value *> module_values;  // built on the first lookup
+    bool constants_scanned;
+
+    std::vector<EncodedState> states;
+    std::map<CacheDigest, unsigned> state_index;
+    std::vector<int8_t> state_checked; // per state, 1 if all its values exist, -1 if not, 0 if not checked
+    std::vector<VisitRecord> records;
+    std::multimap<CacheDigest, unsigned> record_index;
+
+    std::map<Function *, CacheDigest> fn_hashes;
+    std::map<Function *, CacheDigest> fn_signatures;
+    DenseMap<Value *, unsigned> positions; // of globals in the module, of instructions in their function
+    std::map<Function *, std::vector<Instruction *>> instructions;
+
+    /// What a function was handed so far, as a set
+    struct Inputs
+    {
+        std::set<CacheDigest> elements;
+        CacheDigest sum;  // of the elements, whatever order they came in
+        unsigned repeats; // visits since the last new element
+        Inputs() : elements(), sum(), repeats(0) {}
+    };
+    std::map<Function *, Inputs> inputs;
+
+    /// What a function handed to others so far, in the order first handed
+    struct Delivered
+    {
+        std::vector<Delivery> list;
+        std::set<Delivery> seen;
+        Delivered() : list(), seen() {}
+    };
+    std::map<Function *, Delivered> delivered;
+    std::set<Function *> ordered; // had a visit over budget, whose state depends on the order
+
+    /// Dataflow values of a replayed function not decoded yet
+    struct Pending
+    {
+        unsigned record;
+        std::vector<bool> done; // before and after each instruction
+    };
+    std::map<Function *, Pending> pending;
+
+    Function *visiting; // function whose visit is being recorded
+    VisitRecord recording;
+    ValueSet read_values;
+
+    unsigned hits, misses;
+    std::set<Function *> analysed;
+    size_t saved_bytes;
+
+    static std::string toHex(const CacheDigest &d)
+    {
+        std::string s;
+        raw_string_ostream os(s);
+        os << format_hex_no_prefix(d.lo ^ d.hi, 16);
+        return os.str();
+    }
+
+    std::string getGlobalName(GlobalValue *gv)
+    {
+        if (gv->hasName())
+        {
+            return gv->getName().str();
+        }
+        return "#" + std::to_string(positions[gv]);
+    }
+
+    /// What callers see of F: its type, whether it has a body and whether it writes pointers
+    CacheDigest hashSignature(Function *F)
+    {
+        std::string s;
+        raw_string_ostream os(s);
+        F->getFunctionType()->print(os);
+        os << (F->isDeclaration() ? " declared" : " defined") << (modref.isPure(F) ? " pure" : "");
+        CacheDigest d;
+        d.add(StringRef(os.str()));
+        return d;
+    }
+
+    /// Names global values reached from a constant operand
+    void printConstantGlobals(Constant *c, raw_ostream &os, std::set<Constant *> *visited)
+    {
+        if (!visited->insert(c).second)
+        {
+            return;
+        }
+        if (auto *gv = dyn_cast<GlobalValue>(c))
+        {
+            os << " " << getValueName(gv);
+            return;
+        }
+        for (Value *operand : c->operands())
+        {
+            if (auto *constant = dyn_cast<Constant>(operand))
+            {
+                printConstantGlobals(constant, os, visited);
+            }
+        }
+    }
+
+    /// Digest of the IR of F, with its operands named as the cache names them
+    CacheDigest hashFunction(Function *F)
+    {
+        std::string s;
+        raw_string_ostream os(s);
+        os << getValueName(F) << "\n";
+        DenseMap<Value *, unsigned> locals;
+        unsigned index = 0;
+        for (auto &BB : *F)
+        {
+            locals[&BB] = index++;
+        }
+        index = 0;
+        for (inst_iterator ii = inst_begin(F), ie = inst_end(F); ii != ie; ii++)
+        {
+            locals[&*ii] = index++;
+        }
+        for (auto &BB : *F)
+        {
+            os << "b" << BB.size() << "\n";
+            for (auto &I : BB)
+            {
+                os << I.getOpcodeName() << " ";
+                I.getType()->print(os);
+                for (Value *operand : I.operands())
+                {
+                    os << " ";
+                    auto it = locals.find(operand);
+                    if (it != locals.end())
+                    {
+                        os << (isa<BasicBlock>(operand) ? "%b" : "%") << it->second;
+                    }
+                    else if (auto *arg = dyn_cast<Argument>(operand))
+                    {
+                        os << "%a" << arg->getArgNo();
+                    }
+                    else if (auto *gv = dyn_cast<GlobalValue>(operand))
+                    {
+                        os << getValueName(gv);
+                    }
+                    else if (auto *constant = dyn_cast<Constant>(operand))
+                    {
+                        constant->print(os);
+                        std::set<Constant *> visited;
+                        printConstantGlobals(constant, os, &visited);
+                    }
+                    else if (!isa<MetadataAsValue>(operand))
+                    {
+                        operand->print(os);
+                    }
+                }
+                if (auto *cmpInst = dyn_cast<CmpInst>(&I))
+                {
+                    os << " p" << (unsigned)cmpInst->getPredicate();
+                }
+                if (isa<CallInst>(&I))
+                {
+                    // 输出按行号排
+                    os << " L" << I.getDebugLoc().getLine();
+                }
+                os << "\n";
+            }
+        }
+        CacheDigest d;
+        d.add(StringRef(os.str()));
+        return d;
+    }
+
+    /// The name a value is stored by, stable across runs while its function does not change
+    std::string getValueName(Value *v)
+    {
+        std::string s;
+        raw_string_ostream os(s);
+        if (auto *F = dyn_cast<Function>(v))
+        {
+            os << "f" << getGlobalName(F) << "|" << toHex(fn_signatures[F]);
+        }
+        else if (auto *gv = dyn_cast<GlobalValue>(v))
+        {
+            os << "g" << getGlobalName(gv) << "|";
+            gv->getType()->print(os);
+        }
+        else if (auto *arg = dyn_cast<Argument>(v))
+        {
+            Function *F = arg->getParent();
+            os << "a" << getGlobalName(F) << "|" << toHex(fn_signatures[F]) << "|" << arg->getArgNo();
+        }
+        else if (auto *inst = dyn_cast<Instruction>(v))
+        {
+            Function *F = inst->getFunction();
+            os << "i" << getGlobalName(F) << "|" << toHex(fn_hashes[F]) << "|" << positions[inst];
+        }
+        else
+        {
+            os << "c";
+            v->print(os);
+        }
+        return os.str();
+    }
+
+    unsigned addName(const std::string &name)
+    {
+        auto it = name_index.find(name);
+        if (it != name_index.end())
+        {
+            return it->second;
+        }
+        unsigned index = names.size();
+        names.push_back(name);
+        name_index.insert(std::make_pair(name, index));
+        CacheDigest d;
+        d.add(StringRef(name));
+        name_digests.push_back(d);
+        resolved.push_back(nullptr);
+        return index;
+    }
+
+    unsigned getName(Value *v)
+    {
+        auto it = name_of.find(v);
+        if (it != name_of.end())
+        {
+            return it->second;
+        }
+        unsigned index = addName(getValueName(v));
+        name_of[v] = index;
+        resolved[index] = v;
+        return index;
+    }
+
+    void addModuleValue(Value *v)
+    {
+        module_values.insert(std::make_pair(getValueName(v), v));
+    }
+
+    void scanConstants(Constant *c)
+    {
+        if (isa<GlobalValue>(c) || !module_values.insert(std::make_pair(getValueName(c), c)).second)
+        {
+            return;
+        }
+        for (Value *operand : c->operands())
+        {
+            if (auto *constant = dyn_cast<Constant>(operand))
+            {
+                scanConstants(constant);
+            }
+        }
+    }
+
+    /// The value a stored name stands for in this module, null if none
+    Value *resolve(unsigned index)
+    {
+        if (resolved[index])
+        {
+            return resolved[index];
+        }
+        if (module_values.empty())
+        {
+            // 第一次查找时给模块中所有的值起名
+            for (auto &G : M.global_values())
+            {
+                addModuleValue(&G);
+            }
+            for (auto &F : M)
+            {
+                for (auto ai = F.arg_begin(), ae = F.arg_end(); ai != ae; ai++)
+                {
+                    addModuleValue(&*ai);
+                }
+                for (inst_iterator ii = inst_begin(F), ie = inst_end(F); ii != ie; ii++)
+                {
+                    addModuleValue(&*ii);
+                }
+            }
+        }
+        const std::string &name = names[index];
+        if (name[0] == 'c' && !constants_scanned)
+        {
+            constants_scanned = true;
+            for (auto &F : M)
+            {
+                for (inst_iterator ii = inst_begin(F), ie = inst_end(F); ii != ie; ii++)
+                {
+                    for (Value *operand : ii->operands())
+                    {
+                        if (auto *constant = dyn_cast<Constant>(operand))
+                            scanConstants(constant);
+                    }
+                }
+            }
+        }
+        auto it = module_values.find(name);
+        if (it == module_values.end())
+        {
+            return nullptr;
+        }
+        resolved[index] = it->second;
+        name_of[it->second] = index;
+        return it->second;
+    }
+
+    /// The key of the next visit of fn
+    CacheDigest getKey(Function *fn)
+    {
+        const Inputs &in = inputs[fn];
+        CacheDigest d;
+        d.add(options);
+        d.add(fn_hashes[fn]);
+        d.add(in.elements.size());
+        d.add(in.sum);
+        // 没有新输入的再次访问(比如递归)要和前一次分开
+        d.add(in.repeats);
+        return d;
+    }
+
+    void addElement(Function *fn, const CacheDigest &element)
+    {
+        Inputs &in = inputs[fn];
+        if (in.elements.insert(element).second)
+        {
+            in.sum.combine(element);
+            in.repeats = 0;
+        }
+    }
+
+    /// Adds a state handed to fn to its inputs
+    void addInput(Function *fn, unsigned kind, unsigned site, const CacheDigest &state)
+    {
+        CacheDigest element;
+        element.add(kind);
+        element.add(name_digests[site]);
+        element.add(state);
+        addElement(fn, element);
+    }
+
+    /// Adds the facts read by a finished visit of fn to its inputs
+    void endInputs(Function *fn, const VisitRecord &record)
+    {
+        for (auto ri = record.reads.begin(), re = record.reads.end(); ri != re; ri++)
+        {
+            CacheDigest element;
+            element.add(3);
+            element.add(name_digests[ri->first]);
+            element.add(ri->second);
+            addElement(fn, element);
+        }
+        inputs[fn].repeats++;
+    }
+
+    void addDelivered(Function *fn, const std::vector<Delivery> &deliveries)
+    {
+        Delivered &out = delivered[fn];
+        for (const Delivery &delivery : deliveries)
+        {
+            if (out.seen.insert(delivery).second)
+            {
+                out.list.push_back(delivery);
+            }
+        }
+    }
+
+    CacheDigest digestFacts(const ValueSet *facts)
+    {
+        if (!facts)
+        {
+            return CacheDigest();
+        }
+        CacheDigest members;
+        for (Value *v : *facts)
+        {
+            members.combine(name_digests[getName(v)]);
+        }
+        CacheDigest d;
+        d.add(facts->size());
+        d.add(members);
+        return d;
+    }
+
+    bool checkReads(unsigned ctx, const VisitRecord &record)
+    {
+        for (auto ri = record.reads.begin(), re = record.reads.end(); ri != re; ri++)
+        {
+            Value *v = resolve(ri->first);
+            if (!v || digestFacts(visitor.getTopLevel(ctx, v)) != ri->second)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    std::vector<std::pair<unsigned, std::vector<unsigned>>> encodeMap(const LiveVarsToMap &map)
+    {
+        std::vector<std::pair<unsigned, std::vector<unsigned>>> entries;
+        for (auto mi = map.begin(), me = map.end(); mi != me; mi++)
+        {
+            std::vector<unsigned> values;
+            for (Value *v : mi->second)
+            {
+                values.push_back(getName(v));
+            }
+            entries.push_back(std::make_pair(getName(mi->first), values));
+        }
+        return entries;
+    }
+
+    CacheDigest digestEntries(const std::vector<std::pair<unsigned, std::vector<unsigned>>> &entries)
+    {
+        CacheDigest sum;
+        for (auto ei = entries.begin(), ee = entries.end(); ei != ee; ei++)
+        {
+            CacheDigest members;
+            for (unsigned v : ei->second)
+            {
+                members.combine(name_digests[v]);
+            }
+            CacheDigest entry;
+            entry.add(name_digests[ei->first]);
+            entry.add(ei->second.size());
+            entry.add(members);
+            sum.combine(entry);
+        }
+        CacheDigest d;
+        d.add(entries.size());
+        d.add(sum);
+        return d;
+    }
+
+    CacheDigest digestState(const EncodedState &state)
+    {
+        CacheDigest d;
+        d.add(digestEntries(state.vars));
+        d.add(digestEntries(state.fields));
+        return d;
+    }
+
+    /// Index of state in the pool, shared by every visit that has it
+    unsigned addState(const LivenessInfo &state)
+    {
+        EncodedState encoded;
+        encoded.vars = encodeMap(state.LiveVars_map);
+        encoded.fields = encodeMap(state.LiveVars_feild_map);
+        encoded.digest = digestState(encoded);
+        auto it = state_index.find(encoded.digest);
+        if (it != state_index.end())
+        {
+            return it->second;
+        }
+        unsigned index = states.size();
+        state_index.insert(std::make_pair(encoded.digest, index));
+        states.push_back(std::move(encoded));
+        return index;
+    }
+
+    bool decodeMap(const std::vector<std::pair<unsigned, std::vector<unsigned>>> &entries, LiveVarsToMap *map)
+    {
+        for (auto ei = entries.begin(), ee = entries.end(); ei != ee; ei++)
+        {
+            Value *key = resolve(ei->first);
+            if (!key)
+            {
+                return false;
+            }
+            ValueSet &values = (*map)[key];
+            for (unsigned v : ei->second)
+            {
+                Value *value = resolve(v);
+                if (!value)
+                {
+                    return false;
+                }
+                values.insert(value);
+            }
+        }
+        return true;
+    }
+
+    bool decodeState(unsigned index, LivenessInfo *state)
+    {
+        return decodeMap(states[index].vars, &state->LiveVars_map) &&
+               decodeMap(states[index].fields, &state->LiveVars_feild_map);
+    }
+
+    bool isResolvable(unsigned index)
+    {
+        state_checked.resize(states.size(), 0);
+        if (!state_checked[index])
+        {
+            LivenessInfo decoded;
+            state_checked[index] = decodeState(index, &decoded) ? 1 : -1;
+        }
+        return state_checked[index] > 0;
+    }
+
+    /// Decodes one dataflow value of a replayed function: half 0 is before instruction index, 1 after
+    void restorePoint(Function *fn, unsigned index, unsigned half)
+    {
+        auto it = pending.find(fn);
+        if (it == pending.end() || it->second.done[2 * index + half])
+        {
+            return;
+        }
+        it->second.done[2 * index + half] = true;
+        const std::pair<unsigned, unsigned> &point = records[it->second.record].points[index];
+        std::pair<LivenessInfo, LivenessInfo> &value = visitor.getResult(CallStringTable::EmptyContext)[instructions[fn][index]];
+        LivenessInfo &dfval = half ? value.second : value.first;
+        dfval = LivenessInfo();
+        decodeState(half ? point.second : point.first, &dfval);
+    }
+
+    void restoreAllPoints(Function *fn)
+    {
+        auto it = pending.find(fn);
+        if (it == pending.end())
+        {
+            return;
+        }
+        for (unsigned i = 0, e = it->second.done.size(); i != e; i++)
+        {
+            restorePoint(fn, i / 2, i % 2);
+        }
+        pending.erase(fn);
+    }
+
+    template <class T>
+    T *resolveAs(unsigned index)
+    {
+        Value *v = resolve(index);
+        return v ? dyn_cast<T>(v) : nullptr;
+    }
+
+    /// Everything a replay needs, false if some value no longer exists
+    bool decodeRecord(const VisitRecord &record, const FunctionContext &fc, FunctionState *state,
+                      std::vector<DecodedDelivery> *deliveries)
+    {
+        unsigned size = 0;
+        for (inst_iterator ii = inst_begin(fc.first), ie = inst_end(fc.first); ii != ie; ii++)
+        {
+            size++;
+        }
+        if (record.points.size() != size)
+        {
+            return false;
+        }
+        for (auto pi = record.points.begin(), pe = record.points.end(); pi != pe; pi++)
+        {
+            if (!isResolvable(pi->first) || !isResolvable(pi->second))
+            {
+                return false;
+            }
+        }
+        if (!decodeMap(record.top_level, &state->top_level))
+        {
+            return false;
+        }
+        for (unsigned site : record.return_sites)
+        {
+            CallInst *callInst = resolveAs<CallInst>(site);
+            if (!callInst)
+            {
+                return false;
+            }
+            state->return_sites.insert(std::make_pair(callInst, fc.second));
+        }
+        for (auto ci = record.callees.begin(), ce = record.callees.end(); ci != ce; ci++)
+        {
+            CallInst *callInst = resolveAs<CallInst>(ci->first);
+            if (!callInst)
+            {
+                return false;
+            }
+            FunctionSet &callees = state->callees[callInst];
+            for (unsigned callee : ci->second)
+            {
+                Function *F = resolveAs<Function>(callee);
+                if (!F)
+                {
+                    return false;
+                }
+                callees.insert(F);
+            }
+        }
+        for (auto di = record.deliveries.begin(), de = record.deliveries.end(); di != de; di++)
+        {
+            deliveries->emplace_back();
+            DecodedDelivery &decoded = deliveries->back();
+            CallInst *callInst = resolveAs<CallInst>(di->site);
+            decoded.target = resolveAs<Function>(di->target);
+            if (!callInst || !decoded.target || (di->state && !decodeState(di->state - 1, &decoded.state)))
+            {
+                return false;
+            }
+            decoded.site = std::make_pair(callInst, fc.second);
+        }
+        return true;
+    }
+
+    static void writeEntries(ByteWriter &w, const std::vector<std::pair<unsigned, std::vector<unsigned>>> &entries,
+                             const std::vector<unsigned> &remap)
+    {
+        w.writeVarint(entries.size());
+        for (auto ei = entries.begin(), ee = entries.end(); ei != ee; ei++)
+        {
+            w.writeVarint(remap[ei->first]);
+            w.writeVarint(ei->second.size());
+            for (unsigned v : ei->second)
+            {
+                w.writeVarint(remap[v]);
+            }
+        }
+    }
+
+    static bool readEntries(ByteReader &r, unsigned num_names, std::vector<std::pair<unsigned, std::vector<unsigned>>> *entries)
+    {
+        for (uint64_t i = 0, e = r.readVarint(); i != e && !r.hasError(); i++)
+        {
+            unsigned key = r.readVarint();
+            std::vector<unsigned> values;
+            for (uint64_t j = 0, je = r.readVarint(); j != je && !r.hasError(); j++)
+            {
+                values.push_back(r.readVarint());
+                if (values.back() >= num_names)
+                    return false;
+            }
+            if (key >= num_names)
+            {
+                return false;
+            }
+            entries->push_back(std::make_pair(key, values));
+        }
+        return !r.hasError();
+    }
+
+    typedef std::map<unsigned, std::vector<unsigned>> EntryMap;
+
+    /// Writes entries as the keys dropped from and the entries changed
+    /// against base, the entries of the state written before
+    static void writeEntriesDelta(ByteWriter &w, const std::vector<std::pair<unsigned, std::vector<unsigned>>> &entries,
+                                  const std::vector<std::pair<unsigned, std::vector<unsigned>>> &base,
+                                  const std::vector<unsigned> &remap)
+    {
+        std::map<unsigned, const std::vector<unsigned> *> previous;
+        for (auto ei = base.begin(), ee = base.end(); ei != ee; ei++)
+        {
+            previous[ei->first] = &ei->second;
+        }
+        std::vector<std::pair<unsigned, std::vector<unsigned>>> changed;
+        for (auto ei = entries.begin(), ee = entries.end(); ei != ee; ei++)
+        {
+            auto pi = previous.find(ei->first);
+            if (pi != previous.end() && *pi->second == ei->second)
+            {
+                previous.erase(pi);
+                continue;
+            }
+            if (pi != previous.end())
+                previous.erase(pi);
+            changed.push_back(*ei);
+        }
+        // previous 中剩下的是这个状态里没有的键
+        w.writeVarint(previous.size());
+        for (auto pi = previous.begin(), pe = previous.end(); pi != pe; pi++)
+        {
+            w.writeVarint(remap[pi->first]);
+        }
+        writeEntries(w, changed, remap);
+    }
+
+    static bool readEntriesDelta(ByteReader &r, unsigned num_names, EntryMap *current,
+                                 std::vector<std::pair<unsigned, std::vector<unsigned>>> *entries)
+    {
+        for (uint64_t i = 0, e = r.readVarint(); i != e && !r.hasError(); i++)
+        {
+            current->erase(r.readVarint());
+        }
+        std::vector<std::pair<unsigned, std::vector<unsigned>>> changed;
+        if (!readEntries(r, num_names, &changed))
+        {
+            return false;
+        }
+        for (auto ci = changed.begin(), ce = changed.end(); ci != ce; ci++)
+        {
+            (*current)[ci->first] = std::move(ci->second);
+        }
+        entries->assign(current->begin(), current->end());
+        return true;
+    }
+
+    static void markEntries(const std::vector<std::pair<unsigned, std::vector<unsigned>>> &entries, std::vector<unsigned> *remap)
+    {
+        for (auto ei = entries.begin(), ee = entries.end(); ei != ee; ei++)
+        {
+            (*remap)[ei->first] = 1;
+            for (unsigned v : ei->second)
+            {
+                (*remap)[v] = 1;
+            }
+        }
+    }
+
+    ///
+    /// Format: magic, version, options, then the names, the state pool and
+    /// the visits, each a count followed by its items. Only what the used
+    /// visits refer to is written, renumbered in order of first appearance.
+    ///
+    void write(raw_ostream &out)
+    {
+        std::vector<unsigned> state_map(states.size(), 0), name_map(names.size(), 0);
+        for (const VisitRecord &record : records)
+        {
+            if (!record.used)
+            {
+                continue;
+            }
+            name_map[record.function] = 1;
+            for (auto ri = record.reads.begin(), re = record.reads.end(); ri != re; ri++)
+                name_map[ri->first] = 1;
+            for (auto pi = record.points.begin(), pe = record.points.end(); pi != pe; pi++)
+            {
+                state_map[pi->first] = 1;
+                state_map[pi->second] = 1;
+            }
+            markEntries(record.top_level, &name_map);
+            for (unsigned site : record.return_sites)
+                name_map[site] = 1;
+            markEntries(record.callees, &name_map);
+            for (const Delivery &delivery : record.deliveries)
+            {
+                name_map[delivery.target] = 1;
+                name_map[delivery.site] = 1;
+                if (delivery.state)
+                    state_map[delivery.state - 1] = 1;
+            }
+        }
+        for (unsigned s = 0; s < states.size(); s++)
+        {
+            if (state_map[s])
+            {
+                markEntries(states[s].vars, &name_map);
+                markEntries(states[s].fields, &name_map);
+            }
+        }
+        unsigned num_names = 0, num_states = 0;
+        for (unsigned &n : name_map)
+        {
+            n = n ? num_names++ : ~0u;
+        }
+        for (unsigned &s : state_map)
+        {
+            s = s ? num_states++ : ~0u;
+        }
+
+        ByteWriter w(out);
+        w.writeBytes("FPCACHE");
+        w.writeVarint(2);
+        w.writeVarint(options);
+        w.writeVarint(num_names);
+        for (unsigned n = 0; n < names.size(); n++)
+        {
+            if (name_map[n] != ~0u)
+                w.writeString(names[n]);
+        }
+        // 相继写出的状态大多只差几项, 每个状态只写与前一个的差别
+        w.writeVarint(num_states);
+        const EncodedState empty_state;
+        const EncodedState *previous_state = &empty_state;
+        for (unsigned s = 0; s < states.size(); s++)
+        {
+            if (state_map[s] == ~0u)
+            {
+                continue;
+            }
+            writeEntriesDelta(w, states[s].vars, previous_state->vars, name_map);
+            writeEntriesDelta(w, states[s].fields, previous_state->fields, name_map);
+            previous_state = &states[s];
+        }
+        unsigned num_records = 0;
+        for (const VisitRecord &record : records)
+        {
+            num_records += record.used;
+        }
+        w.writeVarint(num_records);
+        // 同一函数相邻两次访问之间多数程序点不变, 只写变了的
+        std::map<unsigned, std::pair<unsigned, const VisitRecord *>> previous;
+        unsigned written = 0;
+        for (const VisitRecord &record : records)
+        {
+            if (!record.used)
+            {
+                continue;
+            }
+            w.writeVarint(record.key.lo);
+            w.writeVarint(record.key.hi);
+            w.writeVarint(name_map[record.function]);
+            w.writeVarint(record.reads.size());
+            for (auto ri = record.reads.begin(), re = record.reads.end(); ri != re; ri++)
+            {
+                w.writeVarint(name_map[ri->first]);
+                w.writeVarint(ri->second.lo);
+                w.writeVarint(ri->second.hi);
+            }
+            auto pi = previous.find(record.function);
+            const VisitRecord *base = pi != previous.end() && pi->second.second->points.size() == record.points.size()
+                                          ? pi->second.second : nullptr;
+            w.writeVarint(base ? pi->second.first + 1 : 0);
+            std::vector<unsigned> changed;
+            for (unsigned i = 0; i < record.points.size(); i++)
+            {
+                if (!base || base->points[i] != record.points[i])
+                    changed.push_back(i);
+            }
+            w.writeVarint(changed.size());
+            unsigned last = 0;
+            for (unsigned i : changed)
+            {
+                w.writeVarint(i - last);
+                w.writeVarint(state_map[record.points[i].first]);
+                w.writeVarint(state_map[record.points[i].second]);
+                last = i;
+            }
+            previous[record.function] = std::make_pair(written++, &record);
+            writeEntries(w, record.top_level, name_map);
+            w.writeVarint(record.return_sites.size());
+            for (unsigned site : record.return_sites)
+            {
+                w.writeVarint(name_map[site]);
+            }
+            writeEntries(w, record.callees, name_map);
+            w.writeVarint(record.status);
+            w.writeVarint(record.requeue);
+            w.writeVarint(record.deliveries.size());
+            for (const Delivery &delivery : record.deliveries)
+            {
+                w.writeVarint(delivery.exit);
+                w.writeVarint(name_map[delivery.target]);
+                w.writeVarint(name_map[delivery.site]);
+                w.writeVarint(delivery.state ? state_map[delivery.state - 1] + 1 : 0);
+            }
+        }
+    }
+
+    bool read(StringRef buffer)
+    {
+        ByteReader r(buffer);
+        if (!r.expectBytes("FPCACHE") || r.readVarint() != 2 || r.readVarint() != options)
+        {
+            return false;
+        }
+        for (uint64_t i = 0, e = r.readVarint(); i != e && !r.hasError(); i++)
+        {
+            addName(r.readString());
+        }
+        unsigned num_names = names.size();
+        EntryMap vars, fields;
+        for (uint64_t i = 0, e = r.readVarint(); i != e && !r.hasError(); i++)
+        {
+            EncodedState state;
+            if (!readEntriesDelta(r, num_names, &vars, &state.vars) ||
+                !readEntriesDelta(r, num_names, &fields, &state.fields))
+            {
+                return false;
+            }
+            state.digest = digestState(state);
+            state_index.insert(std::make_pair(state.digest, states.size()));
+            states.push_back(std::move(state));
+        }
+        unsigned num_states = states.size();
+        for (uint64_t i = 0, e = r.readVarint(); i != e && !r.hasError(); i++)
+        {
+            VisitRecord record;
+            record.key.lo = r.readVarint();
+            record.key.hi = r.readVarint();
+            record.function = r.readVarint();
+            for (uint64_t j = 0, je = r.readVarint(); j != je && !r.hasError(); j++)
+            {
+                unsigned v = r.readVarint();
+                CacheDigest d;
+                d.lo = r.readVarint();
+                d.hi = r.readVarint();
+                record.reads.push_back(std::make_pair(v, d));
+                if (v >= num_names)
+                    return false;
+            }
+            uint64_t base = r.readVarint();
+            if (base > records.size())
+            {
+                return false;
+            }
+            unsigned index = 0;
+            for (uint64_t j = 0, je = r.readVarint(); j != je && !r.hasError(); j++)
+            {
+                index += r.readVarint();
+                unsigned in = r.readVarint(), out = r.readVarint();
+                if (in >= num_states || out >= num_states)
+                    return false;
+                if (base)
+                {
+                    if (record.points.empty())
+                        record.points = records[base - 1].points;
+                    if (index >= record.points.size())
+                        return false;
+                    record.points[index] = std::make_pair(in, out);
+                }
+                else
+                {
+                    if (index != record.points.size())
+                        return false;
+                    record.points.push_back(std::make_pair(in, out));
+                }
+            }
+            if (base && record.points.empty())
+            {
+                record.points = records[base - 1].points;
+            }
+            if (!readEntries(r, num_names, &record.top_level))
+            {
+                return false;
+            }
+            for (uint64_t j = 0, je = r.readVarint(); j != je && !r.hasError(); j++)
+            {
+                record.return_sites.push_back(r.readVarint());
+                if (record.return_sites.back() >= num_names)
+                    return false;
+            }
+            if (!readEntries(r, num_names, &record.callees))
+            {
+                return false;
+            }
+            record.status = r.readVarint();
+            record.requeue = r.readVarint();
+            for (uint64_t j = 0, je = r.readVarint(); j != je && !r.hasError(); j++)
+            {
+                Delivery delivery;
+                delivery.exit = r.readVarint();
+                delivery.target = r.readVarint();
+                delivery.site = r.readVarint();
+                delivery.state = r.readVarint();
+                if (delivery.target >= num_names || delivery.site >= num_names || delivery.state > num_states)
+                    return false;
+                record.deliveries.push_back(delivery);
+            }
+            if (record.function >= num_names || record.status > DF_ExceededStateSize + 1)
+            {
+                return false;
+            }
+            record_index.insert(std::make_pair(record.key, records.size()));
+            records.push_back(std::move(record));
+        }
+        return !r.hasError() && r.atEnd();
+    }
+};
+
+#endif /* !_VISITCACHE_H_ */
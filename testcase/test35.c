@@ -0,0 +1,28 @@
+#include <stdlib.h>
+int plus(int a, int b) {
+   return a+b;
+}
+
+int minus(int a, int b) {
+   return a-b;
+}
+
+void keep(int (**pp)(int, int)) {
+}
+
+void set(int (**pp)(int, int)) {
+    *pp = minus;
+}
+
+int main(int argc, char **argv) {
+    int (*fp)(int, int) = plus;
+    void (*h)(int (**)(int, int)) = keep;
+    if (argc > 1)
+        h = set;
+    h(&fp);
+    fp(1, 2);
+    return 0;
+}
+
+// 22 : keep, set
+// 23 : plus, minus
@@ -0,0 +1,29 @@
+// assignment -mode=sparse test36.bc
+int plus(int a, int b) {
+   return a+b;
+}
+
+int minus(int a, int b) {
+   return a-b;
+}
+
+void set(int (**pp)(int, int), int (*f)(int, int)) {
+    *pp = f;
+}
+
+void twice(int (**pp)(int, int)) {
+    set(pp, minus);
+}
+
+int main() {
+    int (*fp)(int, int) = plus;
+    fp(1, 2);
+    twice(&fp);
+    fp(1, 2);
+    return 0;
+}
+
+// 15 : set
+// 20 : plus
+// 21 : twice
+// 22 : minus
@@ -0,0 +1,23 @@
+// assignment -mode=steensgaard test39.bc
+int plus(int a, int b) {
+   return a+b;
+}
+
+int minus(int a, int b) {
+   return a-b;
+}
+
+int (*fp)(int, int);
+int (*gp)(int, int);
+
+int main() {
+    fp = plus;
+    gp = minus;
+    fp = gp;
+    fp(1, 2);
+    gp(1, 2);
+    return 0;
+}
+
+// 17 : plus, minus
+// 18 : plus, minus
@@ -0,0 +1,34 @@
+// assignment -mode=types test40.bc
+int plus(int a, int b) {
+   return a+b;
+}
+
+int minus(int a, int b) {
+   return a-b;
+}
+
+int neg(int a) {
+   return -a;
+}
+
+int times(int a, int b) {
+   return a*b;
+}
+
+int (*fp)(int, int);
+int (*up)(int);
+
+int main() {
+    fp = plus;
+    up = neg;
+    fp(1, 2);
+    up(1);
+    fp = minus;
+    fp(1, 2);
+    return times(1, 2);
+}
+
+// 24 : plus, minus
+// 25 : neg
+// 27 : plus, minus
+// 28 : times
@@ -0,0 +1,27 @@
+// assignment -query=14,21 test41.bc
+int plus(int a, int b) {
+   return a+b;
+}
+
+int minus(int a, int b) {
+   return a-b;
+}
+
+int (*fp)(int, int);
+int (*gp)(int, int);
+
+int apply(int (*f)(int, int), int a) {
+    return f(a, a);
+}
+
+int main() {
+    fp = plus;
+    gp = minus;
+    apply(fp, 1);
+    gp(1, 2);
+    fp(3, 4);
+    return 0;
+}
+
+// 14 : plus
+// 21 : minus
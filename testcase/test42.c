@@ -0,0 +1,32 @@
+// assignment -slice test42.bc
+int plus(int a, int b) {
+   return a+b;
+}
+
+int minus(int a, int b) {
+   return a-b;
+}
+
+int table[16];
+int (*fp)(int, int);
+
+int fill(int n) {
+    int sum = 0;
+    for (int i = 0; i < n; i++) {
+        table[i] = i * i;
+        sum += table[i];
+    }
+    return sum;
+}
+
+int main() {
+    fp = plus;
+    int s = fill(16);
+    fp(s, 1);
+    fp = minus;
+    return fp(s, 2);
+}
+
+// 24 : fill
+// 25 : plus
+// 27 : minus
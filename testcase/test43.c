@@ -0,0 +1,23 @@
+// assignment -entry=start test43.bc
+int plus(int a, int b) {
+   return a+b;
+}
+
+int minus(int a, int b) {
+   return a-b;
+}
+
+int run(int (*f)(int, int), int a) {
+    return f(a, a);
+}
+
+int start() {
+    return run(plus, 1);
+}
+
+int main() {
+    return run(minus, 2);
+}
+
+// 11 : plus
+// 15 : run
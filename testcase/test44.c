@@ -0,0 +1,26 @@
+// assignment -lazy test44.bc
+static int plus(int a, int b) {
+   return a+b;
+}
+
+static int minus(int a, int b) {
+   return a-b;
+}
+
+static int apply(int (*f)(int, int), int a) {
+    return f(a, a);
+}
+
+static int unused(int (*f)(int, int)) {
+    return f(0, 0);
+}
+
+int main() {
+    int (*g)(int (*)(int, int), int) = apply;
+    g(plus, 1);
+    return apply(minus, 2);
+}
+
+// 11 : plus, minus
+// 20 : apply
+// 21 : apply
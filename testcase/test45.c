@@ -0,0 +1,28 @@
+// assignment -batch=test45.txt
+int plus(int a, int b) {
+   return a+b;
+}
+
+int minus(int a, int b) {
+   return a-b;
+}
+
+struct op {
+    int (*f)(int, int);
+};
+
+int main() {
+    struct op o;
+    o.f = plus;
+    o.f(1, 2);
+    o.f = minus;
+    return o.f(3, 4);
+}
+
+// ==> test45.bc <==
+// 17 : plus
+// 19 : minus
+// ==> test10.bc <==
+// 25 : malloc
+// 31 : minus
+// 37 : plus
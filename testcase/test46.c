@@ -0,0 +1,18 @@
+// assignment test46.bc test46_lib.bc
+int plus(int a, int b) {
+   return a+b;
+}
+
+int minus(int a, int b);
+int apply(int (*f)(int, int), int a);
+
+int main() {
+    apply(plus, 1);
+    return apply(minus, 2);
+}
+
+// ==> test46.bc <==
+// 10 : apply
+// 11 : apply
+// ==> test46_lib.bc <==
+// 6 : plus, minus
@@ -0,0 +1,7 @@
+int minus(int a, int b) {
+   return a-b;
+}
+
+int apply(int (*f)(int, int), int a) {
+    return f(a, a);
+}
@@ -0,0 +1,18 @@
+// assignment -summary-dir=. test47.bc test47_lib.bc
+// assignment -summary-index test47.fps test47_lib.fps
+int plus(int a, int b) {
+   return a+b;
+}
+
+extern int (*handler)(int, int);
+int dispatch(int a);
+
+int main() {
+    handler = plus;
+    return dispatch(1);
+}
+
+// ==> test47.bc <==
+// 12 : dispatch
+// ==> test47_lib.bc <==
+// 12 : plus, minus
@@ -0,0 +1,13 @@
+int minus(int a, int b) {
+   return a-b;
+}
+
+int (*handler)(int, int);
+
+void reset() {
+    handler = minus;
+}
+
+int dispatch(int a) {
+    return handler(a, a);
+}
@@ -0,0 +1,33 @@
+// assignment -shards=2 test48.bc
+int plus(int a, int b) {
+   return a+b;
+}
+
+int minus(int a, int b) {
+   return a-b;
+}
+
+void pick(int (**pp)(int, int), int sub) {
+    if (sub)
+        *pp = minus;
+    else
+        *pp = plus;
+}
+
+int call(int (*f)(int, int), int a) {
+    return f(a, a);
+}
+
+int main() {
+    int (*fp)(int, int);
+    pick(&fp, 0);
+    call(fp, 1);
+    pick(&fp, 1);
+    return call(fp, 2);
+}
+
+// 18 : plus, minus
+// 23 : pick
+// 24 : call
+// 25 : pick
+// 26 : call
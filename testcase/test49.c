@@ -0,0 +1,28 @@
+// assignment -cache-dir=. test49.bc
+int plus(int a, int b) {
+   return a+b;
+}
+
+int minus(int a, int b) {
+   return a-b;
+}
+
+int run(int (*f)(int, int), int a) {
+    return f(a, a);
+}
+
+int twice(int (*f)(int, int), int a) {
+    int x = run(f, a);
+    return run(f, x);
+}
+
+int main() {
+    twice(plus, 1);
+    return twice(minus, 2);
+}
+
+// 11 : plus, minus
+// 15 : run
+// 16 : run
+// 20 : twice
+// 21 : twice
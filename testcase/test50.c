@@ -0,0 +1,29 @@
+// assignment -checkpoint-dir=. -checkpoint-interval=0 test50.bc
+int plus(int a, int b) {
+   return a+b;
+}
+
+int minus(int a, int b) {
+   return a-b;
+}
+
+int down(int (*f)(int, int), int n);
+
+int up(int (*f)(int, int), int n) {
+    return down(f, n - 1);
+}
+
+int down(int (*f)(int, int), int n) {
+    if (n <= 0)
+        return f(n, n);
+    return up(minus, n);
+}
+
+int main() {
+    return up(plus, 3);
+}
+
+// 13 : down
+// 18 : plus, minus
+// 19 : up
+// 23 : up
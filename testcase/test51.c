@@ -0,0 +1,25 @@
+// printf 'test51.c:11\nmain\nnosuch\n' | assignment -serve test51.bc
+int plus(int a, int b) {
+   return a+b;
+}
+
+int minus(int a, int b) {
+   return a-b;
+}
+
+int apply(int (*f)(int, int), int a) {
+    return f(a, a);
+}
+
+int main() {
+    apply(plus, 1);
+    return apply(minus, 2);
+}
+
+// 11 : plus, minus
+//
+// 15 : apply
+// 16 : apply
+//
+// error: no call in a function named nosuch
+//
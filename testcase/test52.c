@@ -0,0 +1,24 @@
+// opt -load-pass-plugin=FuncPtrPlugin.so -passes='function(mem2reg),print<funcptr>' -disable-output test52.bc
+int plus(int a, int b) {
+   return a+b;
+}
+
+int minus(int a, int b) {
+   return a-b;
+}
+
+int apply(int (*f)(int, int), int a) {
+    return f(a, a);
+}
+
+int main() {
+    int (*none)(int, int) = 0;
+    apply(plus, 1);
+    if (none)
+        none(1, 2);
+    return 0;
+}
+
+// 11 : plus
+// 16 : apply
+// 18 : 
@@ -0,0 +1,37 @@
+// assignment -slice test53.bc
+int plus(int a, int b) {
+   return a+b;
+}
+
+int minus(int a, int b) {
+   return a-b;
+}
+
+int count;
+
+void tick(int n) {
+    count += n;
+}
+
+void keep(int (**pp)(int, int)) {
+}
+
+void set(int (**pp)(int, int)) {
+    *pp = minus;
+}
+
+int main(int argc, char **argv) {
+    int (*fp)(int, int) = plus;
+    void (*h)(int (**)(int, int)) = keep;
+    tick(1);
+    fp(1, 2);
+    if (argc > 1)
+        h = set;
+    h(&fp);
+    return fp(3, 4);
+}
+
+// 26 : tick
+// 27 : plus
+// 30 : keep, set
+// 31 : plus, minus
@@ -0,0 +1,43 @@
+// assignment -context-k=1 test55.bc
+int plus(int a, int b) {
+   return a+b;
+}
+
+int minus(int a, int b) {
+   return a-b;
+}
+
+struct fptr {
+    int (*p_fptr)(int, int);
+};
+
+struct wrap {
+    struct fptr *f;
+};
+
+void swap(struct wrap *a, struct wrap *b) {
+    struct wrap t = *a;
+    *a = *b;
+    *b = t;
+}
+
+int main() {
+    struct fptr pf;
+    pf.p_fptr = plus;
+    struct fptr mf;
+    mf.p_fptr = minus;
+    struct wrap x;
+    x.f = &pf;
+    struct wrap y;
+    y.f = &mf;
+    swap(&x, &y);
+    x.f->p_fptr(1, 2);
+    swap(&x, &y);
+    x.f->p_fptr(1, 2);
+    return 0;
+}
+
+// 33 : swap
+// 34 : minus
+// 35 : swap
+// 36 : plus
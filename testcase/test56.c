@@ -0,0 +1,30 @@
+// assignment -cache-dir=. test56.bc
+// assignment -cache-dir=. -print-stats test56.bc
+int plus(int a, int b) {
+   return a+b;
+}
+
+int minus(int a, int b) {
+   return a-b;
+}
+
+int run(int (*f)(int, int), int a) {
+    return f(a, a);
+}
+
+int twice(int (*f)(int, int), int a) {
+    int x = run(f, a);
+    return run(f, x);
+}
+
+int main() {
+    twice(plus, 1);
+    return twice(minus, 2);
+}
+
+// 12 : plus, minus
+// 16 : run
+// 17 : run
+// 21 : twice
+// 22 : twice
+// cache: 16 visits replayed, 0 analysed (0 of 5 functions), 1 KB written
@@ -0,0 +1,30 @@
+// assignment -checkpoint-dir=. -checkpoint-interval=0 -checkpoint-stop=3 test57.bc
+// assignment -checkpoint-dir=. -print-stats test57.bc
+int plus(int a, int b) {
+   return a+b;
+}
+
+int minus(int a, int b) {
+   return a-b;
+}
+
+int run(int (*f)(int, int), int a) {
+    return f(a, a);
+}
+
+int twice(int (*f)(int, int), int a) {
+    int x = run(f, a);
+    return run(f, x);
+}
+
+int main() {
+    twice(plus, 1);
+    return twice(minus, 2);
+}
+
+// 12 : plus, minus
+// 16 : run
+// 17 : run
+// 21 : twice
+// 22 : twice
+// checkpoint: resumed with 2 functions queued, 0 written
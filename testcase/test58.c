@@ -0,0 +1,36 @@
+int plus(int a, int b) {
+   return a+b;
+}
+
+int minus(int a, int b) {
+   return a-b;
+}
+
+struct fptr {
+    int (*p_fptr)(int, int);
+};
+
+int (*g)(int, int);
+
+void set(struct fptr *t) {
+    t->p_fptr = g;
+    g = minus;
+}
+
+int main() {
+    struct fptr s;
+    s.p_fptr = minus;
+    struct fptr t;
+    t.p_fptr = minus;
+    g = plus;
+    set(&t);
+    s.p_fptr(1, 2);
+    t.p_fptr(1, 2);
+    g(1, 2);
+    return 0;
+}
+
+// 27 : set
+// 28 : minus
+// 29 : plus
+// 30 : minus
@@ -0,0 +1,33 @@
+// assignment -max-block-visits=3 test59.bc
+int plus(int a, int b) {
+   return a+b;
+}
+
+int minus(int a, int b) {
+   return a-b;
+}
+
+struct fptr {
+    int (*p_fptr)(int, int);
+};
+
+int run(struct fptr *s, int n) {
+    int r = 0;
+    s->p_fptr = minus;
+    for (int i = 0; i < n; i++)
+        r += s->p_fptr(i, n);
+    return r;
+}
+
+int main() {
+    struct fptr s;
+    s.p_fptr = plus;
+    run(&s, 3);
+    s.p_fptr(1, 2);
+    return 0;
+}
+
+// 18 : plus, minus
+// 25 : run
+// 26 : plus, minus
+// degraded run (context 0): block visits
@@ -0,0 +1,36 @@
+int plus(int a, int b) {
+   return a+b;
+}
+
+int minus(int a, int b) {
+   return a-b;
+}
+
+struct fptr {
+    int (*p_fptr)(int, int);
+};
+
+int (*get(struct fptr *s))(int, int) {
+    return s->p_fptr;
+}
+
+int main(int argc) {
+    struct fptr s;
+    s.p_fptr = plus;
+    int (*f)(int, int) = get(&s);
+    s.p_fptr = minus;
+    int (*g)(int, int) = s.p_fptr;
+    f(1, 2);
+    g(1, 2);
+    int (*h)(int, int) = f;
+    for (int i = 0; i < argc; i++) {
+        h(1, 2);
+        h = g;
+    }
+    return 0;
+}
+
+// 20 : get
+// 23 : plus
+// 24 : minus
+// 27 : plus, minus
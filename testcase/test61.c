@@ -0,0 +1,31 @@
+int plus(int a, int b) {
+   return a+b;
+}
+
+int minus(int a, int b) {
+   return a-b;
+}
+
+struct fptr {
+    int (*p_fptr)(int, int);
+};
+
+int main(int argc) {
+    struct fptr s;
+    *(int (**)(int, int))&s = minus;
+    void *v = (void *)plus;
+    struct fptr t;
+    t = s;
+    t.p_fptr(1, 2);
+    ((int (*)(int, int))v)(1, 2);
+    int (*g)(int, int);
+    do {
+        g = s.p_fptr;
+    } while (--argc > 0);
+    g(1, 2);
+    return 0;
+}
+
+// 19 : minus
+// 20 : plus
+// 25 : minus
@@ -0,0 +1,39 @@
+// assignment -print-stats test62.bc
+int plus(int a, int b) {
+   return a+b;
+}
+
+int minus(int a, int b) {
+   return a-b;
+}
+
+struct fptr {
+    int (*p_fptr)(int, int);
+};
+
+int apply(int (*f)(int, int)) {
+    return f(1, 2);
+}
+
+int main(int argc) {
+    int (*f)(int, int) = argc > 1 ? plus : minus;
+    f(1, 2);
+    apply(argc > 2 ? f : plus);
+    struct fptr a;
+    a.p_fptr = plus;
+    struct fptr b;
+    b.p_fptr = minus;
+    struct fptr *p = argc > 3 ? &a : &b;
+    p->p_fptr(1, 2);
+    a.p_fptr = minus;
+    p = argc > 4 ? &a : &a;
+    p->p_fptr(1, 2);
+    return 0;
+}
+
+// 15 : plus, minus
+// 20 : plus, minus
+// 21 : apply
+// 27 : plus, minus
+// 30 : minus
+// fast path: 1 of 4 indirect call sites (25.0%)